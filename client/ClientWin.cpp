@@ -18,6 +18,7 @@
 #include "Log.h"
 #include "Profiler.h"
 #include "GLFrame.h"
+#include "vglutil.h"
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -28,13 +29,37 @@ extern Display *maindpy;
 
 
 ClientWin::ClientWin(int dpynum_, Window window_, int drawMethod_,
-	bool stereo_) : drawMethod(drawMethod_), reqDrawMethod(drawMethod_),
-	fb(NULL), cfindex(0), deadYet(false), thread(NULL), stereo(stereo_)
+	bool stereo_, Socket *ackSocket_, CriticalSection *ackMutex_,
+	bool sendTimes_, int wakeFD_) :
+	drawMethod(drawMethod_), reqDrawMethod(drawMethod_), fb(NULL),
+	cframes(NULL), nframes(RECVBUFS), cfindex(0),
+	#ifdef USEXV
+	xvindex(0),
+	#endif
+	pool(NULL), jobs(NULL), newFrame(true), directState(0), directBytes(0),
+	lastEOF(NULL), curTileSize(0), lastTileSize(0),
+	profile(false), stalled(false), gets(0), stalls(0), lastReport(0.0), deadYet(false),
+	thread(NULL), stereo(stereo_), ackSocket(ackSocket_), ackMutex(ackMutex_),
+	sendTimes(sendTimes_), wakeFD(wakeFD_), parked(false)
 {
+	char *env=NULL;  int temp;
+
 	if(dpynum_<0 || dpynum_>65535 || !window_)
 		throw(Error("ClientWin::ClientWin()", "Invalid argument"));
 	dpynum=dpynum_;  window=window_;
 
+	if((env=getenv("VGLCLIENT_RECVBUFS"))!=NULL && strlen(env)>0
+		&& (temp=atoi(env))>=2)
+		nframes=min(temp, MAXRECVBUFS);
+	if((env=getenv("RRPROFILE"))!=NULL && !strncmp(env, "1", 1))
+		profile=true;
+	if((env=getenv("VGL_PROFILE"))!=NULL && !strncmp(env, "1", 1))
+		profile=true;
+	pool=DecodePool::getInstance();
+	if(pool->getThreads()<2) pool=NULL;
+	else nframes+=pool->getThreads();
+	_newcheck(cframes=new CompressedFrame[nframes]);
+	_newcheck(jobs=new DecodeJob[nframes]);
 	#ifdef USEXV
 	for(int i=0; i<NFRAMES; i++) xvframes[i]=NULL;
 	#endif
@@ -53,6 +78,7 @@ ClientWin::~ClientWin(void)
 	deadYet=true;
 	q.release();
 	if(thread) thread->stop();
+	waitForTiles();
 	if(fb) delete fb;
 	#ifdef USEXV
 	for(int i=0; i<NFRAMES; i++)
@@ -63,7 +89,9 @@ ClientWin::~ClientWin(void)
 		}
 	}
 	#endif
-	for(int i=0; i<NFRAMES; i++) cframes[i].signalComplete();
+	for(int i=0; i<nframes; i++) cframes[i].signalComplete();
+	delete [] cframes;
+	delete [] jobs;
 	if(thread) { delete thread;  thread=NULL; }
 }
 
@@ -95,12 +123,13 @@ void ClientWin::initGL(void)
 	}
 	if(newfb)
 	{
+		waitForTiles();
 		if(fb)
 		{
 			if(fb->isGL) delete ((GLFrame *)fb);
 			else delete ((FBXFrame *)fb);
 		}
-		fb=(Frame *)newfb;
+		fb=(Frame *)newfb;  newFrame=true;
 	}
 }
 
@@ -127,12 +156,13 @@ void ClientWin::initX11(void)
 	}
 	if(newfb)
 	{
+		waitForTiles();
 		if(fb)
 		{
 			if(fb->isGL) {delete ((GLFrame *)fb);}
 			else delete ((FBXFrame *)fb);
 		}
-		fb=(Frame *)newfb;
+		fb=(Frame *)newfb;  newFrame=true;
 	}
 }
 
@@ -143,35 +173,74 @@ int ClientWin::match(int dpynum_, Window window_)
 }
 
 
-Frame *ClientWin::getFrame(bool useXV)
+// If wait is false, then return NULL rather than waiting for the next buffer
+// to be released.
+Frame *ClientWin::getFrame(bool useXV, bool wait)
 {
-	Frame *f=NULL;
+	Frame *f=NULL;  bool complete;
 
 	if(thread) thread->checkError();
 	cfmutex.lock();
 	#ifdef USEXV
+	// XV frames are full-size images, so they are not worth queueing deeply.
 	if(useXV)
 	{
-		if(!xvframes[cfindex])
+		if(!xvframes[xvindex])
 		{
 			char dpystr[80];
 			sprintf(dpystr, ":%d.0", dpynum);
-			_newcheck(xvframes[cfindex]=new XVFrame(dpystr, window));
-			if(!xvframes[cfindex]) _throw("Could not allocate class instance");
+			_newcheck(xvframes[xvindex]=new XVFrame(dpystr, window));
+			if(!xvframes[xvindex]) _throw("Could not allocate class instance");
 		}
-		f=(Frame *)xvframes[cfindex];
+		f=(Frame *)xvframes[xvindex];
 	}
 	else
 	#endif
 	f=(Frame *)&cframes[cfindex];
-	cfindex=(cfindex+1)%NFRAMES;
+	complete=f->isComplete();
+	if(!complete && !wait)
+	{
+		if(profile && !stalled) countStall(true);
+		stalled=true;  parked=true;
+		cfmutex.unlock();
+		return NULL;
+	}
+	#ifdef USEXV
+	if(useXV) xvindex=(xvindex+1)%NFRAMES;
+	else
+	#endif
+	cfindex=(cfindex+1)%nframes;
 	cfmutex.unlock();
+	if(profile && !stalled) countStall(!complete);
+	stalled=false;
 	f->waitUntilComplete();
 	if(thread) thread->checkError();
+	// Grow the buffer ahead of time to fit the largest tile in the last two
+	// frames, so that the receiver rarely has to reallocate while a tile is
+	// arriving.
+	if(!f->isXV)
+		((CompressedFrame *)f)->reserve(max(curTileSize, lastTileSize));
 	return f;
 }
 
 
+// Report how often the network reader had to wait for the decoder to release
+// a receive buffer.  If this is high, then increasing VGLCLIENT_RECVBUFS may
+// help.
+void ClientWin::countStall(bool stalled)
+{
+	double now=timer.time();
+	gets++;  if(stalled) stalls++;
+	if(lastReport==0.0) lastReport=now;
+	if(now-lastReport>2.0)
+	{
+		vglout.PRINT("Recv Stall  - %7.2f%% of tiles (%ld / %ld buffers)\n",
+			(double)stalls*100./(double)gets, stalls, gets);
+		gets=stalls=0;  lastReport=now;
+	}
+}
+
+
 void ClientWin::drawFrame(Frame *f)
 {
 	if(thread) thread->checkError();
@@ -194,11 +263,94 @@ void ClientWin::drawFrame(Frame *f)
 			if(drawMethod==RR_DRAWAUTO) drawMethod=RR_DRAWX11;
 			initX11();
 		}
+		if(c->hdr.flags==RR_EOF)
+		{
+			lastTileSize=curTileSize;  curTileSize=0;
+			lastEOF=f;  directState=0;
+		}
+		else curTileSize=max(curTileSize, CompressedFrame::bufSize(c->hdr));
 	}
 	q.add(f);
 }
 
 
+// Uncompressed tiles can be received directly into the frame buffer, rather
+// than into the receive ring, if the frame buffer's pixel format is RGB.  This
+// is decided for each frame when its first tile arrives, at which point the
+// window thread must have finished drawing the previous frame.  Returns NULL if
+// the tile must be received into the ring.  If wait is false and the previous
+// frame is still being drawn, then this sets park to true and returns NULL.
+Frame *ClientWin::getDirectFrame(rrframeheader &h, int scale, bool wait,
+	bool &park)
+{
+	park=false;
+	if(thread) thread->checkError();
+	if(directState==0)
+	{
+		if(h.compress!=RRCOMP_RGB || h.flags!=0 || stereo || !fb)
+		{
+			directState=-1;  return NULL;
+		}
+		if(lastEOF && !lastEOF->isComplete())
+		{
+			if(!wait)
+			{
+				// Check again while holding cfmutex, so that releaseFrame() cannot
+				// miss the park.
+				CriticalSection::SafeLock l(cfmutex);
+				if(!lastEOF->isComplete()) { park=parked=true;  return NULL; }
+			}
+			else
+			{
+				// Waiting resets the event, so signal it again for getFrame().
+				lastEOF->waitUntilComplete();  lastEOF->signalComplete();
+				if(thread) thread->checkError();
+			}
+		}
+		CriticalSection::SafeLock l(mutex);
+		if(fb->isGL) ((GLFrame *)fb)->init(h, false, scale);
+		else ((FBXFrame *)fb)->init(h, scale);
+		if(fb->pixelSize==3 && !(fb->flags&(FRAME_BGR|FRAME_ALPHAFIRST))
+			&& fb->hdr.framew==h.framew && fb->hdr.frameh==h.frameh)
+			directState=1;
+		else directState=-1;
+	}
+	if(directState<0) return NULL;
+	if(h.x+h.width>fb->hdr.framew || h.y+h.height>fb->hdr.frameh
+		|| h.size!=(unsigned int)h.width*h.height*3)
+		_throw("Invalid uncompressed tile");
+	return fb;
+}
+
+
+// Mark f as free for reuse.  This is called by the window thread and by the
+// decode threads.  f is signaled before cfmutex is acquired, so a receiver that
+// checks f while holding cfmutex either sees that it is complete or has set
+// parked by the time that it is checked here.
+void ClientWin::releaseFrame(Frame *f)
+{
+	f->signalComplete();
+	if(wakeFD<0) return;
+	CriticalSection::SafeLock l(cfmutex);
+	if(parked)
+	{
+		char c=0;
+		parked=false;
+		if(write(wakeFD, &c, 1)<0) {}
+	}
+}
+
+
+// Called after a tile has been received directly into the frame buffer
+void ClientWin::tileReceived(rrframeheader &h)
+{
+	if(fb->isGL)
+		((GLFrame *)fb)->addDirtyRect(h.x, fb->hdr.frameh-h.y-h.height, h.width,
+			h.height);
+	directBytes+=h.size;
+}
+
+
 void ClientWin::run(void)
 {
 	Profiler pt("Total     "), pb("Blit      "), pd("Decompress");
@@ -225,21 +377,49 @@ void ClientWin::run(void)
 					bytes=0;
 					pt.startFrame();
 				}
+				else
+				{
+					f->times.decodeTime=f->times.drawTime=timer.usec();
+					sendAck(f);
+				}
 			}
 			else
 			#endif
 			{
 				if(f->hdr.flags==RR_EOF)
 				{
+					if(pool) { decodeGroup.wait();  newFrame=true; }
+					f->times.decodeTime=timer.usec();
 					pb.startFrame();
-					if(fb->isGL) ((GLFrame *)fb)->init(f->hdr, stereo);
-					else ((FBXFrame *)fb)->init(f->hdr);
+					if(fb->isGL) ((GLFrame *)fb)->init(f->hdr, stereo, f->scale);
+					else ((FBXFrame *)fb)->init(f->hdr, f->scale);
 					if(fb->isGL) ((GLFrame *)fb)->redraw();
 					else ((FBXFrame *)fb)->redraw();
 					pb.endFrame(fb->hdr.framew*fb->hdr.frameh, 0, 1);
+					bytes+=directBytes;  directBytes=0;
 					pt.endFrame(fb->hdr.framew*fb->hdr.frameh, bytes, 1);
 					bytes=0;
 					pt.startFrame();
+					f->times.drawTime=timer.usec();
+					sendAck(f);
+				}
+				else if(pool)
+				{
+					// The frame buffer is initialized only once per frame, since the
+					// decode threads may be writing to it.
+					CompressedFrame *cf=(CompressedFrame *)f;
+					if(newFrame)
+					{
+						if(fb->isGL)
+							((GLFrame *)fb)->init(cf->hdr, cf->stereo, cf->scale);
+						else ((FBXFrame *)fb)->init(cf->hdr, cf->scale);
+						newFrame=false;
+					}
+					DecodeJob *job=&jobs[cf-cframes];
+					job->fb=fb;  job->cf=cf;  job->win=this;  job->group=&decodeGroup;
+					bytes+=f->hdr.size;
+					pool->decode(job);
+					continue;
 				}
 				else
 				{
@@ -252,13 +432,48 @@ void ClientWin::run(void)
 					bytes+=f->hdr.size;
 				}
 			}
-			f->signalComplete();
+			releaseFrame(f);
 		}
 
 	}
 	catch(Error &e)
 	{
-		if(thread) thread->setError(e);  if(f) f->signalComplete();
+		if(thread) thread->setError(e);  if(f) releaseFrame(f);
 		throw;
 	}
 }
+
+
+void ClientWin::sendAck(Frame *f)
+{
+	if(!ackSocket) return;
+	char buf[sizeof_rrframeack+sizeof_rrframetimes];
+	rrframeack ack;  rrframetimes times=f->times;
+	ack.winid=f->hdr.winid;  ack.dpynum=f->hdr.dpynum;
+	if(!littleendian())
+	{
+		ack.winid=byteswap(ack.winid);  ack.dpynum=byteswap16(ack.dpynum);
+		times.stamp.seq=byteswap(times.stamp.seq);
+		times.stamp.time=byteswap(times.stamp.time);
+		times.recvTime=byteswap(times.recvTime);
+		times.decodeTime=byteswap(times.decodeTime);
+		times.drawTime=byteswap(times.drawTime);
+	}
+	memcpy(buf, &ack, sizeof_rrframeack);
+	memcpy(&buf[sizeof_rrframeack], &times, sizeof_rrframetimes);
+	CriticalSection::SafeLock l(*ackMutex);
+	ackSocket->send(buf, sizeof_rrframeack+(sendTimes? sizeof_rrframetimes:0));
+}
+
+
+// Wait for the decode pool to finish with this window's tiles.  Decompression
+// errors are reported by the window thread when it draws the frame.
+void ClientWin::waitForTiles(void)
+{
+	if(!pool) return;
+	try
+	{
+		decodeGroup.wait();
+	}
+	catch(...) {}
+}
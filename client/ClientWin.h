@@ -19,6 +19,9 @@
 #include "Frame.h"
 #include "Thread.h"
 #include "GenericQ.h"
+#include "Socket.h"
+#include "DecodePool.h"
+#include "Timer.h"
 
 
 enum {RR_DRAWAUTO=-1, RR_DRAWX11=0, RR_DRAWOGL};
@@ -30,10 +33,16 @@ namespace vglclient
 	{
 		public:
 
-			ClientWin(int dpynum, Window window, int drawMethod, bool stereo);
+			ClientWin(int dpynum, Window window, int drawMethod, bool stereo,
+				vglutil::Socket *ackSocket=NULL, vglutil::CriticalSection *ackMutex=NULL,
+				bool sendTimes=false, int wakeFD=-1);
 			virtual ~ClientWin(void);
-			vglcommon::Frame *getFrame(bool useXV);
+			vglcommon::Frame *getFrame(bool useXV, bool wait=true);
 			void drawFrame(vglcommon::Frame *f);
+			vglcommon::Frame *getDirectFrame(rrframeheader &h, int scale,
+				bool wait, bool &park);
+			void tileReceived(rrframeheader &h);
+			void releaseFrame(vglcommon::Frame *f);
 			int match(int dpynum, Window window);
 			bool isStereo(void) { return stereo; }
 
@@ -41,14 +50,34 @@ namespace vglclient
 
 			void initGL(void);
 			void initX11(void);
+			void sendAck(vglcommon::Frame *f);
 
 			int drawMethod, reqDrawMethod;
-			static const int NFRAMES=2;
+			// The receive ring has VGLCLIENT_RECVBUFS slots (default: RECVBUFS) plus
+			// one for each decode thread, so that the network reader can run ahead of
+			// the decoder.
+			static const int NFRAMES=2, RECVBUFS=8, MAXRECVBUFS=256;
 			vglcommon::Frame *fb;
-			vglcommon::CompressedFrame cframes[NFRAMES];  int cfindex;
+			vglcommon::CompressedFrame *cframes;  int nframes, cfindex;
 			#ifdef USEXV
-			vglcommon::XVFrame *xvframes[NFRAMES];
+			vglcommon::XVFrame *xvframes[NFRAMES];  int xvindex;
 			#endif
+			DecodePool *pool;
+			DecodeJob *jobs;
+			DecodeGroup decodeGroup;
+			bool newFrame;
+			void waitForTiles(void);
+			// Uncompressed frames are received directly into fb if its pixel
+			// format is RGB (see getDirectFrame().)  directState is 1 if the
+			// current frame is being received directly, -1 if it is not, or 0 if
+			// none of its tiles have been received yet.
+			int directState;  long directBytes;
+			vglcommon::Frame *lastEOF;
+			// Largest tile buffer size in the current and previous frame
+			unsigned long curTileSize, lastTileSize;
+			void countStall(bool stalled);
+			bool profile, stalled;  long gets, stalls;  double lastReport;
+			vglutil::Timer timer;
 			vglutil::GenericQ q;
 			bool deadYet;
 			int dpynum;  Window window;
@@ -57,6 +86,19 @@ namespace vglclient
 			vglutil::CriticalSection cfmutex;
 			bool stereo;
 			vglutil::CriticalSection mutex;
+			// If non-NULL, then an acknowledgment is sent to the server through
+			// ackSocket after each frame is displayed.  ackMutex is shared by all
+			// windows that use the same connection.  If sendTimes is true, then
+			// each acknowledgment is followed by the frame's latency times (protocol
+			// v2.5 and later.)
+			vglutil::Socket *ackSocket;
+			vglutil::CriticalSection *ackMutex;
+			bool sendTimes;
+			// If wakeFD is not -1, then a byte is written to it when a frame buffer
+			// is released while the receiver is parked on this window (that is,
+			// getFrame() or getDirectFrame() returned without waiting.)  parked is
+			// protected by cfmutex.
+			int wakeFD;  bool parked;
 	};
 }
 
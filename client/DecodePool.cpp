@@ -0,0 +1,147 @@
+/* Copyright (C)2014 D. R. Commander
+ *
+ * This library is free software and may be redistributed and/or modified under
+ * the terms of the wxWindows Library License, Version 3.1 or (at your option)
+ * any later version.  The full license is in the LICENSE.txt file included
+ * with this distribution.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * wxWindows Library License for more details.
+ */
+
+#include "DecodePool.h"
+#include "ClientWin.h"
+#include "GLFrame.h"
+#include "Log.h"
+#include "vglutil.h"
+
+using namespace vglutil;
+using namespace vglcommon;
+using namespace vglclient;
+
+
+void DecodeGroup::add(void)
+{
+	CriticalSection::SafeLock l(mutex);
+	pending++;
+}
+
+
+void DecodeGroup::done(Error *e)
+{
+	CriticalSection::SafeLock l(mutex);
+	if(e && !failed) { error=*e;  failed=true; }
+	if(--pending<=0) event.signal();
+}
+
+
+// Wait for all outstanding tiles to be decompressed, and rethrow the first
+// error that occurred while decompressing them.  Errors are sticky, since a
+// frame buffer that failed to decompress cannot be drawn.
+void DecodeGroup::wait(void)
+{
+	CriticalSection::SafeLock l(mutex);
+	while(pending>0)
+	{
+		mutex.unlock();
+		event.wait();
+		mutex.lock();
+	}
+	if(failed) throw error;
+}
+
+
+DecodePool *DecodePool::instance=NULL;
+CriticalSection DecodePool::instanceMutex;
+
+
+DecodePool *DecodePool::getInstance(void)
+{
+	if(instance==NULL)
+	{
+		CriticalSection::SafeLock l(instanceMutex);
+		if(instance==NULL) _newcheck(instance=new DecodePool);
+	}
+	return instance;
+}
+
+
+// The number of decompression threads defaults to the number of CPUs (up to
+// MAXTHREADS) and can be overridden with VGLCLIENT_NPROCS.  If only one thread
+// would be used, then the pool is not started, and each window decompresses
+// its own tiles as before.
+DecodePool::DecodePool(void) : nthreads(min(numprocs(), MAXTHREADS))
+{
+	char *env=NULL;  int temp;
+
+	if((env=getenv("VGLCLIENT_NPROCS"))!=NULL && strlen(env)>0
+		&& (temp=atoi(env))>0)
+		nthreads=min(temp, MAXTHREADS);
+	if((env=getenv("VGL_VERBOSE"))!=NULL && strlen(env)>0
+		&& !strncmp(env, "1", 1))
+		vglout.println("Using %d / %d CPU's for decompression", nthreads,
+			numprocs());
+	if(nthreads<2) nthreads=1;
+	else for(int i=0; i<nthreads; i++)
+	{
+		_newcheck(workers[i]=new Worker(i, this));
+		_newcheck(threads[i]=new Thread(workers[i]));
+		threads[i]->start();
+	}
+}
+
+
+void DecodePool::decode(DecodeJob *job)
+{
+	job->group->add();
+	q.add(job);
+}
+
+
+DecodePool::Worker::Worker(int myRank, DecodePool *parent_) : parent(parent_)
+{
+	char temps[20];
+	snprintf(temps, 20, "Decomp %d  ", myRank);
+	profDecomp.setName(temps);
+}
+
+
+void DecodePool::Worker::run(void)
+{
+	tjhandle tjhnd=NULL;
+
+	while(1)
+	{
+		void *jtemp=NULL;
+		parent->q.get(&jtemp);
+		DecodeJob *job=(DecodeJob *)jtemp;
+		if(!job) break;
+
+		// The job structure belongs to the compressed tile, which the receiver
+		// thread can reuse as soon as it is signaled.
+		CompressedFrame *cf=job->cf;  ClientWin *win=job->win;
+		DecodeGroup *group=job->group;
+		try
+		{
+			if(!tjhnd && (tjhnd=tjInitDecompress())==NULL)
+				throw(Error("DecodePool::Worker::run()", tjGetErrorStr()));
+			profDecomp.startFrame();
+			if(job->fb->isGL) ((GLFrame *)job->fb)->decompress(*cf, tjhnd);
+			else ((FBXFrame *)job->fb)->decompress(*cf, tjhnd);
+			profDecomp.endFrame(cf->hdr.width*cf->hdr.height, 0,
+				(double)(cf->hdr.width*cf->hdr.height)/
+					(double)(cf->hdr.framew*cf->hdr.frameh));
+			win->releaseFrame(cf);
+			group->done(NULL);
+		}
+		catch(Error &e)
+		{
+			win->releaseFrame(cf);
+			group->done(&e);
+		}
+	}
+
+	if(tjhnd) tjDestroy(tjhnd);
+}
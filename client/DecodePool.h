@@ -0,0 +1,99 @@
+/* Copyright (C)2014 D. R. Commander
+ *
+ * This library is free software and may be redistributed and/or modified under
+ * the terms of the wxWindows Library License, Version 3.1 or (at your option)
+ * any later version.  The full license is in the LICENSE.txt file included
+ * with this distribution.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * wxWindows Library License for more details.
+ */
+
+#ifndef __DECODEPOOL_H__
+#define __DECODEPOOL_H__
+
+#include "Frame.h"
+#include "Thread.h"
+#include "GenericQ.h"
+#include "Profiler.h"
+
+
+namespace vglclient
+{
+	class ClientWin;
+
+	// Tracks the tiles that a window has handed off to the decode pool, so that
+	// the window can wait for all of them to be decompressed before it draws
+	// the frame.
+
+	class DecodeGroup
+	{
+		public:
+
+			DecodeGroup(void) : pending(0), failed(false) {}
+			void add(void);
+			void done(vglutil::Error *e);
+			void wait(void);
+
+		private:
+
+			vglutil::CriticalSection mutex;
+			vglutil::Event event;
+			int pending;  bool failed;
+			vglutil::Error error;
+	};
+
+
+	typedef struct _DecodeJob
+	{
+		vglcommon::Frame *fb;
+		vglcommon::CompressedFrame *cf;
+		ClientWin *win;
+		DecodeGroup *group;
+	} DecodeJob;
+
+
+	// A process-wide pool of threads that decompress tiles into the frame
+	// buffers of ClientWin instances.  The tiles in a frame cover disjoint
+	// regions of the frame buffer, so they can be decompressed concurrently.
+
+	class DecodePool
+	{
+		public:
+
+			static DecodePool *getInstance(void);
+			int getThreads(void) { return nthreads; }
+			void decode(DecodeJob *job);
+
+		private:
+
+			DecodePool(void);
+			~DecodePool(void) {}
+
+			static const int MAXTHREADS=8;
+			static DecodePool *instance;
+			static vglutil::CriticalSection instanceMutex;
+			int nthreads;
+			vglutil::GenericQ q;
+
+		class Worker : public vglutil::Runnable
+		{
+			public:
+
+				Worker(int myRank, DecodePool *parent_);
+				void run(void);
+
+			private:
+
+				DecodePool *parent;
+				vglcommon::Profiler profDecomp;
+		};
+
+			Worker *workers[MAXTHREADS];
+			vglutil::Thread *threads[MAXTHREADS];
+	};
+}
+
+#endif // __DECODEPOOL_H__
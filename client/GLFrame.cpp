@@ -25,7 +25,8 @@ using namespace vglcommon;
 
 GLFrame::GLFrame(char *dpystring, Window win_) : Frame(),
 	dpy(NULL),
-	win(win_), ctx(0), tjhnd(NULL), newdpy(false)
+	win(win_), ctx(0), tjhnd(NULL), newdpy(false), texWidth(0), texHeight(0),
+	texStereo(false), dirtyRects(NULL), nDirty(0), maxDirty(0), allDirty(true)
 {
 	if(!dpystring || !win)
 		throw(Error("GLFrame::GLFrame", "Invalid argument"));
@@ -39,7 +40,8 @@ GLFrame::GLFrame(char *dpystring, Window win_) : Frame(),
 
 GLFrame::GLFrame(Display *dpy_, Window win_) : Frame(),
 	dpy(NULL),
-	win(win_), ctx(0), tjhnd(NULL), newdpy(false)
+	win(win_), ctx(0), tjhnd(NULL), newdpy(false), texWidth(0), texHeight(0),
+	texStereo(false), dirtyRects(NULL), nDirty(0), maxDirty(0), allDirty(true)
 {
 	if(!dpy_ || !win_) throw(Error("GLFrame::GLFrame", "Invalid argument"));
 
@@ -53,6 +55,7 @@ void GLFrame::init(void)
 {
 	XVisualInfo *v=NULL;
 
+	tex[0]=tex[1]=0;
 	try
 	{
 		pixelSize=3;
@@ -106,10 +109,14 @@ GLFrame::~GLFrame(void)
 	{
 		delete [] rbits;  rbits=NULL;
 	}
+	if(dirtyRects)
+	{
+		free(dirtyRects);  dirtyRects=NULL;
+	}
 }
 
 
-void GLFrame::init(rrframeheader &h, bool stereo_)
+void GLFrame::init(rrframeheader &h, bool stereo_, int scale_)
 {
 	int flags_=FRAME_BOTTOMUP;
 
@@ -117,21 +124,39 @@ void GLFrame::init(rrframeheader &h, bool stereo_)
 	if(littleendian() && h.compress!=RRCOMP_RGB) flags_|=FRAME_BGR;
 	#endif
 	Frame::init(h, 3, flags_, stereo_);
+	scale=scale_;
 }
 
 
 GLFrame &GLFrame::operator= (CompressedFrame &cf)
+{
+	if(!cf.bits || cf.hdr.size<1) _throw("JPEG not initialized");
+	init(cf.hdr, cf.stereo, cf.scale);
+	if(!tjhnd && cf.hdr.compress!=RRCOMP_RGB)
+	{
+		if((tjhnd=tjInitDecompress())==NULL)
+			throw(Error("GLFrame::decompressor", tjGetErrorStr()));
+	}
+	decompress(cf, tjhnd);
+	return *this;
+}
+
+
+// Decompress a tile into a frame that has already been initialized with the
+// tile's frame dimensions.  This can be called from multiple threads at once
+// (see FBXFrame::decompress()).
+void GLFrame::decompress(CompressedFrame &cf, tjhandle handle)
 {
 	int tjflags=TJ_BOTTOMUP;
 
 	if(!cf.bits || cf.hdr.size<1) _throw("JPEG not initialized");
-	init(cf.hdr, cf.stereo);
 	if(!bits) _throw("Frame not initialized");
 	if(flags&FRAME_BGR) tjflags|=TJ_BGR;
 	int width=min(cf.hdr.width, hdr.framew-cf.hdr.x);
 	int height=min(cf.hdr.height, hdr.frameh-cf.hdr.y);
 	if(width>0 && height>0 && cf.hdr.width<=width && cf.hdr.height<=height)
 	{
+		int y=max(0, hdr.frameh-cf.hdr.y-height);
 		if(cf.hdr.compress==RRCOMP_RGB)
 		{
 			decompressRGB(cf, width, height, false);
@@ -140,44 +165,186 @@ GLFrame &GLFrame::operator= (CompressedFrame &cf)
 		}
 		else
 		{
-			if(!tjhnd)
-			{
-				if((tjhnd=tjInitDecompress())==NULL)
-					throw(Error("GLFrame::decompressor", tjGetErrorStr()));
-			}
-			int y=max(0, hdr.frameh-cf.hdr.y-height);
-			_tj(tjDecompress(tjhnd, cf.bits, cf.hdr.size,
+			_tj(tjDecompress(handle, cf.bits, cf.hdr.size,
 				(unsigned char *)&bits[pitch*y+cf.hdr.x*pixelSize], width, pitch,
 				height, pixelSize, tjflags));
 			if(stereo && cf.rbits && rbits)
 			{
-				_tj(tjDecompress(tjhnd, cf.rbits, cf.rhdr.size,
+				_tj(tjDecompress(handle, cf.rbits, cf.rhdr.size,
 					(unsigned char *)&rbits[pitch*y+cf.hdr.x*pixelSize],
 					width, pitch, height, pixelSize, tjflags));
 			}
 		}
+		addDirtyRect(cf.hdr.x, y, width, height);
 	}
-	return *this;
+}
+
+
+// Record a region of the frame (in bottom-up coordinates) that must be
+// uploaded to the texture before the next redraw
+void GLFrame::addDirtyRect(int x, int y, int width, int height)
+{
+	CriticalSection::SafeLock l(dirtyMutex);
+	if(allDirty) return;
+	if(nDirty>=maxDirty)
+	{
+		int newMax=maxDirty? maxDirty*2:64;
+		DirtyRect *newRects=
+			(DirtyRect *)realloc(dirtyRects, sizeof(DirtyRect)*newMax);
+		if(!newRects) { allDirty=true;  return; }
+		dirtyRects=newRects;  maxDirty=newMax;
+	}
+	dirtyRects[nDirty].x=x;  dirtyRects[nDirty].y=y;
+	dirtyRects[nDirty].width=width;  dirtyRects[nDirty].height=height;
+	nDirty++;
 }
 
 
 void GLFrame::redraw(void)
 {
-	drawTile(0, 0, hdr.framew, hdr.frameh);
+	if(!glXMakeCurrent(dpy, win, ctx))
+		_throw("Could not bind OpenGL context to window (window may have disappeared)");
+
+	if(!initTexture())
+	{
+		// The frame is too large to fit in a texture, so fall back to
+		// glDrawPixels().
+		drawTile(0, 0, hdr.framew, hdr.frameh);
+		sync();
+		return;
+	}
+
+	int e;
+	e=glGetError();
+	while(e!=GL_NO_ERROR) e=glGetError();  // Clear previous error
+	{
+		CriticalSection::SafeLock l(dirtyMutex);
+		if(allDirty) updateTexture(0, 0, hdr.framew, hdr.frameh);
+		else
+		{
+			for(int i=0; i<nDirty; i++)
+				updateTexture(dirtyRects[i].x, dirtyRects[i].y, dirtyRects[i].width,
+					dirtyRects[i].height);
+		}
+		nDirty=0;  allDirty=false;
+	}
+	drawTexture();
+	if(glError()) _throw("Could not draw frame");
 	sync();
 }
 
 
-void GLFrame::drawTile(int x, int y, int width, int height)
+int GLFrame::getFormat(void)
 {
-	if(x<0 || width<1 || (x+width)>hdr.framew || y<0 || height<1
-		|| (y+height)>hdr.frameh)
-		return;
 	int format=GL_RGB;
 	#ifdef GL_BGR_EXT
-	if(littleendian()) format=GL_BGR_EXT;
+	if(flags&FRAME_BGR) format=GL_BGR_EXT;
 	#endif
 	if(pixelSize==1) format=GL_COLOR_INDEX;
+	return format;
+}
+
+
+// (Re)allocate the texture(s) if the frame size or stereo mode has changed.
+// Returns false if the frame cannot be drawn using a texture.
+bool GLFrame::initTexture(void)
+{
+	if(!bits || pixelSize!=3) return false;
+
+	// Power-of-two texture dimensions are used so that this works with any
+	// OpenGL implementation.
+	int width=1, height=1;
+	while(width<hdr.framew) width*=2;
+	while(height<hdr.frameh) height*=2;
+	if(tex[0] && width==texWidth && height==texHeight && stereo==texStereo)
+		return true;
+
+	GLint maxSize=0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	if(width>maxSize || height>maxSize) return false;
+
+	int e;
+	e=glGetError();
+	while(e!=GL_NO_ERROR) e=glGetError();  // Clear previous error
+	if(!tex[0]) glGenTextures(2, tex);
+	for(int i=0; i<(stereo? 2:1); i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, tex[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB,
+			GL_UNSIGNED_BYTE, NULL);
+	}
+	if(glError())
+	{
+		glDeleteTextures(2, tex);  tex[0]=tex[1]=0;
+		return false;
+	}
+	texWidth=width;  texHeight=height;  texStereo=stereo;
+
+	CriticalSection::SafeLock l(dirtyMutex);
+	allDirty=true;
+	return true;
+}
+
+
+void GLFrame::updateTexture(int x, int y, int width, int height)
+{
+	if(x<0 || width<1 || (x+width)>hdr.framew || y<0 || height<1
+		|| (y+height)>hdr.frameh)
+		return;
+	int format=getFormat();
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch/pixelSize);
+	glBindTexture(GL_TEXTURE_2D, tex[0]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format,
+		GL_UNSIGNED_BYTE, &bits[pitch*y+x*pixelSize]);
+	if(stereo && rbits)
+	{
+		glBindTexture(GL_TEXTURE_2D, tex[1]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format,
+			GL_UNSIGNED_BYTE, &rbits[pitch*y+x*pixelSize]);
+	}
+}
+
+
+void GLFrame::drawTexture(void)
+{
+	float s=(float)hdr.framew/(float)texWidth,
+		t=(float)hdr.frameh/(float)texHeight;
+
+	int oldbuf=-1;
+	glGetIntegerv(GL_DRAW_BUFFER, &oldbuf);
+	// If the frame was scaled down by the server, then the texture is
+	// magnified (using nearest-neighbor filtering) to fill the window.
+	glViewport(0, 0, hdr.framew*scale, hdr.frameh*scale);
+	glEnable(GL_TEXTURE_2D);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	for(int i=0; i<(stereo? 2:1); i++)
+	{
+		if(stereo) glDrawBuffer(i==0? GL_BACK_LEFT:GL_BACK_RIGHT);
+		glBindTexture(GL_TEXTURE_2D, tex[i]);
+		glBegin(GL_QUADS);
+		glTexCoord2f(0.0f, 0.0f);  glVertex2f(-1.0f, -1.0f);
+		glTexCoord2f(s, 0.0f);  glVertex2f(1.0f, -1.0f);
+		glTexCoord2f(s, t);  glVertex2f(1.0f, 1.0f);
+		glTexCoord2f(0.0f, t);  glVertex2f(-1.0f, 1.0f);
+		glEnd();
+	}
+	if(stereo) glDrawBuffer(oldbuf);
+	glDisable(GL_TEXTURE_2D);
+}
+
+
+void GLFrame::drawTile(int x, int y, int width, int height)
+{
+	if(x<0 || width<1 || (x+width)>hdr.framew || y<0 || height<1
+		|| (y+height)>hdr.frameh)
+		return;
+	int format=getFormat();
 
 	if(!glXMakeCurrent(dpy, win, ctx))
 		_throw("Could not bind OpenGL context to window (window may have disappeared)");
@@ -190,7 +357,8 @@ void GLFrame::drawTile(int x, int y, int width, int height)
 	int oldbuf=-1;
 	glGetIntegerv(GL_DRAW_BUFFER, &oldbuf);
 	if(stereo) glDrawBuffer(GL_BACK_LEFT);
-	glViewport(0, 0, hdr.framew, hdr.frameh);
+	glViewport(0, 0, hdr.framew*scale, hdr.frameh*scale);
+	glPixelZoom((float)scale, (float)scale);
 	glRasterPos2f(((float)x/(float)hdr.framew)*2.0f-1.0f,
 		((float)y/(float)hdr.frameh)*2.0f-1.0f);
 	glDrawPixels(width, height, format, GL_UNSIGNED_BYTE,
@@ -204,6 +372,7 @@ void GLFrame::drawTile(int x, int y, int width, int height)
 			&rbits[pitch*y+x*pixelSize]);
 		glDrawBuffer(oldbuf);
 	}
+	glPixelZoom(1.0f, 1.0f);
 
 	if(glError()) _throw("Could not draw pixels");
 }
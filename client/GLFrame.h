@@ -19,6 +19,7 @@
 
 #include <GL/glx.h>
 #include "Frame.h"
+#include "Mutex.h"
 
 
 namespace vglcommon
@@ -30,21 +31,35 @@ namespace vglcommon
 			GLFrame(char *dpystring, Window win);
 			GLFrame(Display *dpy, Window win);
 			~GLFrame(void);
-			void init(rrframeheader &h, bool stereo);
+			void init(rrframeheader &h, bool stereo, int scale=1);
 			GLFrame &operator= (CompressedFrame &cf);
+			void decompress(CompressedFrame &cf, tjhandle handle);
 			void redraw(void);
 			void drawTile(int x, int y, int width, int height);
 			void sync(void);
+			void addDirtyRect(int x, int y, int width, int height);
 
 		private:
 
 			void init(void);
 			int glError(void);
+			int getFormat(void);
+			bool initTexture(void);
+			void updateTexture(int x, int y, int width, int height);
+			void drawTexture(void);
 
 			Display *dpy;  Window win;
 			GLXContext ctx;
 			tjhandle tjhnd;
 			bool newdpy;
+
+			// The frame is drawn by texturing a quad with a persistent texture (one
+			// per eye), and only the tiles that were decompressed since the last
+			// redraw are uploaded to it.
+			GLuint tex[2];  int texWidth, texHeight;  bool texStereo;
+			typedef struct { int x, y, width, height; } DirtyRect;
+			DirtyRect *dirtyRects;  int nDirty, maxDirty;  bool allDirty;
+			vglutil::CriticalSection dirtyMutex;
 	};
 }
 
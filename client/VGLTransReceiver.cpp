@@ -15,6 +15,14 @@
 
 #include "VGLTransReceiver.h"
 #include "vglutil.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -75,14 +83,47 @@ static unsigned short DisplayNumber(Display *dpy)
 	h.dpynum=(unsigned short)h1.dpynum;}
 
 
+// Decode a varint (see rrframeinfo) from the buffer, advancing ptr past it.
+// Returns false if the varint is truncated or too large.
+static bool getVarint(unsigned char *&ptr, unsigned char *end,
+	unsigned int &value)
+{
+	value=0;
+	for(int shift=0; ptr<end && shift<32; shift+=7)
+	{
+		unsigned char c=*ptr++;
+		value|=(unsigned int)(c&0x7F)<<shift;
+		if(!(c&0x80)) return true;
+	}
+	return false;
+}
+
+
+static void printVersion(rrversion &v)
+{
+	char *env=NULL;
+	if((env=getenv("VGL_VERBOSE"))!=NULL && strlen(env)>0
+		&& !strncmp(env, "1", 1))
+		vglout.println("Server version: %d.%d", v.major, v.minor);
+	vglout.flush();
+}
+
+
 VGLTransReceiver::VGLTransReceiver(bool doSSL_, int drawMethod_) :
-	drawMethod(drawMethod_), listenSocket(NULL), thread(NULL), deadYet(false),
-	doSSL(doSSL_)
+	listeners(NULL), drawMethod(drawMethod_), listenSocket(NULL), thread(NULL),
+	deadYet(false), doSSL(doSSL_)
 {
 	char *env=NULL;
 
 	if((env=getenv("VGL_VERBOSE"))!=NULL && strlen(env)>0
 		&& !strncmp(env, "1", 1)) fbx_printwarnings(vglout.getFile());
+	#ifdef __linux__
+	// Used to wake up the reactor thread when the receiver is destroyed or when
+	// a parked connection may be able to proceed
+	if(pipe(wakeFD)<0) _throwunix();
+	for(int i=0; i<2; i++)
+		fcntl(wakeFD[i], F_SETFL, fcntl(wakeFD[i], F_GETFL)|O_NONBLOCK);
+	#endif
 	_newcheck(thread=new Thread(this));
 }
 
@@ -93,7 +134,13 @@ VGLTransReceiver::~VGLTransReceiver(void)
 	listenMutex.lock();
 	if(listenSocket) listenSocket->close();
 	listenMutex.unlock();
+	#ifdef __linux__
+	wake();
+	#endif
 	if(thread) { thread->stop();  thread=NULL; }
+	#ifdef __linux__
+	close(wakeFD[0]);  close(wakeFD[1]);
+	#endif
 }
 
 
@@ -117,6 +164,10 @@ void VGLTransReceiver::run(void)
 {
 	Socket *socket=NULL;  Listener *listener=NULL;
 
+	#ifdef __linux__
+	if(!doSSL) { runReactor();  return; }
+	#endif
+
 	while(!deadYet)
 	{
 		try
@@ -125,7 +176,8 @@ void VGLTransReceiver::run(void)
 			socket=listenSocket->accept();  if(deadYet) break;
 			vglout.println("++ %sConnection from %s.", doSSL? "SSL ":"",
 				socket->remoteName());
-			_newcheck(listener=new Listener(socket, drawMethod));
+			_newcheck(listener=new Listener(socket, drawMethod, doSSL));
+			listener->start();
 			continue;
 		}
 		catch(Error &e)
@@ -146,107 +198,680 @@ void VGLTransReceiver::run(void)
 }
 
 
-void VGLTransReceiver::Listener::run(void)
+#ifdef __linux__
+
+// Service the listening socket and all non-SSL connections from a single
+// thread, so that the number of threads does not grow with the number of
+// connected applications.  A connection whose window has no free frame buffers
+// is "parked": it is removed from the epoll set (so that the server is
+// throttled by TCP flow control, as it would be with a blocking receive) and
+// retried whenever the reactor wakes up.  The window writes to wakeFD when it
+// releases a buffer, as does a stream that completes a frame for which other
+// streams are waiting at the barrier.
+void VGLTransReceiver::runReactor(void)
 {
-	ClientWin *w=NULL;
-	Frame *f=NULL;
-	rrframeheader h;  rrframeheader_v1 h1;  bool haveHeader=false;
-	rrversion v;
+	static const int MAXEVENTS=64;
+	struct epoll_event ev, events[MAXEVENTS];
+	Listener *listener=NULL, **ptr;
+	int epfd=-1;
 
 	try
 	{
-		recv((char *)&h1, sizeof_rrframeheader_v1);
-		ENDIANIZE(h1);
-		if(h1.framew!=0 && h1.frameh!=0 && h1.width!=0 && h1.height!=0
-			&& h1.winid!=0 && h1.size!=0 && h1.flags!=RR_EOF)
+		if((epfd=epoll_create(MAXEVENTS))<0) _throwunix();
+		memset(&ev, 0, sizeof(ev));
+		ev.events=EPOLLIN;  ev.data.ptr=NULL;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, listenSocket->getSocket(), &ev)<0)
+			_throwunix();
+		ev.data.ptr=wakeFD;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFD[0], &ev)<0) _throwunix();
+	}
+	catch(Error &e)
+	{
+		vglout.println("%s-- %s", e.getMethod(), e.getMessage());
+		if(epfd>=0) close(epfd);
+		return;
+	}
+
+	while(!deadYet)
+	{
+		int n=epoll_wait(epfd, events, MAXEVENTS, -1);
+		if(n<0)
 		{
-			v.major=1;  v.minor=0;  haveHeader=true;
+			if(errno==EINTR) continue;
+			vglout.println("VGLTransReceiver::runReactor()-- %s", strerror(errno));
+			break;
+		}
+		if(deadYet) break;
+
+		for(int i=0; i<n; i++)
+		{
+			if(events[i].data.ptr==wakeFD)
+			{
+				char buf[256];
+				while(::read(wakeFD[0], buf, sizeof(buf))>0) {}
+				continue;
+			}
+			if(events[i].data.ptr==NULL)
+			{
+				Socket *socket=NULL;
+				try
+				{
+					listener=NULL;
+					socket=listenSocket->accept();
+					vglout.println("++ Connection from %s.", socket->remoteName());
+					_newcheck(listener=new Listener(socket, drawMethod, false, this));
+					socket=NULL;
+					ev.events=EPOLLIN;  ev.data.ptr=listener;
+					if(epoll_ctl(epfd, EPOLL_CTL_ADD,
+						listener->socket->getSocket(), &ev)<0)
+						_throwunix();
+					listener->next=listeners;  listeners=listener;
+				}
+				catch(Error &e)
+				{
+					vglout.println("%s-- %s", e.getMethod(), e.getMessage());
+					if(listener) delete listener;
+					if(socket) delete socket;
+				}
+				continue;
+			}
+			listener=(Listener *)events[i].data.ptr;
+			if(!listener->isParked() && !listener->read()) listener->close();
 		}
-		else
+
+		// Retry parked connections.  Closing either the main connection or one
+		// of its additional streams closes all of them.
+		for(listener=listeners; listener; listener=listener->next)
+			if(listener->isParked() && !listener->read()) listener->close();
+		for(listener=listeners; listener; listener=listener->next)
+			if(listener->primary && listener->isClosed())
+				listener->primary->close();
+		for(listener=listeners; listener; listener=listener->next)
+			if(listener->primary && listener->primary->isClosed())
+				listener->close();
+
+		// Update the epoll set and delete closed connections
+		for(ptr=&listeners; *ptr;)
 		{
+			listener=*ptr;
+			if(listener->isClosed())
+			{
+				*ptr=listener->next;  delete listener;
+				continue;
+			}
+			if(listener->armed==listener->isParked())
+			{
+				listener->armed=!listener->isParked();
+				ev.events=listener->armed? EPOLLIN:0;  ev.data.ptr=listener;
+				epoll_ctl(epfd, EPOLL_CTL_MOD, listener->socket->getSocket(), &ev);
+			}
+			ptr=&listener->next;
+		}
+	}
+
+	while(listeners)
+	{
+		listener=listeners;  listeners=listener->next;
+		delete listener;
+	}
+	close(epfd);
+	vglout.println("Listener exiting ...");
+	listenMutex.lock();
+	if(listenSocket) { delete listenSocket;  listenSocket=NULL; }
+	listenMutex.unlock();
+}
+
+
+void VGLTransReceiver::wake(void)
+{
+	char c=0;
+	if(write(wakeFD[1], &c, 1)<0) {}
+}
+
+#endif
+
+
+void VGLTransReceiver::Listener::run(void)
+{
+	try
+	{
+		while(1)
+		{
+			do
+			{
+				int len;  char *ptr=getTarget(len);
+				recv(ptr, len);
+				targetPos+=len;
+			} while(targetPos<targetLen);
+			process(true);
+		}
+	}
+	catch(Error &e)
+	{
+		vglout.println("%s-- %s", e.getMethod(), e.getMessage());
+	}
+	if(thread) { thread->detach();  delete thread; }
+	delete this;
+}
+
+
+// Receive as much data as is available without blocking, processing each
+// complete header or payload as it arrives.  In order to prevent a busy
+// connection from starving the others, this returns after a fixed number of
+// receives.  Returns false if the connection should be closed.
+bool VGLTransReceiver::Listener::read(void)
+{
+	static const int MAXRECVS=64;
+
+	try
+	{
+		for(int i=0; i<MAXRECVS; i++)
+		{
+			if(isParked())
+			{
+				if(!process(false)) return true;
+				continue;
+			}
+			int len;  char *ptr=getTarget(len);
+			int bytes=socket->tryRecv(ptr, len);
+			if(bytes<=0 && targetLen>0) return true;
+			targetPos+=bytes;
+			if(targetPos>=targetLen) process(false);
+		}
+	}
+	catch(Error &e)
+	{
+		vglout.println("%s-- %s", e.getMethod(), e.getMessage());
+		return false;
+	}
+	return true;
+}
+
+
+void VGLTransReceiver::Listener::expect(char *buf, int len, int nextState)
+{
+	target=buf;  targetLen=len;  targetPos=0;  state=nextState;
+	rowLen=rowPitch=0;
+}
+
+
+void VGLTransReceiver::Listener::expectRows(char *buf, int rowLen_, int pitch,
+	int rows, int nextState)
+{
+	target=buf;  targetLen=rowLen_*rows;  targetPos=0;  state=nextState;
+	rowLen=rowLen_;  rowPitch=pitch;
+}
+
+
+// Return the address and size of the largest contiguous region of the target
+// that has not yet been received
+char *VGLTransReceiver::Listener::getTarget(int &len)
+{
+	if(rowLen>0)
+	{
+		int row=targetPos/rowLen, col=targetPos%rowLen;
+		len=rowLen-col;
+		return &target[(long)row*rowPitch+col];
+	}
+	len=targetLen-targetPos;
+	return &target[targetPos];
+}
+
+
+// Act on the data that was just received.  If wait is false and the window
+// has no free frame buffers, then the parser stays in STATE_FRAME, and this
+// returns false.  Likewise, an additional stream that has reached the end of
+// the frame stays in STATE_BARRIER until the other streams catch up.
+bool VGLTransReceiver::Listener::process(bool wait)
+{
+	Listener *owner=primary? primary:this;
+
+	switch(state)
+	{
+		case STATE_FIRSTHEADER:
+			ENDIANIZE_V1(h1);
+			if(h1.flags==RR_JOIN)
+			{
+				join(h1.winid);
+				expectHeader();
+				return true;
+			}
+			if(h1.framew!=0 && h1.frameh!=0 && h1.width!=0 && h1.height!=0
+				&& h1.winid!=0 && h1.size!=0 && h1.flags!=RR_EOF)
+			{
+				v.major=1;  v.minor=0;
+				printVersion(v);
+				CONVERT_HEADER(h1, h);
+				state=STATE_FRAME;
+				return process(wait);
+			}
 			strncpy(v.id, "VGL", 3);
 			v.major=RR_MAJOR_VERSION;  v.minor=RR_MINOR_VERSION;
 			send((char *)&v, sizeof_rrversion);
-			recv((char *)&v, sizeof_rrversion);
+			expect((char *)&v, sizeof_rrversion, STATE_VERSION);
+			return true;
+
+		case STATE_VERSION:
 			if(strncmp(v.id, "VGL", 3) || v.major<1)
 				_throw("Error reading server version");
-		}
+			// Frame acknowledgments are sent from the window threads, which cannot
+			// safely share an SSL connection with this thread.
+			if((v.major>2 || (v.major==2 && v.minor>=2)) && !doSSL) doAcks=true;
+			if(v.major>=3) compact=true;
+			// The server uses our reply time to estimate the offset between our
+			// clocks, so reply immediately.
+			if((v.major>2 || (v.major==2 && v.minor>=5)) && !doSSL)
+			{
+				Timer timer;  unsigned int time=timer.usec();
+				if(!littleendian()) time=byteswap(time);
+				send((char *)&time, 4);
+				doStamps=true;
+			}
 
-		char *env=NULL;
-		if((env=getenv("VGL_VERBOSE"))!=NULL && strlen(env)>0
-			&& !strncmp(env, "1", 1))
-			vglout.println("Server version: %d.%d", v.major, v.minor);
-		vglout.flush();
+			printVersion(v);
+			if((v.major>2 || (v.major==2 && v.minor>=3)) && !doSSL)
+				expect((char *)&info, sizeof_rrshminfo, STATE_SHMINFO);
+			else expectHeader();
+			return true;
 
-		while(1)
+		case STATE_SHMINFO:
+			mapShm();
+			if(v.major>2 || (v.major==2 && v.minor>=4))
+				expect((char *)&stripeInfo, sizeof_rrstripeinfo, STATE_STRIPEINFO);
+			else expectHeader();
+			return true;
+
+		case STATE_STRIPEINFO:
 		{
-			do
+			// Striping requires the reactor, since the streams must be serviced by
+			// the same thread.
+			unsigned char reply=1;
+			token=stripeInfo.token;
+			if(!littleendian()) token=byteswap(token);
+			if(receiver && stripeInfo.streams>1)
+				reply=min(stripeInfo.streams, (unsigned char)RR_MAXSTREAMS);
+			nStreams=reply;
+			send((char *)&reply, 1);
+			expectHeader();
+			return true;
+		}
+
+		case STATE_HEADER:
+			if(v.major==1 && v.minor==0)
+			{
+				ENDIANIZE_V1(h1);
+				CONVERT_HEADER(h1, h);
+			}
+			else ENDIANIZE(h);
+			if(owner->nStreams>1 && h.flags!=RR_EOF)
+			{
+				expect((char *)&tileSeq, 4, STATE_SEQ);
+				return true;
+			}
+			if(doStamps && h.flags==RR_EOF)
+			{
+				expect((char *)&stamp, sizeof_rrframestamp, STATE_STAMP);
+				return true;
+			}
+			state=STATE_STAMP;
+			return process(wait);
+
+		case STATE_TAG:
+			if(tag==RR3_FRAME)
+			{
+				expect((char *)&frameInfo, sizeof_rrframeinfo, STATE_FRAMEINFO);
+				return true;
+			}
+			if(!frameOpen) _throw("Tile or EOF received outside of a frame");
+			if(tag==RR3_SCALE)
 			{
-				if(v.major==1 && v.minor==0)
+				expect((char *)&scaleByte, 1, STATE_SCALE);
+				return true;
+			}
+			if(tag==RR3_EOF)
+			{
+				h.flags=RR_EOF;  h.x=h.y=0;  h.width=h.framew;  h.height=h.frameh;
+				h.size=0;  frameOpen=false;
+				if(doStamps)
 				{
-					if(!haveHeader)
-					{
-						recv((char *)&h1, sizeof_rrframeheader_v1);
-						ENDIANIZE_V1(h1);
-					}
-					haveHeader=false;
-					CONVERT_HEADER(h1, h);
+					expect((char *)&stamp, sizeof_rrframestamp, STATE_STAMP);
+					return true;
 				}
-				else
+				state=STATE_STAMP;
+				return process(wait);
+			}
+			h.flags=(tag>>5)&3;
+			if(tag&0x80 || h.flags==RR_EOF || (tag&0x1F)<5)
+				_throw("Invalid tile record");
+			expect((char *)tileRecord, tag&0x1F, STATE_TILE);
+			return true;
+
+		case STATE_FRAMEINFO:
+			if(!littleendian())
+			{
+				frameInfo.winid=byteswap(frameInfo.winid);
+				frameInfo.seq=byteswap(frameInfo.seq);
+				frameInfo.framew=byteswap16(frameInfo.framew);
+				frameInfo.frameh=byteswap16(frameInfo.frameh);
+				frameInfo.dpynum=byteswap16(frameInfo.dpynum);
+			}
+			if(owner->nStreams>1 && frameInfo.seq!=seq)
+				_throw("Stream out of sequence");
+			h.winid=frameInfo.winid;  h.dpynum=frameInfo.dpynum;
+			h.framew=frameInfo.framew;  h.frameh=frameInfo.frameh;
+			h.qual=frameInfo.qual;  h.subsamp=frameInfo.subsamp;
+			h.compress=frameInfo.compress;
+			frameOpen=true;  scale=1;
+			expectHeader();
+			return true;
+
+		case STATE_SCALE:
+			if(scaleByte!=1 && scaleByte!=2 && scaleByte!=4)
+				_throw("Invalid scale factor");
+			scale=scaleByte;
+			expectHeader();
+			return true;
+
+		case STATE_TILE:
+		{
+			unsigned char *ptr=tileRecord, *end=&tileRecord[targetLen];
+			unsigned int x, y, width, height, size, offset1=0;
+			if(!getVarint(ptr, end, x) || !getVarint(ptr, end, y)
+				|| !getVarint(ptr, end, width) || !getVarint(ptr, end, height)
+				|| !getVarint(ptr, end, size)
+				|| (shmBase && !getVarint(ptr, end, offset1))
+				|| x>65535 || y>65535 || width>65535 || height>65535)
+				_throw("Invalid tile record");
+			h.x=x;  h.y=y;  h.width=width;  h.height=height;  h.size=size;
+			offset=offset1>0? offset1-1:RR_SHMINLINE;
+			state=STATE_FRAME;
+			return process(wait);
+		}
+
+		case STATE_STAMP:
+			if(doStamps && h.flags==RR_EOF && !littleendian())
+			{
+				stamp.seq=byteswap(stamp.seq);  stamp.time=byteswap(stamp.time);
+			}
+			if(owner->nStreams>1 && h.flags==RR_EOF)
+			{
+				// The last stream to reach the end of the frame displays it.
+				if(owner->eofs<owner->nStreams-1)
 				{
-					recv((char *)&h, sizeof_rrframeheader);
-					ENDIANIZE(h);
+					owner->eofs++;
+					state=STATE_BARRIER;
+					return process(wait);
 				}
-				bool stereo=(h.flags==RR_LEFT || h.flags==RR_RIGHT);
-				unsigned short dpynum=(v.major<2 || (v.major==2 && v.minor<1))?
-					h.dpynum : DisplayNumber(maindpy);
-				_errifnot(w=addWindow(dpynum, h.winid, stereo));
-
-				if(!stereo || h.flags==RR_LEFT || !f)
+			}
+			state=STATE_FRAME;
+			return process(wait);
+
+		case STATE_SEQ:
+			if(!littleendian()) tileSeq=byteswap(tileSeq);
+			if(tileSeq!=seq) _throw("Stream out of sequence");
+			state=STATE_FRAME;
+			return process(wait);
+
+		case STATE_BARRIER:
+			if(owner->completedSeq==seq) return false;
+			seq++;
+			expectHeader();
+			return true;
+
+		case STATE_FRAME:
+		{
+			bool stereo=(h.flags==RR_LEFT || h.flags==RR_RIGHT);
+			unsigned short dpynum=(v.major<2 || (v.major==2 && v.minor<1))?
+				h.dpynum : DisplayNumber(maindpy);
+			_errifnot(w=owner->addWindow(dpynum, h.winid, stereo));
+
+			// An uncompressed tile that follows inline can be received directly
+			// into the window's frame buffer, if its pixel format is RGB.
+			if(h.compress==RRCOMP_RGB && h.flags!=RR_EOF
+				&& (compact? offset==RR_SHMINLINE : !shmBase))
+			{
+				bool park=false;
+				try
 				{
-					try
-					{
-						f=w->getFrame(h.compress==RRCOMP_YUV);
-					}
-					catch (...) { if(w) deleteWindow(w);  throw; }
+					direct=w->getDirectFrame(h, scale, wait, park);
 				}
-				#ifdef USEXV
-				if(h.compress==RRCOMP_YUV)
+				catch (...) { if(w) owner->deleteWindow(w);  throw; }
+				if(park) return false;
+				if(direct)
 				{
-					((XVFrame *)f)->init(h);
-					if(h.size!=((XVFrame *)f)->hdr.size && h.flags!=RR_EOF)
-						_throw("YUV image size mismatch");
+					// The tile is stored bottom-up.
+					int pitch=direct->pitch, y=h.y+h.height-1;
+					if(direct->flags&FRAME_BOTTOMUP)
+						y=direct->hdr.frameh-h.y-h.height;
+					else pitch=-pitch;
+					expectRows((char *)&direct->bits[direct->pitch*y+h.x*3],
+						h.width*3, pitch, h.height, STATE_PAYLOAD);
+					return true;
 				}
-				else
-				#endif
-				((CompressedFrame *)f)->init(h, h.flags);
-				if(h.flags!=RR_EOF)
-					recv((char *)(h.flags==RR_RIGHT? f->rbits:f->bits), h.size);
+			}
 
-				if(!stereo || h.flags!=RR_LEFT)
+			if(!stereo || h.flags==RR_LEFT || !f)
+			{
+				Frame *newf=NULL;
+				try
 				{
-					try
-					{
-						w->drawFrame(f);
-					}
-					catch (...) { if(w) deleteWindow(w);  throw; }
+					newf=w->getFrame(h.compress==RRCOMP_YUV, wait);
 				}
+				catch (...) { if(w) owner->deleteWindow(w);  throw; }
+				if(!newf) return false;
+				f=newf;
+			}
+			#ifdef USEXV
+			if(h.compress==RRCOMP_YUV)
+			{
+				((XVFrame *)f)->init(h);
+				if(h.size!=((XVFrame *)f)->hdr.size && h.flags!=RR_EOF)
+					_throw("YUV image size mismatch");
+			}
+			else
+			#endif
+			((CompressedFrame *)f)->init(h, h.flags);
+			f->scale=scale;
+			if(h.flags==RR_EOF)
+			{
+				Timer timer;
+				f->times.stamp=owner->stamp;  f->times.recvTime=timer.usec();
+				break;
+			}
+			if(shmBase && !compact)
+			{
+				expect((char *)&offset, 4, STATE_OFFSET);
+				return true;
+			}
+			// With compact framing, the offset was in the tile record.
+			if(!compact) offset=RR_SHMINLINE;
+			state=STATE_OFFSET;
+			return process(wait);
+		}
 
-			} while(!(f && f->hdr.flags==RR_EOF));
+		case STATE_OFFSET:
+			if(!littleendian() && !compact) offset=byteswap(offset);
+			if(offset==RR_SHMINLINE)
+			{
+				expect((char *)(h.flags==RR_RIGHT? f->rbits:f->bits), h.size,
+					STATE_PAYLOAD);
+				return true;
+			}
+			else
+			{
+				// The server will not reuse the tile's region of the ring until we
+				// acknowledge the frame, so the tile can be decompressed in place.
+				if(offset>shmSize || h.size>shmSize-offset)
+					_throw("Invalid shared memory offset");
+				unsigned char *buf=&shmBase[RR_SHMHDRSIZE+offset];
+				if(f->isXV) memcpy(f->bits, buf, h.size);
+				else ((CompressedFrame *)f)->setBits(buf, h.flags);
+			}
+			break;
 
-			if(v.major==1 && v.minor==0)
+		case STATE_PAYLOAD:
+			break;
+	}
+
+	// A complete tile or EOF has been received.
+	if(direct)
+	{
+		w->tileReceived(h);  direct=NULL;
+		expectHeader();
+		return true;
+	}
+	bool stereo=(h.flags==RR_LEFT || h.flags==RR_RIGHT);
+	if(!stereo || h.flags!=RR_LEFT)
+	{
+		try
+		{
+			w->drawFrame(f);
+		}
+		catch (...) { if(w) owner->deleteWindow(w);  throw; }
+	}
+	if(f->hdr.flags==RR_EOF && owner->nStreams>1)
+	{
+		owner->eofs=0;  owner->completedSeq++;  seq++;
+		#ifdef __linux__
+		if(receiver) receiver->wake();
+		#endif
+	}
+	if(f->hdr.flags==RR_EOF && v.major==1 && v.minor==0)
+	{
+		char cts=1;
+		send(&cts, 1);
+	}
+	expectHeader();
+	return true;
+}
+
+
+// Wait for the next header or, with compact framing, the next record
+void VGLTransReceiver::Listener::expectHeader(void)
+{
+	if(compact) expect((char *)&tag, 1, STATE_TAG);
+	else if(v.major==1 && v.minor==0)
+		expect((char *)&h1, sizeof_rrframeheader_v1, STATE_HEADER);
+	else expect((char *)&h, sizeof_rrframeheader, STATE_HEADER);
+}
+
+
+// Attach this connection as an additional stream of the main connection with
+// the given token
+void VGLTransReceiver::Listener::join(unsigned int token_)
+{
+	if(!receiver) _throw("Striping is not supported on this connection");
+	for(Listener *l=receiver->listeners; l; l=l->next)
+	{
+		if(l!=this && !l->primary && l->nStreams>1 && l->token==token_
+			&& !l->isClosed())
+		{
+			primary=l;  v=l->v;  compact=l->compact;
+			return;
+		}
+	}
+	_throw("Unknown stream");
+}
+
+
+// Map the server's shared memory ring, if possible, and tell the server
+// whether we did.  This fails harmlessly if the server is on another machine,
+// since the ring's PID either does not exist here or belongs to a process whose
+// file descriptor does not contain the cookie.
+#ifdef __linux__
+
+// Connect to the server's abstract Unix domain socket and receive the ring's
+// file descriptor.  This fails if the server is on a different machine or in a
+// different network namespace.
+static int getShmFD(rrshminfo &info)
+{
+	struct sockaddr_un addr;  struct timeval tv;
+	int sd=-1, fd=-1, len=strnlen(info.name, sizeof(info.name));
+	char c=0;  struct iovec iov;  struct msghdr msg;
+	union
+	{
+		struct cmsghdr hdr;  char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	if(len<1 || len>=(int)sizeof(info.name)) return -1;
+	memset(&addr, 0, sizeof(addr));  addr.sun_family=AF_UNIX;
+	memcpy(&addr.sun_path[1], info.name, len);
+	if((sd=socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0))<0) return -1;
+	// Don't stall the reactor if the server never sends the descriptor
+	tv.tv_sec=1;  tv.tv_usec=0;
+	setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if(connect(sd, (struct sockaddr *)&addr, sizeof(sa_family_t)+1+len)==0)
+	{
+		iov.iov_base=&c;  iov.iov_len=1;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov=&iov;  msg.msg_iovlen=1;
+		msg.msg_control=control.buf;  msg.msg_controllen=sizeof(control.buf);
+		if(recvmsg(sd, &msg, MSG_CMSG_CLOEXEC)==1)
+		{
+			struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msg);
+			if(cmsg && cmsg->cmsg_level==SOL_SOCKET
+				&& cmsg->cmsg_type==SCM_RIGHTS
+				&& cmsg->cmsg_len==CMSG_LEN(sizeof(int)))
+				memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+	::close(sd);
+	return fd;
+}
+
+#endif
+
+
+void VGLTransReceiver::Listener::mapShm(void)
+{
+	char reply=0;
+
+	if(!littleendian())
+	{
+		info.size=byteswap(info.size);
+		info.cookie[0]=byteswap(info.cookie[0]);
+		info.cookie[1]=byteswap(info.cookie[1]);
+	}
+	#ifdef __linux__
+	if(info.size>0 && info.size<=0x7FFFFFFF-RR_SHMHDRSIZE)
+	{
+		int fd=-1;  struct stat st;
+		if((fd=getShmFD(info))>=0)
+		{
+			void *ptr=MAP_FAILED;
+			if(fstat(fd, &st)==0 && st.st_size>=RR_SHMHDRSIZE+(off_t)info.size)
+				ptr=mmap(NULL, RR_SHMHDRSIZE+info.size, PROT_READ, MAP_SHARED, fd,
+					0);
+			::close(fd);
+			if(ptr!=MAP_FAILED)
 			{
-				char cts=1;
-				send(&cts, 1);
+				if(!memcmp(ptr, info.cookie, sizeof(info.cookie)))
+				{
+					shmBase=(unsigned char *)ptr;  shmSize=info.size;  reply=1;
+				}
+				else munmap(ptr, RR_SHMHDRSIZE+info.size);
 			}
 		}
 	}
-	catch(Error &e)
+	#endif
+	send(&reply, 1);
+
+	char *env=NULL;
+	if(info.size>0 && (env=getenv("VGL_VERBOSE"))!=NULL && strlen(env)>0
+		&& !strncmp(env, "1", 1))
+		vglout.println("%s shared memory transport", shmBase? "Using":
+			"Not using");
+}
+
+
+void VGLTransReceiver::Listener::unmapShm(void)
+{
+	#ifdef __linux__
+	if(shmBase)
 	{
-		vglout.println("%s-- %s", e.getMethod(), e.getMessage());
+		munmap(shmBase, RR_SHMHDRSIZE+shmSize);  shmBase=NULL;
 	}
-	if(thread) { thread->detach();  delete thread; }
-	delete this;
+	#endif
 }
 
 
@@ -285,7 +910,12 @@ ClientWin *VGLTransReceiver::Listener::addWindow(int dpynum, Window win,
 	}
 	if(nwin>=MAXWIN) _throw("No free window ID's");
 	if(dpynum<0 || dpynum>65535 || win==None) _throw("Invalid argument");
-	_newcheck(windows[winid]=new ClientWin(dpynum, win, drawMethod, stereo));
+	int wakeFD=-1;
+	#ifdef __linux__
+	if(receiver) wakeFD=receiver->wakeFD[1];
+	#endif
+	_newcheck(windows[winid]=new ClientWin(dpynum, win, drawMethod, stereo,
+		doAcks? socket:NULL, &ackMutex, doStamps, wakeFD));
 
 	if(!windows[winid]) _throw("Could not create window instance");
 	nwin++;
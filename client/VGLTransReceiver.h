@@ -39,6 +39,13 @@ namespace vglclient
 		private:
 
 			void run(void);
+			#ifdef __linux__
+			void runReactor(void);
+			void wake(void);
+			int wakeFD[2];
+			#endif
+			class Listener;
+			Listener *listeners;
 
 			int drawMethod;
 			vglutil::Socket *listenSocket;
@@ -48,18 +55,33 @@ namespace vglclient
 			bool doSSL;
 			unsigned short port;
 
+		// A Listener parses the stream from a single VGL server.  It is driven
+		// either by its own thread, which uses blocking receives, or (for
+		// non-SSL connections on Linux) by the receiver's reactor thread, which
+		// calls read() whenever the connection has data.
 		class Listener : public vglutil::Runnable
 		{
 			public:
 
-				Listener(vglutil::Socket *socket_, int drawMethod_) :
-					drawMethod(drawMethod_), nwin(0), socket(socket_), thread(NULL),
-					remoteName(NULL)
+				Listener(vglutil::Socket *socket_, int drawMethod_, bool doSSL_,
+					VGLTransReceiver *receiver_=NULL) : drawMethod(drawMethod_),
+					nwin(0), socket(socket_), thread(NULL), remoteName(NULL),
+					doSSL(doSSL_), doAcks(false), doStamps(false), compact(false),
+					frameOpen(false), scale(1), scaleByte(1), shmBase(NULL),
+					shmSize(0), state(STATE_FIRSTHEADER), target(NULL), targetLen(0),
+					targetPos(0), rowLen(0), rowPitch(0), w(NULL), f(NULL), offset(0),
+					tileSeq(0), direct(NULL),
+					primary(NULL), nStreams(1), eofs(0), token(0), seq(0),
+					completedSeq(0), receiver(receiver_), armed(true), next(NULL)
 				{
 					memset(windows, 0, sizeof(ClientWin *)*MAXWIN);
+					memset(&h, 0, sizeof(rrframeheader));
+					memset(&h1, 0, sizeof(rrframeheader_v1));
+					memset(&v, 0, sizeof(rrversion));
+					memset(&stamp, 0, sizeof(rrframestamp));
+					memset(&frameInfo, 0, sizeof(rrframeinfo));
 					if(socket) remoteName=socket->remoteName();
-					_newcheck(thread=new vglutil::Thread(this));
-					thread->start();
+					expect((char *)&h1, sizeof_rrframeheader_v1, STATE_FIRSTHEADER);
 				}
 
 				virtual ~Listener(void)
@@ -76,14 +98,35 @@ namespace vglclient
 					if(!remoteName) vglout.PRINTLN("-- Disconnecting\n");
 					else vglout.PRINTLN("-- Disconnecting %s", remoteName);
 					if(socket) { delete socket;  socket=NULL; }
+					unmapShm();
+				}
+
+				void start(void)
+				{
+					_newcheck(thread=new vglutil::Thread(this));
+					thread->start();
 				}
 
+				bool read(void);
+				bool isParked(void)
+				{
+					return state==STATE_FRAME || state==STATE_BARRIER;
+				}
+				bool isClosed(void) { return !socket || socket->getSocket()<0; }
+				void close(void) { if(socket) socket->close(); }
 				void send(char *buf, int len);
 				void recv(char *buf, int len);
 
 			private:
 
 				void run(void);
+				void expect(char *buf, int len, int nextState);
+				void expectRows(char *buf, int rowLen, int pitch, int rows,
+					int nextState);
+				char *getTarget(int &len);
+				void expectHeader(void);
+				bool process(bool wait);
+				void join(unsigned int token);
 
 				int drawMethod;
 				ClientWin *windows[MAXWIN];
@@ -94,6 +137,58 @@ namespace vglclient
 				vglutil::Socket *socket;
 				vglutil::Thread *thread;
 				char *remoteName;
+				bool doSSL, doAcks, doStamps;
+				// Compact framing (protocol v3.0 and later.)  frameOpen is true if a
+				// frame record has been received for the current frame.  scale is the
+				// factor by which the server scaled down the current frame (protocol
+				// v3.1 and later.)
+				bool compact, frameOpen;  int scale;  unsigned char scaleByte;
+				vglutil::CriticalSection ackMutex;
+				// Shared memory ring from the server, if it is running on this
+				// machine (protocol v2.3 and later)
+				void mapShm(void);
+				void unmapShm(void);
+				unsigned char *shmBase;  unsigned int shmSize;
+
+				// Parser state.  The parser is waiting for targetLen bytes to be
+				// received into target, except in STATE_FRAME, in which it is waiting
+				// for a window to release a frame buffer, and in STATE_BARRIER, in
+				// which it is waiting for the other streams to finish the frame.  If
+				// rowLen is non-zero, then target is the first of several rows that
+				// are rowPitch bytes apart.
+				enum
+				{
+					STATE_FIRSTHEADER, STATE_VERSION, STATE_SHMINFO, STATE_STRIPEINFO,
+					STATE_HEADER, STATE_TAG, STATE_FRAMEINFO, STATE_TILE, STATE_SEQ,
+					STATE_STAMP, STATE_BARRIER, STATE_FRAME, STATE_OFFSET, STATE_PAYLOAD,
+					STATE_SCALE
+				};
+				int state;  char *target;  int targetLen, targetPos, rowLen, rowPitch;
+				rrframeheader h;  rrframeheader_v1 h1;  rrversion v;
+				rrshminfo info;  rrstripeinfo stripeInfo;
+				unsigned char tag;  rrframeinfo frameInfo;
+				unsigned char tileRecord[RR3_MAXTILERECORD];
+				// Latency stamp that followed the last EOF header (protocol v2.5 and
+				// later.)  Only the main connection carries stamps.
+				rrframestamp stamp;
+				ClientWin *w;  vglcommon::Frame *f;  unsigned int offset, tileSeq;
+				// Frame buffer into which the current tile is being received
+				// directly, if any
+				vglcommon::Frame *direct;
+
+				// Striping (protocol v2.4 and later.)  An additional stream has a
+				// primary, which is the Listener for the main connection and which
+				// owns the windows.  nStreams, eofs, token, and completedSeq are used
+				// only by the primary.  eofs is the number of streams waiting at the
+				// barrier for frame completedSeq, and seq is the frame that this
+				// stream is currently receiving.
+				Listener *primary;  int nStreams, eofs;
+				unsigned int token, seq, completedSeq;
+				VGLTransReceiver *receiver;
+
+				// Used by the reactor
+				bool armed;  Listener *next;
+				friend class VGLTransReceiver;
 		};
 	};
 }
@@ -19,6 +19,7 @@
 #include <string.h>
 #include "vgllogo.h"
 #include "Frame.h"
+#include "PixelConv.h"
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -31,10 +32,11 @@ using namespace vglcommon;
 // Uncompressed frame
 
 Frame::Frame(bool primary_) : bits(NULL), rbits(NULL), pitch(0),
-	pixelSize(0), flags(0), isGL(false), isXV(false), stereo(false),
+	pixelSize(0), flags(0), isGL(false), isXV(false), stereo(false), scale(1),
 	primary(primary_)
 {
 	memset(&hdr, 0, sizeof(rrframeheader));
+	memset(&times, 0, sizeof(rrframetimes));
 	ready.wait();
 }
 
@@ -181,23 +183,15 @@ bool Frame::tileEquals(Frame *last, int x, int y, int width, int height)
 
 void Frame::makeAnaglyph(Frame &r, Frame &g, Frame &b)
 {
-	int rindex=flags&FRAME_BGR? 2:0, gindex=1, bindex=flags&FRAME_BGR? 0:2,
-		i, j;
 	unsigned char *srcrptr=r.bits, *srcgptr=g.bits, *srcbptr=b.bits,
-		*dstptr=bits, *dstrptr, *dstgptr, *dstbptr;
+		*dstptr=bits;
+	int format=PixelConv::getFormat(pixelSize, flags);
+	if(format<0) _throw("Unsupported pixel format");
 
-	if(flags&FRAME_ALPHAFIRST) { rindex++;  gindex++;  bindex++; }
-
-	for(j=0; j<hdr.frameh; j++, srcrptr+=r.pitch, srcgptr+=g.pitch,
+	for(int j=0; j<hdr.frameh; j++, srcrptr+=r.pitch, srcgptr+=g.pitch,
 		srcbptr+=b.pitch, dstptr+=pitch)
-	{
-		for(i=0, dstrptr=&dstptr[rindex], dstgptr=&dstptr[gindex],
-			dstbptr=&dstptr[bindex]; i<hdr.framew; i++, dstrptr+=pixelSize,
-			dstgptr+=pixelSize, dstbptr+=pixelSize)
-		{
-			*dstrptr=srcrptr[i];  *dstgptr=srcgptr[i];  *dstbptr=srcbptr[i];
-		}
-	}
+		PixelConv::packPlanes(srcrptr, srcgptr, srcbptr, dstptr, hdr.framew,
+			format);
 }
 
 
@@ -237,29 +231,15 @@ void Frame::makePassive(Frame &stf, int mode)
 	}
 	else if(mode==RRSTEREO_SIDEBYSIDE)
 	{
-		int pad=pitch-hdr.framew*pixelSize;
-		int h=hdr.frameh;
-		while(h>0)
+		// The left half of each row receives the even pixels from the left eye,
+		// and the right half receives the odd pixels from the right eye.
+		int leftWidth=(hdr.framew+1)/2, rightWidth=hdr.framew/2;
+		for(int j=0; j<hdr.frameh; j++)
 		{
-			unsigned char *srclptr2=srclptr;
-			unsigned char *srcrptr2=srcrptr+pixelSize;
-			for(int i=0; i<(hdr.framew+1)/2; i++)
-			{
-				*(int *)dstptr=*(int *)srclptr2;
-				srclptr2+=pixelSize*2;  dstptr+=pixelSize;
-			}
-			for(int i=(hdr.framew+1)/2; i<hdr.framew-1; i++)
-			{
-				*(int *)dstptr=*(int *)srcrptr2;
-				srcrptr2+=pixelSize*2;  dstptr+=pixelSize;
-			}
-			if(hdr.framew>1)
-			{
-				memcpy(dstptr, srcrptr2, pixelSize);
-				dstptr+=pixelSize;
-			}
-			srclptr+=pitch;  srcrptr+=pitch;  dstptr+=pad;
-			h--;
+			PixelConv::decimate(srclptr, dstptr, leftWidth, pixelSize);
+			PixelConv::decimate(srcrptr+pixelSize, dstptr+leftWidth*pixelSize,
+				rightWidth, pixelSize);
+			srclptr+=pitch;  srcrptr+=pitch;  dstptr+=pitch;
 		}
 	}
 }
@@ -269,59 +249,23 @@ void Frame::decompressRGB(Frame &f, int width, int height, bool rightEye)
 {
 	if(!f.bits || f.hdr.size<1 || !bits || !hdr.size)
 		_throw("Frame not initialized");
+	if(f.pixelSize!=3) _throw("Source frame is not RGB");
 
-	int dstbgr=((flags&FRAME_BGR)!=0), dstbu=((flags&FRAME_BOTTOMUP)!=0),
-		dstaf=((flags&FRAME_ALPHAFIRST)!=0);
-	int i, j;
+	int dstbu=((flags&FRAME_BOTTOMUP)!=0);
+	int format=PixelConv::getFormat(pixelSize, flags);
+	if(format<0) _throw("Unsupported pixel format");
 	int srcStride=f.pitch, dstStride=pitch;
 	int startLine=dstbu? max(0, hdr.frameh-f.hdr.y-height) : f.hdr.y;
 	unsigned char *srcptr=rightEye? f.rbits:f.bits,
 		*dstptr=rightEye? &rbits[pitch*startLine+f.hdr.x*pixelSize]:
 			&bits[pitch*startLine+f.hdr.x*pixelSize];
-	unsigned char *srcptr2, *dstptr2;
 
 	if(!dstbu)
 	{
 		srcptr=&srcptr[(height-1)*f.pitch];  srcStride=-srcStride;
 	}
-	if(!dstbgr && pixelSize==3)
-	{
-		int wps=width*pixelSize;
-		if(dstaf)
-		{
-			dstptr++;  wps--;
-		}
-		for(i=0; i<height; i++, srcptr+=srcStride, dstptr+=dstStride)
-		{
-			memcpy(dstptr, srcptr, wps);
-		}
-	}
-	else
-	{
-		if(dstaf) dstptr++;
-		if(!dstbgr)
-		{
-			for(i=0; i<height; i++, srcptr+=srcStride, dstptr+=dstStride)
-			{
-				for(j=0, srcptr2=srcptr, dstptr2=dstptr; j<width; j++,
-					srcptr2+=f.pixelSize, dstptr2+=pixelSize)
-					memcpy(dstptr2, srcptr2, 3);
-			}
-	 	}
-		else
-		{
-			for(i=0; i<height; i++, srcptr+=srcStride, dstptr+=dstStride)
-			{
-				for(j=0, srcptr2=srcptr, dstptr2=dstptr; j<width; j++,
-					srcptr2+=f.pixelSize, dstptr2+=pixelSize)
-				{
-					dstptr2[2]=srcptr2[0];
-					dstptr2[1]=srcptr2[1];
-					dstptr2[0]=srcptr2[2];
-			 	}
-			}
-		}
-	}
+	for(int i=0; i<height; i++, srcptr+=srcStride, dstptr+=dstStride)
+		PixelConv::fromRGB(srcptr, dstptr, width, format);
 }
 
 
@@ -409,7 +353,11 @@ void Frame::checkHeader(rrframeheader &h)
 
 // Compressed frame
 
-CompressedFrame::CompressedFrame(void) : Frame(), tjhnd(NULL)
+// The buffers are owned by the CompressedFrame instance rather than by the
+// base class, since bits and rbits may point to an external buffer (see
+// setBits().)
+CompressedFrame::CompressedFrame(void) : Frame(false), ownBits(NULL),
+	ownRBits(NULL), bitsSize(0), rbitsSize(0), tjhnd(NULL)
 {
 	if(!(tjhnd=tjInitCompress())) _throw(tjGetErrorStr());
 	pixelSize=3;
@@ -420,6 +368,9 @@ CompressedFrame::CompressedFrame(void) : Frame(), tjhnd(NULL)
 CompressedFrame::~CompressedFrame(void)
 {
 	if(tjhnd) tjDestroy(tjhnd);
+	if(ownBits) delete [] ownBits;
+	if(ownRBits) delete [] ownRBits;
+	bits=rbits=NULL;
 }
 
 CompressedFrame &CompressedFrame::operator= (Frame &f)
@@ -517,42 +468,63 @@ void CompressedFrame::init(rrframeheader &h, int buffer)
 	switch(buffer)
 	{
 		case RR_LEFT:
-			if(h.width!=hdr.width || h.height!=hdr.height || !bits)
-			{
-				if(bits) delete [] bits;
-				_newcheck(bits=new unsigned char[tjBufSize(h.width, h.height,
-					h.subsamp)]);
-			}
+			reserve(bufSize(h));
 			hdr=h;  hdr.flags=RR_LEFT;  stereo=true;
 			break;
 		case RR_RIGHT:
-			if(h.width!=rhdr.width || h.height!=rhdr.height || !rbits)
+			if(bufSize(h)>rbitsSize || !ownRBits)
 			{
-				if(rbits) delete [] rbits;
-				_newcheck(rbits=new unsigned char[tjBufSize(h.width, h.height,
-					h.subsamp)]);
+				if(ownRBits) delete [] ownRBits;
+				_newcheck(ownRBits=new unsigned char[bufSize(h)]);
+				rbitsSize=bufSize(h);
 			}
+			rbits=ownRBits;
 			rhdr=h;  rhdr.flags=RR_RIGHT;  stereo=true;
 			break;
 		default:
-			if(h.width!=hdr.width || h.height!=hdr.height || !bits)
-			{
-				if(bits) delete [] bits;
-				_newcheck(bits=new unsigned char[tjBufSize(h.width, h.height,
-					h.subsamp)]);
-			}
+			reserve(bufSize(h));
 			hdr=h;  hdr.flags=0;  stereo=false;
 			break;
 	}
-	if(!stereo && rbits)
+	if(!stereo && ownRBits)
 	{
-		delete [] rbits;  rbits=NULL;
+		delete [] ownRBits;  ownRBits=rbits=NULL;  rbitsSize=0;
 		memset(&rhdr, 0, sizeof(rrframeheader));
 	}
 	pitch=hdr.width*pixelSize;
 }
 
 
+// The buffers are only reallocated when they need to grow, so a frame that
+// alternates between tile sizes does not thrash the heap.
+unsigned long CompressedFrame::bufSize(rrframeheader &h)
+{
+	return tjBufSize(h.width, h.height, h.subsamp);
+}
+
+
+void CompressedFrame::reserve(unsigned long size)
+{
+	if(size>bitsSize || !ownBits)
+	{
+		if(ownBits) delete [] ownBits;
+		_newcheck(ownBits=new unsigned char[size]);
+		bitsSize=size;
+	}
+	bits=ownBits;
+}
+
+
+// Make the left (or mono) or right buffer point to an external buffer, which
+// must remain valid until the frame is reinitialized.  This allows tiles to be
+// decompressed directly from shared memory.
+void CompressedFrame::setBits(unsigned char *buf, int buffer)
+{
+	if(buffer==RR_RIGHT) rbits=buf;
+	else bits=buf;
+}
+
+
 // Frame created from shared graphics memory
 
 FBXFrame::FBXFrame(Display *dpy, Drawable draw, Visual *vis,
@@ -574,6 +546,7 @@ FBXFrame::FBXFrame(char *dpystring, Window win) : Frame()
 void FBXFrame::init(char *dpystring, Drawable draw, Visual *vis)
 {
 	tjhnd=NULL;  reuseConn=false;
+	scaleBits=NULL;  scaleBitsSize=0;
 	memset(&fb, 0, sizeof(fbx_struct));
 	if(!dpystring || !draw) throw(Error("FBXFrame::init", "Invalid argument"));
 	if(!(wh.dpy=XOpenDisplay(dpystring)))
@@ -585,6 +558,7 @@ void FBXFrame::init(char *dpystring, Drawable draw, Visual *vis)
 void FBXFrame::init(Display *dpy, Drawable draw, Visual *vis)
 {
 	tjhnd=NULL;  reuseConn=true;
+	scaleBits=NULL;  scaleBitsSize=0;
 	memset(&fb, 0, sizeof(fbx_struct));
 	if(!dpy || !draw) throw(Error("FBXFrame::init", "Invalid argument"));
 	wh.dpy=dpy;
@@ -595,28 +569,44 @@ void FBXFrame::init(Display *dpy, Drawable draw, Visual *vis)
 FBXFrame::~FBXFrame(void)
 {
 	if(fb.bits) fbx_term(&fb);  if(bits) bits=NULL;
+	if(scaleBits) { delete [] scaleBits;  scaleBits=NULL; }
 	if(tjhnd) tjDestroy(tjhnd);
 	if(wh.dpy && !reuseConn) XCloseDisplay(wh.dpy);
 }
 
 
-void FBXFrame::init(rrframeheader &h)
+// If scale is greater than 1, then the frame described by h was scaled down by
+// the server.  The tiles are decompressed into a separate buffer at that size,
+// and redraw() scales it back up into the frame buffer.
+void FBXFrame::init(rrframeheader &h, int scale_)
 {
 	checkHeader(h);
 	int usexshm=1;  char *env=NULL;
 	if((env=getenv("VGL_USEXSHM"))!=NULL && strlen(env)>0 && !strcmp(env, "0"))
 		usexshm=0;
-	_fbx(fbx_init(&fb, wh, h.framew, h.frameh, usexshm));
-	if(h.framew>fb.width || h.frameh>fb.height)
+	int width=h.framew*scale_, height=h.frameh*scale_;
+	_fbx(fbx_init(&fb, wh, width, height, usexshm));
+	if(width>fb.width || height>fb.height)
 	{
 		XSync(wh.dpy, False);
-		_fbx(fbx_init(&fb, wh, h.framew, h.frameh, usexshm));
+		_fbx(fbx_init(&fb, wh, width, height, usexshm));
 	}
-	hdr=h;
-	if(hdr.framew>fb.width) hdr.framew=fb.width;
-	if(hdr.frameh>fb.height) hdr.frameh=fb.height;
+	hdr=h;  scale=scale_;
+	if(hdr.framew*scale>fb.width) hdr.framew=fb.width/scale;
+	if(hdr.frameh*scale>fb.height) hdr.frameh=fb.height/scale;
 	pixelSize=fbx_ps[fb.format];  pitch=fb.pitch;
 	bits=(unsigned char *)fb.bits;
+	if(scale>1)
+	{
+		pitch=hdr.framew*pixelSize;
+		if(pitch*hdr.frameh>scaleBitsSize)
+		{
+			delete [] scaleBits;  scaleBits=NULL;  scaleBitsSize=0;
+			_newcheck(scaleBits=new unsigned char[pitch*hdr.frameh]);
+			scaleBitsSize=pitch*hdr.frameh;
+		}
+		bits=scaleBits;
+	}
 	flags=0;
 	if(fbx_bgr[fb.format]) flags|=FRAME_BGR;
 	if(fbx_alphafirst[fb.format]) flags|=FRAME_ALPHAFIRST;
@@ -624,39 +614,130 @@ void FBXFrame::init(rrframeheader &h)
 
 
 FBXFrame &FBXFrame::operator= (CompressedFrame &cf)
+{
+	if(!cf.bits || cf.hdr.size<1)
+		_throw("JPEG not initialized");
+	init(cf.hdr, cf.scale);
+	if(!tjhnd && cf.hdr.compress!=RRCOMP_RGB)
+	{
+		if((tjhnd=tjInitDecompress())==NULL)
+			throw(Error("FBXFrame::decompressor", tjGetErrorStr()));
+	}
+	decompress(cf, tjhnd);
+	return *this;
+}
+
+
+// Decompress a tile into a frame that has already been initialized with the
+// tile's frame dimensions.  Tiles that do not overlap can be decompressed into
+// the same frame by multiple threads at once, as long as each thread uses its
+// own TurboJPEG instance.
+void FBXFrame::decompress(CompressedFrame &cf, tjhandle handle)
 {
 	int tjflags=0;
 	if(!cf.bits || cf.hdr.size<1)
 		_throw("JPEG not initialized");
-	init(cf.hdr);
 	if(!fb.xi) _throw("Frame not initialized");
 	if(fbx_bgr[fb.format]) tjflags|=TJ_BGR;
 	if(fbx_alphafirst[fb.format]) tjflags|=TJ_ALPHAFIRST;
-	int width=min(cf.hdr.width, fb.width-cf.hdr.x);
-	int height=min(cf.hdr.height, fb.height-cf.hdr.y);
+	int width=min(cf.hdr.width, hdr.framew-cf.hdr.x);
+	int height=min(cf.hdr.height, hdr.frameh-cf.hdr.y);
 	if(width>0 && height>0 && cf.hdr.width<=width && cf.hdr.height<=height)
 	{
 		if(cf.hdr.compress==RRCOMP_RGB) decompressRGB(cf, width, height, false);
 		else
 		{
-			if(!tjhnd)
+			_tj(tjDecompress(handle, cf.bits, cf.hdr.size,
+				&bits[pitch*cf.hdr.y+cf.hdr.x*pixelSize], width, pitch, height,
+				pixelSize, tjflags));
+		}
+	}
+}
+
+
+// If sync is false, then this returns as soon as the blit has been sent to the
+// X server, and waitUntilDrawn() must be called before the frame is reused.
+// If last is non-NULL, then it must be the frame that was previously drawn
+// into the same window, and only the tiles that differ from it are drawn.
+void FBXFrame::redraw(bool sync, Frame *last, int tileSize)
+{
+	if(scale>1)
+	{
+		// Replicate each pixel of the scaled-down frame into a scale x scale
+		// block of the frame buffer, and draw the whole frame buffer.
+		int width=hdr.framew*scale, height=hdr.frameh*scale,
+			rowSize=width*pixelSize;
+		for(int i=0; i<hdr.frameh; i++)
+		{
+			unsigned char *src=&bits[pitch*
+				(flags&FRAME_BOTTOMUP? hdr.frameh-i-1:i)],
+				*dst=(unsigned char *)&fb.bits[fb.pitch*i*scale];
+			PixelConv::upscale(src, dst, hdr.framew, pixelSize, scale);
+			for(int j=1; j<scale; j++) memcpy(&dst[fb.pitch*j], dst, rowSize);
+		}
+		if(sync) { _fbx(fbx_write(&fb, 0, 0, 0, 0, width, height)); }
+		else { _fbx(fbx_flush(&fb, 0, 0, 0, 0, width, height)); }
+		return;
+	}
+	if(flags&FRAME_BOTTOMUP)
+	{
+		PixelConv::flip((unsigned char *)fb.bits, fb.pitch,
+			fb.width*fbx_ps[fb.format], fb.height);
+		flags&=(~FRAME_BOTTOMUP);
+	}
+	if(!last)
+	{
+		if(sync) { _fbx(fbx_write(&fb, 0, 0, 0, 0, fb.width, fb.height)); }
+		else { _fbx(fbx_flush(&fb, 0, 0, 0, 0, fb.width, fb.height)); }
+		return;
+	}
+
+	int tileSizeX=tileSize? tileSize:hdr.width;
+	int tileSizeY=tileSize? tileSize:hdr.height;
+
+	for(int i=0; i<hdr.height; i+=tileSizeY)
+	{
+		int height=tileSizeY, y=i, spanX=-1, spanWidth=0;
+
+		if(hdr.height-i<(3*tileSizeY/2))
+		{
+			height=hdr.height-i;  i+=tileSizeY;
+		}
+		// Adjacent changed tiles in the same row are drawn with one request.
+		for(int j=0; j<hdr.width; j+=tileSizeX)
+		{
+			int width=tileSizeX, x=j;
+
+			if(hdr.width-j<(3*tileSizeX/2))
+			{
+				width=hdr.width-j;  j+=tileSizeX;
+			}
+			if(tileEquals(last, x, y, width, height))
+			{
+				if(spanX>=0)
+					_fbx(fbx_flush(&fb, spanX, y, spanX, y, spanWidth, height));
+				spanX=-1;
+			}
+			else
 			{
-				if((tjhnd=tjInitDecompress())==NULL)
-					throw(Error("FBXFrame::decompressor", tjGetErrorStr()));
+				if(spanX<0) { spanX=x;  spanWidth=0; }
+				spanWidth+=width;
 			}
-			_tj(tjDecompress(tjhnd, cf.bits, cf.hdr.size,
-				(unsigned char *)&fb.bits[fb.pitch*cf.hdr.y+cf.hdr.x*fbx_ps[fb.format]],
-				width, fb.pitch, height, fbx_ps[fb.format], tjflags));
 		}
+		if(spanX>=0)
+			_fbx(fbx_flush(&fb, spanX, y, spanX, y, spanWidth, height));
+	}
+	if(sync)
+	{
+		XSync(wh.dpy, False);
+		_fbx(fbx_wait(&fb));
 	}
-	return *this;
 }
 
 
-void FBXFrame::redraw(void)
+void FBXFrame::waitUntilDrawn(void)
 {
-	if(flags&FRAME_BOTTOMUP) _fbx(fbx_flip(&fb, 0, 0, 0, 0));
-	_fbx(fbx_write(&fb, 0, 0, 0, 0, fb.width, fb.height));
+	_fbx(fbx_wait(&fb));
 }
 
 
@@ -699,35 +780,88 @@ XVFrame::~XVFrame(void)
 
 XVFrame &XVFrame::operator= (Frame &f)
 {
-	if(!f.bits) _throw("Frame not initialized");
-	if(f.pixelSize<3 || f.pixelSize>4)
-		_throw("Only true color frames are supported");
-	int tjflags=0;
-	init(f.hdr);
-	if(f.flags&FRAME_BOTTOMUP) tjflags|=TJ_BOTTOMUP;
-	if(f.flags&FRAME_BGR) tjflags|=TJ_BGR;
+	init(f);
 	if(!tjhnd)
 	{
 		if((tjhnd=tjInitCompress())==NULL)
 			throw(Error("XVFrame::compressor", tjGetErrorStr()));
 	}
-	_tj(tjEncodeYUV(tjhnd, f.bits, f.hdr.width, f.pitch, f.hdr.height,
-		f.pixelSize, bits, TJ_420, tjflags));
+	encode(f, 0, f.hdr.height, tjhnd, NULL);
+	return *this;
+}
+
+
+// Initialize the frame so that f can be converted into it using encode()
+void XVFrame::init(Frame &f)
+{
+	if(!f.bits) _throw("Frame not initialized");
+	if(f.pixelSize<3 || f.pixelSize>4)
+		_throw("Only true color frames are supported");
+	init(f.hdr);
 	hdr.size=(unsigned int)tjBufSizeYUV(f.hdr.width, f.hdr.height, TJ_420);
 	if(hdr.size!=(unsigned long)fb.xvi->data_size)
 		_throw("Image size mismatch in YUV encoder");
-	return *this;
+}
+
+
+// Convert rows startY through startY+height-1 of f to I420 and store them in
+// the corresponding rows of this frame.  Unless the whole frame is being
+// converted, startY must be even, and buf must point to a scratch buffer of at
+// least tjBufSizeYUV(f.hdr.width, height, TJ_420) bytes.  Stripes can be
+// converted in parallel if each thread uses its own handle and buffer.
+void XVFrame::encode(Frame &f, int startY, int height, tjhandle handle,
+	unsigned char *buf)
+{
+	int tjflags=0, width=f.hdr.width;  unsigned char *srcBits=f.bits;
+
+	if(startY<0 || height<1 || startY+height>f.hdr.height)
+		_throw("Invalid argument");
+	if(f.flags&FRAME_BOTTOMUP)
+	{
+		tjflags|=TJ_BOTTOMUP;
+		srcBits+=(f.hdr.height-startY-height)*f.pitch;
+	}
+	else srcBits+=startY*f.pitch;
+	if(f.flags&FRAME_BGR) tjflags|=TJ_BGR;
+
+	if(height==f.hdr.height)
+	{
+		_tj(tjEncodeYUV(handle, srcBits, width, f.pitch, height, f.pixelSize,
+			bits, TJ_420, tjflags));
+		return;
+	}
+
+	if(!buf || startY&1) _throw("Invalid argument");
+	_tj(tjEncodeYUV(handle, srcBits, width, f.pitch, height, f.pixelSize, buf,
+		TJ_420, tjflags));
+
+	// The planes in buf have rows padded to 4 bytes, whereas the planes in the
+	// XvImage have the pitches and offsets that the X server chose.
+	XvImage *xvi=fb.xvi;
+	int cw=(width+1)/2, ch=(height+1)/2;
+	int yPitch=(width+3)&(~3), cPitch=(cw+3)&(~3);
+	unsigned char *u=&buf[yPitch*height], *v=&u[cPitch*ch];
+	for(int i=0; i<height; i++)
+		memcpy(&bits[xvi->offsets[0]+xvi->pitches[0]*(startY+i)],
+			&buf[yPitch*i], width);
+	for(int i=0; i<ch; i++)
+	{
+		memcpy(&bits[xvi->offsets[1]+xvi->pitches[1]*(startY/2+i)],
+			&u[cPitch*i], cw);
+		memcpy(&bits[xvi->offsets[2]+xvi->pitches[2]*(startY/2+i)],
+			&v[cPitch*i], cw);
+	}
 }
 
 
 void XVFrame::init(rrframeheader &h)
 {
 	checkHeader(h);
-	_fbxv(fbxv_init(&fb, dpy, win, h.framew, h.frameh, I420_PLANAR, 0));
+	_fbxv(fbxv_init(&fb, dpy, win, h.framew, h.frameh, I420_PLANAR, 1));
 	if(h.framew>fb.xvi->width || h.frameh>fb.xvi->height)
 	{
 		XSync(dpy, False);
-		_fbx(fbxv_init(&fb, dpy, win, h.framew, h.frameh, I420_PLANAR, 0));
+		_fbx(fbxv_init(&fb, dpy, win, h.framew, h.frameh, I420_PLANAR, 1));
 	}
 	hdr=h;
 	if(hdr.framew>fb.xvi->width) hdr.framew=fb.xvi->width;
@@ -738,9 +872,28 @@ void XVFrame::init(rrframeheader &h)
 }
 
 
-void XVFrame::redraw(void)
+// If sync is false, then the image is drawn asynchronously, and
+// waitUntilDrawn() must be called before the frame is reused.
+void XVFrame::redraw(bool sync)
+{
+	// If the frame was scaled down by the server, then X Video scales it back
+	// up.
+	int dstWidth=hdr.framew*scale, dstHeight=hdr.frameh*scale;
+
+	if(sync)
+	{
+		_fbxv(fbxv_write(&fb, 0, 0, 0, 0, 0, 0, dstWidth, dstHeight));
+	}
+	else
+	{
+		_fbxv(fbxv_flush(&fb, 0, 0, 0, 0, 0, 0, dstWidth, dstHeight));
+	}
+}
+
+
+void XVFrame::waitUntilDrawn(void)
 {
-	_fbxv(fbxv_write(&fb, 0, 0, 0, 0, 0, 0, hdr.framew, hdr.frameh));
+	_fbxv(fbxv_wait(&fb));
 }
 
 #endif
@@ -63,6 +63,11 @@ namespace vglcommon
 			unsigned char *rbits;
 			int pitch, pixelSize, flags;
 			bool isGL, isXV, stereo;
+			// Factor by which the frame was scaled down by the faker (see
+			// RR3_SCALE.)  The client scales the frame back up when drawing it.
+			int scale;
+			// Latency times of an EOF frame (used by the VirtualGL Client)
+			rrframetimes times;
 
 		protected:
 
@@ -92,11 +97,16 @@ namespace vglcommon
 			void compressJPEG(Frame &f);
 			void compressRGB(Frame &f);
 			void init(rrframeheader &h, int buffer);
+			void reserve(unsigned long size);
+			void setBits(unsigned char *buf, int buffer);
+			static unsigned long bufSize(rrframeheader &h);
 
 			rrframeheader rhdr;
 
 		private:
 
+			unsigned char *ownBits, *ownRBits;
+			unsigned long bitsSize, rbitsSize;
 			tjhandle tjhnd;
 			friend class FBXFrame;
 	};
@@ -117,9 +127,12 @@ namespace vglcommon
 			void init(char *dpystring, Drawable draw, Visual *vis=NULL);
 			void init(Display *dpy, Drawable draw, Visual *vis);
 			~FBXFrame(void);
-			void init(rrframeheader &h);
+			void init(rrframeheader &h, int scale=1);
 			FBXFrame& operator= (CompressedFrame &cf);
-			void redraw(void);
+			void decompress(CompressedFrame &cf, tjhandle handle);
+			void redraw(bool sync=true) { redraw(sync, NULL, 0); }
+			void redraw(bool sync, Frame *last, int tileSize);
+			void waitUntilDrawn(void);
 
 		private:
 
@@ -127,6 +140,8 @@ namespace vglcommon
 			fbx_struct fb;
 			tjhandle tjhnd;
 			bool reuseConn;
+			// Scaled-down frame (see init())
+			unsigned char *scaleBits;  int scaleBitsSize;
 	};
 }
 
@@ -147,7 +162,11 @@ namespace vglcommon
 			~XVFrame(void);
 			XVFrame &operator= (Frame &f);
 			void init(rrframeheader &h);
-			void redraw(void);
+			void init(Frame &f);
+			void encode(Frame &f, int startY, int height, tjhandle handle,
+				unsigned char *buf);
+			void redraw(bool sync=true);
+			void waitUntilDrawn(void);
 
 		private:
 
@@ -0,0 +1,665 @@
+/* Copyright (C)2014 D. R. Commander
+ *
+ * This library is free software and may be redistributed and/or modified under
+ * the terms of the wxWindows Library License, Version 3.1 or (at your option)
+ * any later version.  The full license is in the LICENSE.txt file included
+ * with this distribution.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * wxWindows Library License for more details.
+ */
+
+#include <string.h>
+#include "PixelConv.h"
+#include "Frame.h"
+
+// The SIMD kernels are compiled using function-specific target attributes, so
+// the rest of the code does not have to be built with -msse* or -mavx*.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) \
+	|| (defined(__GNUC__) \
+		&& (__GNUC__>4 || (__GNUC__==4 && __GNUC_MINOR__>=9))))
+#define PIXELCONV_X86
+#include <immintrin.h>
+#define TARGET(t) __attribute__((target(t)))
+#endif
+
+using namespace vglcommon;
+
+
+static const int pixelSize[PF_NUMFORMATS]={ 3, 4, 3, 4, 4, 4 };
+static const int roffset[PF_NUMFORMATS]={ 0, 0, 2, 2, 3, 1 };
+static const int goffset[PF_NUMFORMATS]={ 1, 1, 1, 1, 2, 2 };
+static const int boffset[PF_NUMFORMATS]={ 2, 2, 0, 0, 1, 3 };
+static const int xoffset[PF_NUMFORMATS]={ -1, 3, -1, 3, 0, 0 };
+
+static const char *formatName[PF_NUMFORMATS]=
+{
+	"RGB", "RGBX", "BGR", "BGRX", "XBGR", "XRGB"
+};
+
+static const char *levelName[SIMD_NUMLEVELS]=
+{
+	"None", "SSE2", "SSSE3", "AVX2"
+};
+
+
+// Plain C kernels.  These also handle the pixels at the end of each row that
+// the SIMD kernels leave behind.
+
+static void fromRGB_C(const unsigned char *src, unsigned char *dst, int width,
+	int format)
+{
+	int ps=pixelSize[format], r=roffset[format], g=goffset[format],
+		b=boffset[format], x=xoffset[format];
+
+	if(format==PF_RGB)
+	{
+		memcpy(dst, src, width*3);  return;
+	}
+	for(int i=0; i<width; i++, src+=3, dst+=ps)
+	{
+		dst[r]=src[0];  dst[g]=src[1];  dst[b]=src[2];
+		if(x>=0) dst[x]=0xFF;
+	}
+}
+
+
+static void packPlanes_C(const unsigned char *rsrc, const unsigned char *gsrc,
+	const unsigned char *bsrc, unsigned char *dst, int width, int format)
+{
+	int ps=pixelSize[format], r=roffset[format], g=goffset[format],
+		b=boffset[format], x=xoffset[format];
+
+	for(int i=0; i<width; i++, dst+=ps)
+	{
+		dst[r]=rsrc[i];  dst[g]=gsrc[i];  dst[b]=bsrc[i];
+		if(x>=0) dst[x]=0xFF;
+	}
+}
+
+
+static void decimate_C(const unsigned char *src, unsigned char *dst,
+	int width, int ps)
+{
+	for(int i=0; i<width; i++, src+=ps*2, dst+=ps)
+		memcpy(dst, src, ps);
+}
+
+
+static void swapRows_C(unsigned char *row1, unsigned char *row2, int rowSize)
+{
+	int i=0;
+	for(; i<=rowSize-(int)sizeof(long); i+=sizeof(long))
+	{
+		long temp;
+		memcpy(&temp, &row1[i], sizeof(long));
+		memcpy(&row1[i], &row2[i], sizeof(long));
+		memcpy(&row2[i], &temp, sizeof(long));
+	}
+	for(; i<rowSize; i++)
+	{
+		unsigned char temp=row1[i];  row1[i]=row2[i];  row2[i]=temp;
+	}
+}
+
+
+static void flip_C(unsigned char *bits, int pitch, int rowSize, int height)
+{
+	unsigned char *top=bits, *bottom=&bits[(long)pitch*(height-1)];
+	for(int j=0; j<height/2; j++, top+=pitch, bottom-=pitch)
+		swapRows_C(top, bottom, rowSize);
+}
+
+
+static void downscale_C(const unsigned char *src, int srcPitch,
+	unsigned char *dst, int width, int ps, int factor)
+{
+	int n=factor*factor;
+
+	for(int i=0; i<width; i++, src+=ps*factor, dst+=ps)
+	{
+		for(int k=0; k<ps; k++)
+		{
+			int sum=0;
+			for(int y=0; y<factor; y++)
+				for(int x=0; x<factor; x++)
+					sum+=src[(long)srcPitch*y+ps*x+k];
+			dst[k]=(sum+n/2)/n;
+		}
+	}
+}
+
+
+static void upscale_C(const unsigned char *src, unsigned char *dst,
+	int width, int ps, int factor)
+{
+	for(int i=0; i<width; i++, src+=ps)
+		for(int x=0; x<factor; x++, dst+=ps)
+			memcpy(dst, src, ps);
+}
+
+
+#ifdef PIXELCONV_X86
+
+// SSE2 kernels
+
+static inline TARGET("sse2") void store4_SSE2(unsigned char *dst, __m128i c0,
+	__m128i c1, __m128i c2, __m128i c3)
+{
+	__m128i lo01=_mm_unpacklo_epi8(c0, c1), hi01=_mm_unpackhi_epi8(c0, c1),
+		lo23=_mm_unpacklo_epi8(c2, c3), hi23=_mm_unpackhi_epi8(c2, c3);
+	_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)&dst[16], _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)&dst[32], _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i *)&dst[48], _mm_unpackhi_epi16(hi01, hi23));
+}
+
+
+// Interleave 16 pixels from the three planes into the component order of the
+// given format.  For 3-byte formats, the fourth byte of each pixel is
+// undefined.
+static inline TARGET("sse2") void pack16_SSE2(const unsigned char *rsrc,
+	const unsigned char *gsrc, const unsigned char *bsrc, unsigned char *dst,
+	int format)
+{
+	__m128i r=_mm_loadu_si128((const __m128i *)rsrc),
+		g=_mm_loadu_si128((const __m128i *)gsrc),
+		b=_mm_loadu_si128((const __m128i *)bsrc), x=_mm_set1_epi8((char)0xFF);
+
+	switch(format)
+	{
+		case PF_BGR:  case PF_BGRX:  store4_SSE2(dst, b, g, r, x);  break;
+		case PF_XBGR:  store4_SSE2(dst, x, b, g, r);  break;
+		case PF_XRGB:  store4_SSE2(dst, x, r, g, b);  break;
+		default:  store4_SSE2(dst, r, g, b, x);  break;
+	}
+}
+
+
+static TARGET("sse2") void packPlanes_SSE2(const unsigned char *rsrc,
+	const unsigned char *gsrc, const unsigned char *bsrc, unsigned char *dst,
+	int width, int format)
+{
+	int i=0;
+
+	if(pixelSize[format]==4)
+	{
+		for(; i+16<=width; i+=16, dst+=64)
+			pack16_SSE2(&rsrc[i], &gsrc[i], &bsrc[i], dst, format);
+	}
+	if(i<width) packPlanes_C(&rsrc[i], &gsrc[i], &bsrc[i], dst, width-i, format);
+}
+
+
+static TARGET("sse2") void decimate_SSE2(const unsigned char *src,
+	unsigned char *dst, int width, int ps)
+{
+	int i=0;
+
+	if(ps==4)
+	{
+		for(; i+5<=width; i+=4, src+=32, dst+=16)
+		{
+			__m128 a=_mm_castsi128_ps(_mm_loadu_si128((const __m128i *)src)),
+				b=_mm_castsi128_ps(_mm_loadu_si128((const __m128i *)&src[16]));
+			_mm_storeu_si128((__m128i *)dst,
+				_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+		}
+	}
+	if(i<width) decimate_C(src, dst, width-i, ps);
+}
+
+
+static TARGET("sse2") void flip_SSE2(unsigned char *bits, int pitch,
+	int rowSize, int height)
+{
+	unsigned char *top=bits, *bottom=&bits[(long)pitch*(height-1)];
+	for(int j=0; j<height/2; j++, top+=pitch, bottom-=pitch)
+	{
+		int i=0;
+		for(; i+16<=rowSize; i+=16)
+		{
+			__m128i t=_mm_loadu_si128((__m128i *)&top[i]),
+				b=_mm_loadu_si128((__m128i *)&bottom[i]);
+			_mm_storeu_si128((__m128i *)&top[i], b);
+			_mm_storeu_si128((__m128i *)&bottom[i], t);
+		}
+		if(i<rowSize) swapRows_C(&top[i], &bottom[i], rowSize-i);
+	}
+}
+
+
+// The box filter accumulates the components of each pair of adjacent 4-byte
+// pixels in the 16-bit lanes of one register, so 4*factor pixels from each row
+// occupy factor*2 registers.
+static inline TARGET("sse2") void accum4_SSE2(__m128i v, __m128i *sum)
+{
+	__m128i zero=_mm_setzero_si128();
+	sum[0]=_mm_add_epi16(sum[0], _mm_unpacklo_epi8(v, zero));
+	sum[1]=_mm_add_epi16(sum[1], _mm_unpackhi_epi8(v, zero));
+}
+
+
+// Add the adjacent pixels in the accumulators until each pixel holds the sum
+// of a factor x factor block, then return the 4 averaged pixels
+static inline TARGET("sse2") __m128i reduce4_SSE2(__m128i *sum, int factor)
+{
+	for(int n=factor*2; n>2; n/=2)
+	{
+		for(int i=0; i<n/2; i++)
+			sum[i]=_mm_add_epi16(_mm_unpacklo_epi64(sum[i*2], sum[i*2+1]),
+				_mm_unpackhi_epi64(sum[i*2], sum[i*2+1]));
+	}
+	__m128i shift=_mm_cvtsi32_si128(factor==4? 4:2),
+		round=_mm_set1_epi16(factor==4? 8:2);
+	return _mm_packus_epi16(
+		_mm_srl_epi16(_mm_add_epi16(sum[0], round), shift),
+		_mm_srl_epi16(_mm_add_epi16(sum[1], round), shift));
+}
+
+
+static TARGET("sse2") void downscale_SSE2(const unsigned char *src,
+	int srcPitch, unsigned char *dst, int width, int ps, int factor)
+{
+	int i=0;
+
+	if(ps==4)
+	{
+		// 4 pixels per iteration
+		for(; i+4<=width; i+=4, src+=16*factor, dst+=16)
+		{
+			__m128i sum[8];
+			for(int k=0; k<factor*2; k++) sum[k]=_mm_setzero_si128();
+			for(int y=0; y<factor; y++)
+			{
+				const unsigned char *row=&src[(long)srcPitch*y];
+				for(int k=0; k<factor; k++)
+					accum4_SSE2(_mm_loadu_si128((const __m128i *)&row[k*16]),
+						&sum[k*2]);
+			}
+			_mm_storeu_si128((__m128i *)dst, reduce4_SSE2(sum, factor));
+		}
+	}
+	if(i<width) downscale_C(src, srcPitch, dst, width-i, ps, factor);
+}
+
+
+static TARGET("sse2") void upscale_SSE2(const unsigned char *src,
+	unsigned char *dst, int width, int ps, int factor)
+{
+	int i=0;
+
+	if(ps==4)
+	{
+		// 4 pixels per iteration
+		for(; i+4<=width; i+=4, src+=16, dst+=16*factor)
+		{
+			__m128i v=_mm_loadu_si128((const __m128i *)src);
+			if(factor==2)
+			{
+				_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi32(v, v));
+				_mm_storeu_si128((__m128i *)&dst[16], _mm_unpackhi_epi32(v, v));
+			}
+			else
+			{
+				_mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi32(v, 0x00));
+				_mm_storeu_si128((__m128i *)&dst[16], _mm_shuffle_epi32(v, 0x55));
+				_mm_storeu_si128((__m128i *)&dst[32], _mm_shuffle_epi32(v, 0xAA));
+				_mm_storeu_si128((__m128i *)&dst[48], _mm_shuffle_epi32(v, 0xFF));
+			}
+		}
+	}
+	if(i<width) upscale_C(src, dst, width-i, ps, factor);
+}
+
+
+// SSSE3 kernels.  These use PSHUFB to rearrange the bytes of 3-byte pixels,
+// and they write 16 bytes at a time, some of which are overwritten with the
+// correct values in the next iteration.
+
+// Build the PSHUFB mask that converts 4 RGB pixels into 4 pixels of the given
+// 4-byte format, along with the mask of the unused bytes
+static void getShuffleMask4(int format, unsigned char *mask,
+	unsigned char *xmask)
+{
+	for(int p=0; p<4; p++)
+	{
+		mask[p*4+roffset[format]]=p*3;
+		mask[p*4+goffset[format]]=p*3+1;
+		mask[p*4+boffset[format]]=p*3+2;
+		mask[p*4+xoffset[format]]=0x80;
+		for(int i=0; i<4; i++) xmask[p*4+i]=(i==xoffset[format])? 0xFF:0;
+	}
+}
+
+
+static TARGET("ssse3") void fromRGB_SSSE3(const unsigned char *src,
+	unsigned char *dst, int width, int format)
+{
+	int i=0;
+
+	if(format==PF_BGR)
+	{
+		// 5 pixels per iteration
+		const __m128i mask=_mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14,
+			13, 12, 15);
+		for(; i+6<=width; i+=5, src+=15, dst+=15)
+			_mm_storeu_si128((__m128i *)dst,
+				_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), mask));
+	}
+	else if(pixelSize[format]==4)
+	{
+		unsigned char m[16], xm[16];
+		getShuffleMask4(format, m, xm);
+		const __m128i mask=_mm_loadu_si128((__m128i *)m),
+			xmask=_mm_loadu_si128((__m128i *)xm);
+		for(; i+6<=width; i+=4, src+=12, dst+=16)
+			_mm_storeu_si128((__m128i *)dst, _mm_or_si128(
+				_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), mask),
+				xmask));
+	}
+	if(i<width) fromRGB_C(src, dst, width-i, format);
+}
+
+
+static TARGET("ssse3") void packPlanes_SSSE3(const unsigned char *rsrc,
+	const unsigned char *gsrc, const unsigned char *bsrc, unsigned char *dst,
+	int width, int format)
+{
+	int i=0;
+
+	if(pixelSize[format]==4)
+	{
+		packPlanes_SSE2(rsrc, gsrc, bsrc, dst, width, format);
+		return;
+	}
+
+	// Interleave 16 pixels into 4-byte pixels on the stack, then remove the
+	// fourth byte of each pixel.
+	const __m128i mask=_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+		-1, -1, -1, -1);
+	unsigned char buf[64];
+	for(; i+18<=width; i+=16, dst+=48)
+	{
+		pack16_SSE2(&rsrc[i], &gsrc[i], &bsrc[i], buf, format);
+		for(int j=0; j<4; j++)
+			_mm_storeu_si128((__m128i *)&dst[j*12], _mm_shuffle_epi8(
+				_mm_loadu_si128((__m128i *)&buf[j*16]), mask));
+	}
+	if(i<width) packPlanes_C(&rsrc[i], &gsrc[i], &bsrc[i], dst, width-i, format);
+}
+
+
+static TARGET("ssse3") void decimate_SSSE3(const unsigned char *src,
+	unsigned char *dst, int width, int ps)
+{
+	int i=0;
+
+	if(ps!=3)
+	{
+		decimate_SSE2(src, dst, width, ps);
+		return;
+	}
+	// 3 pixels per iteration
+	const __m128i mask=_mm_setr_epi8(0, 1, 2, 6, 7, 8, 12, 13, 14, -1, -1, -1,
+		-1, -1, -1, -1);
+	for(; i+6<=width; i+=3, src+=18, dst+=9)
+		_mm_storeu_si128((__m128i *)dst,
+			_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), mask));
+	if(i<width) decimate_C(src, dst, width-i, ps);
+}
+
+
+static TARGET("ssse3") void downscale_SSSE3(const unsigned char *src,
+	int srcPitch, unsigned char *dst, int width, int ps, int factor)
+{
+	int i=0;
+
+	if(ps!=3)
+	{
+		downscale_SSE2(src, srcPitch, dst, width, ps, factor);
+		return;
+	}
+	// 4 pixels per iteration.  The source pixels are expanded to 4 bytes before
+	// they are accumulated, and the fourth byte of each result is removed.
+	const __m128i expand=_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9,
+		10, 11, -1),
+		compact=_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1,
+			-1);
+	for(; i+6<=width; i+=4, src+=12*factor, dst+=12)
+	{
+		__m128i sum[8];
+		for(int k=0; k<factor*2; k++) sum[k]=_mm_setzero_si128();
+		for(int y=0; y<factor; y++)
+		{
+			const unsigned char *row=&src[(long)srcPitch*y];
+			for(int k=0; k<factor; k++)
+				accum4_SSE2(_mm_shuffle_epi8(
+					_mm_loadu_si128((const __m128i *)&row[k*12]), expand), &sum[k*2]);
+		}
+		_mm_storeu_si128((__m128i *)dst,
+			_mm_shuffle_epi8(reduce4_SSE2(sum, factor), compact));
+	}
+	if(i<width) downscale_C(src, srcPitch, dst, width-i, ps, factor);
+}
+
+
+static TARGET("ssse3") void upscale_SSSE3(const unsigned char *src,
+	unsigned char *dst, int width, int ps, int factor)
+{
+	int i=0;
+
+	if(ps!=3)
+	{
+		upscale_SSE2(src, dst, width, ps, factor);
+		return;
+	}
+	// 4 pixels per iteration
+	unsigned char m[48];  __m128i mask[3];
+	int nMasks=(12*factor+15)/16;
+	memset(m, 0, 48);
+	for(int k=0; k<12*factor; k++) m[k]=(k/3/factor)*3+k%3;
+	for(int j=0; j<nMasks; j++) mask[j]=_mm_loadu_si128((__m128i *)&m[j*16]);
+	for(; i+6<=width; i+=4, src+=12, dst+=12*factor)
+	{
+		__m128i v=_mm_loadu_si128((const __m128i *)src);
+		for(int j=0; j<nMasks; j++)
+			_mm_storeu_si128((__m128i *)&dst[j*16], _mm_shuffle_epi8(v, mask[j]));
+	}
+	if(i<width) upscale_C(src, dst, width-i, ps, factor);
+}
+
+
+// AVX2 kernels
+
+static TARGET("avx2") void fromRGB_AVX2(const unsigned char *src,
+	unsigned char *dst, int width, int format)
+{
+	int i=0;
+
+	if(pixelSize[format]==4)
+	{
+		// 8 pixels per iteration.  PSHUFB operates on each 128-bit lane
+		// separately, so each lane receives 4 pixels.
+		unsigned char m[16], xm[16];
+		getShuffleMask4(format, m, xm);
+		const __m256i mask=
+			_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)m)),
+			xmask=_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)xm));
+		for(; i+10<=width; i+=8, src+=24, dst+=32)
+		{
+			__m256i v=_mm256_inserti128_si256(_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *)src)),
+				_mm_loadu_si128((const __m128i *)&src[12]), 1);
+			_mm256_storeu_si256((__m256i *)dst,
+				_mm256_or_si256(_mm256_shuffle_epi8(v, mask), xmask));
+		}
+	}
+	if(i<width) fromRGB_SSSE3(src, dst, width-i, format);
+}
+
+#endif // PIXELCONV_X86
+
+
+int PixelConv::level=-1, PixelConv::maxLevel=-1;
+PixelConv::FromRGBFunc PixelConv::fromRGBFunc=fromRGB_C;
+PixelConv::PackPlanesFunc PixelConv::packPlanesFunc=packPlanes_C;
+PixelConv::DecimateFunc PixelConv::decimateFunc=decimate_C;
+PixelConv::FlipFunc PixelConv::flipFunc=flip_C;
+PixelConv::DownscaleFunc PixelConv::downscaleFunc=downscale_C;
+PixelConv::UpscaleFunc PixelConv::upscaleFunc=upscale_C;
+
+
+// If two threads call this at the same time, then they will both select the
+// same kernels.  The C kernels are used until then.
+void PixelConv::init(void)
+{
+	int max=SIMD_NONE;
+
+	#ifdef PIXELCONV_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+	{
+		max=SIMD_SSE2;
+		if(__builtin_cpu_supports("ssse3"))
+		{
+			max=SIMD_SSSE3;
+			if(__builtin_cpu_supports("avx2")) max=SIMD_AVX2;
+		}
+	}
+	#endif
+	maxLevel=max;
+	setLevel(maxLevel);
+}
+
+
+int PixelConv::getFormat(int pixelSize, int flags)
+{
+	bool bgr=(flags&FRAME_BGR)!=0, alphaFirst=(flags&FRAME_ALPHAFIRST)!=0;
+
+	if(pixelSize==3 && !alphaFirst) return bgr? PF_BGR:PF_RGB;
+	if(pixelSize==4)
+	{
+		if(alphaFirst) return bgr? PF_XBGR:PF_XRGB;
+		return bgr? PF_BGRX:PF_RGBX;
+	}
+	return -1;
+}
+
+
+int PixelConv::getPixelSize(int format)
+{
+	if(format<0 || format>=PF_NUMFORMATS) return 0;
+	return pixelSize[format];
+}
+
+
+const char *PixelConv::getFormatName(int format)
+{
+	if(format<0 || format>=PF_NUMFORMATS) return "Unknown";
+	return formatName[format];
+}
+
+
+int PixelConv::getMaxLevel(void)
+{
+	if(maxLevel<0) init();
+	return maxLevel;
+}
+
+
+int PixelConv::getLevel(void)
+{
+	if(maxLevel<0) init();
+	return level;
+}
+
+
+const char *PixelConv::getLevelName(int level_)
+{
+	if(level_<0 || level_>=SIMD_NUMLEVELS) return "Unknown";
+	return levelName[level_];
+}
+
+
+void PixelConv::setLevel(int level_)
+{
+	if(maxLevel<0) init();
+	if(level_<SIMD_NONE) level_=SIMD_NONE;
+	if(level_>maxLevel) level_=maxLevel;
+
+	fromRGBFunc=fromRGB_C;  packPlanesFunc=packPlanes_C;
+	decimateFunc=decimate_C;  flipFunc=flip_C;
+	downscaleFunc=downscale_C;  upscaleFunc=upscale_C;
+	#ifdef PIXELCONV_X86
+	if(level_>=SIMD_SSE2)
+	{
+		packPlanesFunc=packPlanes_SSE2;  decimateFunc=decimate_SSE2;
+		flipFunc=flip_SSE2;  downscaleFunc=downscale_SSE2;
+		upscaleFunc=upscale_SSE2;
+	}
+	if(level_>=SIMD_SSSE3)
+	{
+		fromRGBFunc=fromRGB_SSSE3;  packPlanesFunc=packPlanes_SSSE3;
+		decimateFunc=decimate_SSSE3;  downscaleFunc=downscale_SSSE3;
+		upscaleFunc=upscale_SSSE3;
+	}
+	if(level_>=SIMD_AVX2) fromRGBFunc=fromRGB_AVX2;
+	#endif
+	level=level_;
+}
+
+
+void PixelConv::fromRGB(const unsigned char *src, unsigned char *dst,
+	int width, int dstFormat)
+{
+	if(maxLevel<0) init();
+	if(width>0) fromRGBFunc(src, dst, width, dstFormat);
+}
+
+
+void PixelConv::packPlanes(const unsigned char *r, const unsigned char *g,
+	const unsigned char *b, unsigned char *dst, int width, int dstFormat)
+{
+	if(maxLevel<0) init();
+	if(width>0) packPlanesFunc(r, g, b, dst, width, dstFormat);
+}
+
+
+void PixelConv::decimate(const unsigned char *src, unsigned char *dst,
+	int width, int pixelSize)
+{
+	if(maxLevel<0) init();
+	if(width>0) decimateFunc(src, dst, width, pixelSize);
+}
+
+
+void PixelConv::flip(unsigned char *bits, int pitch, int rowSize, int height)
+{
+	if(maxLevel<0) init();
+	if(height>1 && rowSize>0) flipFunc(bits, pitch, rowSize, height);
+}
+
+
+// The SIMD kernels support only factors of 2 and 4.
+void PixelConv::downscale(const unsigned char *src, int srcPitch,
+	unsigned char *dst, int width, int pixelSize, int factor)
+{
+	if(maxLevel<0) init();
+	if(width<1 || factor<1) return;
+	if(factor==2 || factor==4)
+		downscaleFunc(src, srcPitch, dst, width, pixelSize, factor);
+	else downscale_C(src, srcPitch, dst, width, pixelSize, factor);
+}
+
+
+void PixelConv::upscale(const unsigned char *src, unsigned char *dst,
+	int width, int pixelSize, int factor)
+{
+	if(maxLevel<0) init();
+	if(width<1 || factor<1) return;
+	if(factor==2 || factor==4) upscaleFunc(src, dst, width, pixelSize, factor);
+	else upscale_C(src, dst, width, pixelSize, factor);
+}
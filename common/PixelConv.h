@@ -0,0 +1,106 @@
+/* Copyright (C)2014 D. R. Commander
+ *
+ * This library is free software and may be redistributed and/or modified under
+ * the terms of the wxWindows Library License, Version 3.1 or (at your option)
+ * any later version.  The full license is in the LICENSE.txt file included
+ * with this distribution.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * wxWindows Library License for more details.
+ */
+
+#ifndef __PIXELCONV_H__
+#define __PIXELCONV_H__
+
+
+namespace vglcommon
+{
+	// Pixel formats of a Frame.  The unused byte in a 4-byte pixel is set to
+	// 0xFF by the kernels below.
+	enum
+	{
+		PF_RGB, PF_RGBX, PF_BGR, PF_BGRX, PF_XBGR, PF_XRGB, PF_NUMFORMATS
+	};
+
+	// SIMD instruction sets for which the kernels below have been optimized
+	enum
+	{
+		SIMD_NONE, SIMD_SSE2, SIMD_SSSE3, SIMD_AVX2, SIMD_NUMLEVELS
+	};
+
+
+	// Row kernels for converting pixels between the formats used by Frames.
+	// The fastest implementation that the CPU supports is selected the first
+	// time that one of the kernels is called.
+	class PixelConv
+	{
+		public:
+
+			// Return the PF_* pixel format corresponding to the given pixel size
+			// and FRAME_* flags, or -1 if there is none
+			static int getFormat(int pixelSize, int flags);
+			static int getPixelSize(int format);
+			static const char *getFormatName(int format);
+
+			// Return the most optimized SIMD level that the CPU supports
+			static int getMaxLevel(void);
+			static int getLevel(void);
+			static const char *getLevelName(int level);
+			// Use the given SIMD level (or lower, if the CPU does not support it)
+			// rather than the most optimized one.  This is mainly for benchmarking.
+			static void setLevel(int level);
+
+			// Convert a row of RGB pixels to the given format
+			static void fromRGB(const unsigned char *src, unsigned char *dst,
+				int width, int dstFormat);
+			// Combine three rows of one-byte pixels into the red, green, and blue
+			// components of a row of pixels in the given format
+			static void packPlanes(const unsigned char *r, const unsigned char *g,
+				const unsigned char *b, unsigned char *dst, int width, int dstFormat);
+			// Copy every other pixel of src into dst.  dst receives width pixels,
+			// so src must contain at least width*2-1 pixels.
+			static void decimate(const unsigned char *src, unsigned char *dst,
+				int width, int pixelSize);
+			// Flip an image upside down in place
+			static void flip(unsigned char *bits, int pitch, int rowSize,
+				int height);
+			// Average each factor x factor block of pixels in the factor rows
+			// starting at src (factor is 2 or 4.)  dst receives width pixels, so
+			// each row of src must contain width*factor pixels.
+			static void downscale(const unsigned char *src, int srcPitch,
+				unsigned char *dst, int width, int pixelSize, int factor);
+			// Copy each pixel of src into factor adjacent pixels of dst (factor is
+			// 2 or 4.)  dst receives width*factor pixels.
+			static void upscale(const unsigned char *src, unsigned char *dst,
+				int width, int pixelSize, int factor);
+
+		private:
+
+			static void init(void);
+
+			typedef void (*FromRGBFunc)(const unsigned char *, unsigned char *,
+				int, int);
+			typedef void (*PackPlanesFunc)(const unsigned char *,
+				const unsigned char *, const unsigned char *, unsigned char *, int,
+				int);
+			typedef void (*DecimateFunc)(const unsigned char *, unsigned char *,
+				int, int);
+			typedef void (*FlipFunc)(unsigned char *, int, int, int);
+			typedef void (*DownscaleFunc)(const unsigned char *, int,
+				unsigned char *, int, int, int);
+			typedef void (*UpscaleFunc)(const unsigned char *, unsigned char *, int,
+				int, int);
+
+			static int level, maxLevel;
+			static FromRGBFunc fromRGBFunc;
+			static PackPlanesFunc packPlanesFunc;
+			static DecimateFunc decimateFunc;
+			static FlipFunc flipFunc;
+			static DownscaleFunc downscaleFunc;
+			static UpscaleFunc upscaleFunc;
+	};
+}
+
+#endif // __PIXELCONV_H__
@@ -103,3 +103,117 @@ void Profiler::endFrame(long pixels, long bytes, double incFrames)
 		totalTime=0.;  mpixels=0.;  frames=0.;  mbytes=0.;  lastFrame=now;
 	}
 }
+
+
+LatencyProfiler::LatencyProfiler(const char *name_, int nStages_,
+	const char **stageNames_, double interval_) : name(name_),
+	stageNames(stageNames_), nStages(nStages_), nSamples(0),
+	interval(interval_), lastReport(0.0), profile(false), file(NULL)
+{
+	char *ev=NULL;
+
+	if(nStages>MAXSTAGES) nStages=MAXSTAGES;
+	if((ev=getenv("VGL_LATENCY"))!=NULL && strlen(ev)>0 && strcmp(ev, "0"))
+	{
+		profile=true;
+		if(strcmp(ev, "1") && (file=fopen(ev, "a"))==NULL)
+			vglout.println("[VGL] WARNING: Could not open latency log %s", ev);
+	}
+}
+
+
+LatencyProfiler::~LatencyProfiler(void)
+{
+	if(file) { fclose(file);  file=NULL; }
+}
+
+
+// Add the latencies (in seconds) of each stage of a single frame
+void LatencyProfiler::addSample(double *stages)
+{
+	if(!profile) return;
+	double now=timer.time();
+
+	for(int i=0; i<nStages; i++)
+		samples[i][nSamples]=(float)(stages[i]>0.0? stages[i]:0.0);
+	nSamples++;
+	if(lastReport==0.0) lastReport=now;
+	if(now-lastReport>interval || nSamples>=MAXSAMPLES) report(now);
+}
+
+
+static int compareFloat(const void *arg1, const void *arg2)
+{
+	float f1=*(float *)arg1, f2=*(float *)arg2;
+	return f1<f2? -1 : (f1>f2? 1:0);
+}
+
+
+void LatencyProfiler::report(double now)
+{
+	char temps[256];
+
+	snprintf(temps, 255,
+		"%-12s- %4d frames:     p50      p90      p99      max (ms)", name,
+		nSamples);
+	if(file) fprintf(file, "%s\n", temps);
+	else vglout.PRINT("%s\n", temps);
+	for(int i=0; i<nStages; i++)
+	{
+		float *s=samples[i];
+		qsort(s, nSamples, sizeof(float), compareFloat);
+		snprintf(temps, 255, "  %-24s %8.2f %8.2f %8.2f %8.2f", stageNames[i],
+			s[(nSamples-1)*50/100]*1000., s[(nSamples-1)*90/100]*1000.,
+			s[(nSamples-1)*99/100]*1000., s[nSamples-1]*1000.);
+		if(file) fprintf(file, "%s\n", temps);
+		else vglout.PRINT("%s\n", temps);
+	}
+	if(file) fflush(file);
+	nSamples=0;  lastReport=now;
+}
+
+
+PoolProfiler::PoolProfiler(const char *name_, double interval_) :
+	name(name_), size(0), interval(interval_), lastReport(0.0), blockTime(0.0),
+	hits(0), waits(0), spoiled(0), profile(false)
+{
+	char *ev=NULL;
+	if((ev=getenv("RRPROFILE"))!=NULL && !strncmp(ev, "1", 1))
+		profile=true;
+	if((ev=getenv("VGL_PROFILE"))!=NULL && !strncmp(ev, "1", 1))
+		profile=true;
+}
+
+
+// Record a buffer request.  blockTime is the time (in seconds) that the
+// application spent waiting for a buffer to be released, or 0 if a free buffer
+// was available.
+void PoolProfiler::addGet(double blockTime_)
+{
+	if(!profile) return;
+	if(blockTime_>0.0) { waits++;  blockTime+=blockTime_; }
+	else hits++;
+	report();
+}
+
+
+void PoolProfiler::addSpoiled(void)
+{
+	if(!profile) return;
+	spoiled++;
+	report();
+}
+
+
+void PoolProfiler::report(void)
+{
+	double now=timer.time();
+	if(lastReport==0.0) lastReport=now;
+	if(now-lastReport>interval && hits+waits>0)
+	{
+		vglout.PRINT("%s  - %d buffers - %7.2f%% hits - %ld waits (%.2f ms blocked)"
+			" - %ld spoiled\n", name, size, (double)hits*100./(double)(hits+waits),
+			waits, blockTime*1000., spoiled);
+		hits=waits=spoiled=0;  blockTime=0.0;  lastReport=now;
+	}
+}
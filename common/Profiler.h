@@ -17,6 +17,7 @@
 #define __PROFILER_H__
 
 #include "Timer.h"
+#include <stdio.h>
 
 
 namespace vglcommon
@@ -41,6 +42,64 @@ namespace vglcommon
 			vglutil::Timer timer;
 			bool freestr;
 	};
+
+
+	// Collects per-stage latency samples and periodically reports the
+	// percentiles of each stage.  If VGL_LATENCY=1, then the reports are
+	// written to the log.  If VGL_LATENCY is set to a file name, then they are
+	// appended to that file.
+	class LatencyProfiler
+	{
+		public:
+
+			static const int MAXSTAGES=8, MAXSAMPLES=1024;
+
+			LatencyProfiler(const char *name, int nStages, const char **stageNames,
+				double interval=2.0);
+			~LatencyProfiler(void);
+			bool isEnabled(void) { return profile; }
+			void addSample(double *stages);
+
+		private:
+
+			void report(double now);
+
+			const char *name, **stageNames;
+			int nStages, nSamples;
+			double interval, lastReport;
+			float samples[MAXSTAGES][MAXSAMPLES];
+			bool profile;
+			FILE *file;
+			vglutil::Timer timer;
+	};
+
+
+	// Counts how often an image transport's frame pool had a free buffer when
+	// the application asked for one, how often (and for how long) the
+	// application had to wait for a buffer to be released, and how many frames
+	// were spoiled.  If profiling is enabled, then these statistics are reported
+	// periodically.
+	class PoolProfiler
+	{
+		public:
+
+			PoolProfiler(const char *name="Pool", double interval=2.0);
+			void setName(const char *name_) { name=name_; }
+			void setSize(int size_) { size=size_; }
+			void addGet(double blockTime);
+			void addSpoiled(void);
+
+		private:
+
+			void report(void);
+
+			const char *name;
+			int size;
+			double interval, lastReport, blockTime;
+			long hits, waits, spoiled;
+			bool profile;
+			vglutil::Timer timer;
+	};
 }
 
 #endif
@@ -19,6 +19,7 @@
 #include "vglutil.h"
 #include "Timer.h"
 #include "bmp.h"
+#include "PixelConv.h"
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -429,7 +430,7 @@ int cmpFrame(unsigned char *buf, int width, int height, Frame &dst,
 	for(int i=0; i<height; i++)
 	{
 		_i=dstbu? i:height-i-1;
-		for(int j=0; j<height; j++)
+		for(int j=0; j<width; j++)
 		{
 			if((buf[pitch*_i+j*3]
 					!= dst.bits[dst.pitch*i+j*ps[dstpf]+roffset[dstpf]]) ||
@@ -444,49 +445,208 @@ int cmpFrame(unsigned char *buf, int width, int height, Frame &dst,
 }
 
 
+// Run statement repeatedly for at least one second, and print the throughput
+#define BENCHMARK(pixels, statement)  \
+{  \
+	double tStart, tTotal=0.;  int benchIter=0;  \
+	do  \
+	{  \
+		tStart=getTime();  \
+		statement;  \
+		tTotal+=getTime()-tStart;  benchIter++;  \
+	} while(tTotal<1.);  \
+	fprintf(stderr, "%f Mpixels/sec - ",  \
+		(double)(pixels)*(double)benchIter/1000000./tTotal);  \
+}
+
+
+// Check that the unused byte of each 4-byte pixel is 0xFF
+int cmpPadding(Frame &dst, BMPPF dstpf)
+{
+	int xoffset=roffset[dstpf]+goffset[dstpf]+boffset[dstpf];
+	xoffset=6-xoffset;
+	if(ps[dstpf]!=4) return 0;
+	for(int i=0; i<dst.hdr.frameh; i++)
+	{
+		for(int j=0; j<dst.hdr.framew; j++)
+		{
+			if(dst.bits[dst.pitch*i+j*4+xoffset]!=0xFF) return 1;
+		}
+	}
+	return 0;
+}
+
+
 void rgbBench(char *filename)
 {
 	unsigned char *buf;  int width, height, dstbu;
-	CompressedFrame src;  Frame dst;  int dstpf;
+	CompressedFrame src;  Frame dst, planes[3], stf, ref;  int dstpf;
+
+	if(bmp_load(filename, &buf, &width, 1, &height, BMPPF_RGB,
+		BMPORN_BOTTOMUP)==-1)
+		throw(bmp_geterr());
+	rrframeheader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.x=hdr.y=0;
+	hdr.width=hdr.framew=width;
+	hdr.height=hdr.frameh=height;
+	hdr.compress=RRCOMP_RGB;  hdr.flags=0;  hdr.size=width*3*height;
+	src.init(hdr, hdr.flags);
+	memcpy(src.bits, buf, width*3*height);
+	hdr.size=0;
+	for(int i=0; i<3; i++)
+	{
+		planes[i].init(hdr, 1, 0);
+		for(int j=0; j<width*height; j++) planes[i].bits[j]=buf[j*3+i];
+	}
 
-	for(dstpf=0; dstpf<BMP_NUMPF; dstpf++)
+	for(int level=SIMD_NONE; level<=PixelConv::getMaxLevel(); level++)
 	{
-		int dstflags=flags[dstpf];
-		for(dstbu=0; dstbu<2; dstbu++)
+		PixelConv::setLevel(level);
+		fprintf(stderr, "SIMD: %s\n\n", PixelConv::getLevelName(level));
+
+		// Frame::decompressRGB() -> PixelConv::fromRGB()
+		for(dstpf=0; dstpf<BMP_NUMPF; dstpf++)
 		{
-			if(dstbu) dstflags|=FRAME_BOTTOMUP;
-			if(bmp_load(filename, &buf, &width, 1, &height, BMPPF_RGB,
-				BMPORN_BOTTOMUP)==-1)
-				throw(bmp_geterr());
-			rrframeheader hdr;
-			memset(&hdr, 0, sizeof(hdr));
-			hdr.x=hdr.y=0;
-			hdr.width=hdr.framew=width;
-			hdr.height=hdr.frameh=height;
-			hdr.compress=RRCOMP_RGB;  hdr.flags=0;  hdr.size=width*3*height;
-			src.init(hdr, hdr.flags);
-			memcpy(src.bits, buf, width*3*height);
-			dst.init(hdr, ps[dstpf], dstflags);
-			memset(dst.bits, 0, dst.pitch*dst.hdr.frameh);
-			fprintf(stderr, "RGB (BOTTOM-UP) -> %s (%s)\n", formatName[dstpf],
-				dstbu? "BOTTOM-UP":"TOP-DOWN");
-			double tStart, tTotal=0.;  int iter=0;
-			do
+			int dstflags=flags[dstpf];
+			for(dstbu=0; dstbu<2; dstbu++)
 			{
-				tStart=getTime();
-				dst.decompressRGB(src, width, height, false);
-				tTotal+=getTime()-tStart;  iter++;
-			} while(tTotal<1.);
-			fprintf(stderr, "%f Mpixels/sec - ", (double)width*(double)height
-				*(double)iter/1000000./tTotal);
-			if(cmpFrame(buf, width, height, dst, (BMPPF)dstpf))
+				if(dstbu) dstflags|=FRAME_BOTTOMUP;
+				dst.init(hdr, ps[dstpf], dstflags);
+				memset(dst.bits, 0, dst.pitch*dst.hdr.frameh);
+				fprintf(stderr, "RGB (BOTTOM-UP) -> %s (%s)\n", formatName[dstpf],
+					dstbu? "BOTTOM-UP":"TOP-DOWN");
+				BENCHMARK(width*height, dst.decompressRGB(src, width, height, false));
+				if(cmpFrame(buf, width, height, dst, (BMPPF)dstpf)
+					|| cmpPadding(dst, (BMPPF)dstpf))
+					fprintf(stderr, "FAILED!\n");
+				else fprintf(stderr, "Passed.\n");
+			}
+		}
+		fprintf(stderr, "\n");
+
+		// Frame::makeAnaglyph() -> PixelConv::packPlanes()
+		for(dstpf=0; dstpf<BMP_NUMPF; dstpf++)
+		{
+			dst.init(hdr, ps[dstpf], flags[dstpf]|FRAME_BOTTOMUP);
+			memset(dst.bits, 0, dst.pitch*dst.hdr.frameh);
+			fprintf(stderr, "Anaglyph -> %s\n", formatName[dstpf]);
+			BENCHMARK(width*height, dst.makeAnaglyph(planes[0], planes[1],
+				planes[2]));
+			if(cmpFrame(buf, width, height, dst, (BMPPF)dstpf)
+				|| cmpPadding(dst, (BMPPF)dstpf))
 				fprintf(stderr, "FAILED!\n");
 			else fprintf(stderr, "Passed.\n");
-			free(buf);
 		}
 		fprintf(stderr, "\n");
-	}
 
+		// Frame::makePassive() -> PixelConv::decimate()
+		for(dstpf=0; dstpf<BMP_NUMPF; dstpf++)
+		{
+			stf.init(hdr, ps[dstpf], flags[dstpf], true);
+			dst.init(hdr, ps[dstpf], flags[dstpf]);
+			for(int i=0; i<stf.pitch*height; i++)
+			{
+				stf.bits[i]=buf[i%(width*3*height)];  stf.rbits[i]=~stf.bits[i];
+			}
+			memset(dst.bits, 0, dst.pitch*dst.hdr.frameh);
+			fprintf(stderr, "Side-by-side stereo (%s)\n", formatName[dstpf]);
+			BENCHMARK(width*height, dst.makePassive(stf, RRSTEREO_SIDEBYSIDE));
+			bool failed=false;  int leftWidth=(width+1)/2;
+			for(int i=0; i<height && !failed; i++)
+			{
+				for(int j=0; j<width; j++)
+				{
+					unsigned char *srcPixel=j<leftWidth?
+						&stf.bits[stf.pitch*i+j*2*ps[dstpf]]:
+						&stf.rbits[stf.pitch*i+((j-leftWidth)*2+1)*ps[dstpf]];
+					if(memcmp(&dst.bits[dst.pitch*i+j*ps[dstpf]], srcPixel,
+						ps[dstpf])) { failed=true;  break; }
+				}
+			}
+			fprintf(stderr, failed? "FAILED!\n":"Passed.\n");
+		}
+		fprintf(stderr, "\n");
+
+		// PixelConv::flip()
+		for(dstpf=0; dstpf<BMP_NUMPF; dstpf++)
+		{
+			dst.init(hdr, ps[dstpf], flags[dstpf]);
+			ref.init(hdr, ps[dstpf], flags[dstpf]);
+			for(int i=0; i<dst.pitch*height; i++)
+				dst.bits[i]=ref.bits[i]=buf[i%(width*3*height)];
+			fprintf(stderr, "Vertical flip (%s)\n", formatName[dstpf]);
+			int flips=0;
+			BENCHMARK(width*height, PixelConv::flip(dst.bits, dst.pitch,
+				width*ps[dstpf], height);  flips++);
+			bool failed=false;
+			for(int i=0; i<height; i++)
+			{
+				int refRow=(flips%2)? height-i-1:i;
+				if(memcmp(&dst.bits[dst.pitch*i], &ref.bits[ref.pitch*refRow],
+					width*ps[dstpf])) { failed=true;  break; }
+			}
+			fprintf(stderr, failed? "FAILED!\n":"Passed.\n");
+		}
+		fprintf(stderr, "\n");
+
+		// PixelConv::downscale() and PixelConv::upscale()
+		for(int factor=2; factor<=4; factor+=2)
+		{
+			rrframeheader shdr=hdr;
+			shdr.width=shdr.framew=width/factor;
+			shdr.height=shdr.frameh=height/factor;
+			int sw=shdr.framew, sh=shdr.frameh;
+			for(dstpf=0; dstpf<BMP_NUMPF && sw>0 && sh>0; dstpf++)
+			{
+				int pixelSize=ps[dstpf];
+				ref.init(hdr, pixelSize, flags[dstpf]);
+				for(int i=0; i<ref.pitch*height; i++)
+					ref.bits[i]=buf[i%(width*3*height)];
+				dst.init(shdr, pixelSize, flags[dstpf]);
+				fprintf(stderr, "%dx box filter (%s)\n", factor, formatName[dstpf]);
+				BENCHMARK(width*height, for(int i=0; i<sh; i++)
+					PixelConv::downscale(&ref.bits[ref.pitch*i*factor], ref.pitch,
+						&dst.bits[dst.pitch*i], sw, pixelSize, factor));
+				bool failed=false;
+				for(int i=0; i<sh && !failed; i++)
+				{
+					for(int j=0; j<sw*pixelSize; j++)
+					{
+						int sum=0, n=factor*factor;
+						for(int y=0; y<factor; y++)
+							for(int x=0; x<factor; x++)
+								sum+=ref.bits[ref.pitch*(i*factor+y)+j/pixelSize*factor
+									*pixelSize+x*pixelSize+j%pixelSize];
+						if(dst.bits[dst.pitch*i+j]!=(sum+n/2)/n)
+						{
+							failed=true;  break;
+						}
+					}
+				}
+				fprintf(stderr, failed? "FAILED!\n":"Passed.\n");
+
+				fprintf(stderr, "%dx pixel replication (%s)\n", factor,
+					formatName[dstpf]);
+				BENCHMARK(sw*sh*factor*factor, for(int i=0; i<sh*factor; i++)
+					PixelConv::upscale(&dst.bits[dst.pitch*(i/factor)],
+						&ref.bits[ref.pitch*i], sw, pixelSize, factor));
+				failed=false;
+				for(int i=0; i<sh*factor && !failed; i++)
+				{
+					for(int j=0; j<sw*factor; j++)
+					{
+						if(memcmp(&ref.bits[ref.pitch*i+j*pixelSize],
+							&dst.bits[dst.pitch*(i/factor)+j/factor*pixelSize],
+							pixelSize)) { failed=true;  break; }
+					}
+				}
+				fprintf(stderr, failed? "FAILED!\n":"Passed.\n");
+			}
+		}
+		fprintf(stderr, "\n");
+	}
+	free(buf);
 }
 
 
@@ -497,7 +657,9 @@ void usage(char *programName)
 	fprintf(stderr, "-gl = Use OpenGL instead of X11 for blitting\n");
 	fprintf(stderr, "-xv = Test X Video encoding/display\n");
 	fprintf(stderr, "-rgb = Use RGB encoding instead of JPEG compression\n");
-	fprintf(stderr, "-rgbbench <filename> = Benchmark the decoding of RGB-encoded images.\n");
+	fprintf(stderr, "-rgbbench <filename> = Benchmark the pixel format conversion kernels,\n");
+	fprintf(stderr, "                       including the decoding of RGB-encoded images,\n");
+	fprintf(stderr, "                       using each SIMD instruction set that the CPU supports.\n");
 	fprintf(stderr, "                       <filename> should be a BMP or PPM file.\n\n");
 	exit(1);
 }
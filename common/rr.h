@@ -16,7 +16,7 @@
 #ifndef __RR_H
 #define __RR_H
 
-#define RR_MAJOR_VERSION 2
+#define RR_MAJOR_VERSION 3
 #define RR_MINOR_VERSION 1
 
 // Argh!
@@ -57,6 +57,140 @@ typedef struct _rrversion
 } rrversion;
 #define sizeof_rrversion 5
 
+/* Acknowledgment sent from the client to the server after the client has
+   displayed a frame (protocol v2.2 and later, non-SSL connections only) */
+typedef struct _rrframeack
+{
+  unsigned int winid;      /* The window ID from the frame's header */
+  unsigned short dpynum;   /* The display number from the frame's header */
+} rrframeack;
+#define sizeof_rrframeack 6
+
+/* Shared memory ring offered by the server to the client after the version
+   exchange (protocol v2.3 and later, non-SSL connections only.)  If size is 0,
+   then the server is not offering a ring.  Otherwise, the server is listening
+   on an abstract Unix domain socket, whose name (without the leading NUL) is
+   given by name.  When the client connects to it, the server passes it a file
+   descriptor for the ring (SCM_RIGHTS), and the client verifies that it has
+   mapped the right ring by comparing the cookie with the first 8 bytes of the
+   ring.  The client replies with a single byte (1 if it accepted the ring, 0
+   otherwise.)  If the ring was accepted, then each non-EOF frame header is
+   followed by a 32-bit offset into the ring (relative to RR_SHMHDRSIZE) rather
+   than by the tile payload.  An offset of RR_SHMINLINE means that the payload
+   follows on the connection as usual. */
+typedef struct _rrshminfo
+{
+  unsigned int size;        /* Size of the ring, not including the header */
+  unsigned int cookie[2];
+  char name[12];            /* NUL-padded */
+} rrshminfo;
+#define sizeof_rrshminfo 24
+#define RR_SHMHDRSIZE 64
+#define RR_SHMINLINE 0xFFFFFFFF
+
+/* Offer of additional connections ("streams") over which the server will
+   stripe its tiles, sent by the server after the shared memory offer (protocol
+   v2.4 and later, non-SSL connections only.)  The client replies with a single
+   byte containing the number of streams it accepts (1 if it does not support
+   striping.)  The server then opens streams-1 additional connections, each of
+   which begins with a v1 header in which flags=RR_JOIN, winid=token, and x is
+   the stream index.  When striping is in use, each frame's tiles are
+   distributed among the streams, each non-EOF frame header is followed by the
+   32-bit sequence number of the frame (the number of EOF headers previously
+   sent on the same stream), and every stream carries the EOF header for every
+   frame.  The client must not display a frame until it has received the EOF
+   header from all of the streams. */
+typedef struct _rrstripeinfo
+{
+  unsigned int token;
+  unsigned char streams;
+} rrstripeinfo;
+#define sizeof_rrstripeinfo 5
+#define RR_MAXSTREAMS 16
+
+/* Latency measurement (protocol v2.5 and later, non-SSL connections only.)
+   All times are the low 32 bits of a monotonic microsecond clock, so only
+   differences between them are meaningful.  When the client receives the
+   server's version, it immediately sends its current time, which the server
+   uses to estimate the offset between the two clocks.  Each EOF header on the
+   main connection is followed by an rrframestamp, and each rrframeack is
+   followed by an rrframetimes structure that echoes the stamp along with the
+   times (in the client's clock) at which the client received the EOF header,
+   finished decoding the frame, and finished drawing it. */
+typedef struct _rrframestamp
+{
+  unsigned int seq;        /* Sequence number of the frame within its window */
+  unsigned int time;       /* Server time at which readback began */
+} rrframestamp;
+#define sizeof_rrframestamp 8
+
+typedef struct _rrframetimes
+{
+  rrframestamp stamp;
+  unsigned int recvTime;
+  unsigned int decodeTime;
+  unsigned int drawTime;
+} rrframetimes;
+#define sizeof_rrframetimes 20
+
+/* Compact framing (protocol v3.0 and later.)  Rather than sending a full
+   frame header with each tile, the server sends the properties that are
+   constant within a frame once per frame on each stream, and each tile is
+   described by a short record.  Each record begins with a tag byte:
+   RR3_FRAME = begins a frame on this stream and is followed by an rrframeinfo
+               structure.  seq replaces the sequence number that follows each
+               frame header when striping is in use (see rrstripeinfo.)
+   RR3_EOF   = ends the frame and replaces the EOF header.  On the main
+               connection, it is followed by an rrframestamp if latency stamps
+               are in use.
+   RR3_SCALE = follows the frame record (protocol v3.1 and later) if the server
+               scaled the frame down before sending it, and is followed by a
+               single byte containing the scaling factor (2 or 4.)  framew,
+               frameh, and the tile records describe the scaled-down frame, and
+               the client scales it back up by the same factor when drawing it.
+   otherwise = a tile.  Bits 5-6 of the tag contain the tile's flags (0,
+               RR_LEFT, or RR_RIGHT), and bits 0-4 contain the length of the
+               tile record that follows.  The tile record contains the x, y,
+               width, height, and size of the tile and (if the shared memory
+               ring is in use) the offset of the payload in the ring plus 1 (0
+               means that the payload follows inline), each encoded as a
+               varint (7 bits per byte, least significant bits first, with the
+               high bit set in all but the last byte.)  The payload, if sent
+               inline, follows the tile record. */
+typedef struct _rrframeinfo
+{
+  unsigned int winid;
+  unsigned int seq;
+  unsigned short framew;
+  unsigned short frameh;
+  unsigned short dpynum;
+  unsigned char qual;
+  unsigned char subsamp;
+  unsigned char compress;
+} rrframeinfo;
+#define sizeof_rrframeinfo 17
+#define RR3_FRAME 0x80
+#define RR3_EOF 0x81
+#define RR3_SCALE 0x82
+#define RR3_MAXTILERECORD 31
+
+/* Record in a VGL Transport capture file (see VGL_CAPTURE.)  A capture file
+   begins with RR_CAPSIGNATURE, a format version byte, and the capture type.
+   Each record is followed by a frame header and by either the tile payload,
+   exactly as it was sent to the client (tile captures), or the uncompressed
+   pixels of the frame with no row padding (frame captures.)  All values are
+   little-endian. */
+typedef struct _rrcaprecord
+{
+  unsigned int time;        /* Microseconds since the capture began */
+  unsigned char pixelSize;  /* Bytes per pixel (frame captures only) */
+  unsigned char flags;      /* Frame flags (frame captures only) */
+} rrcaprecord;
+#define sizeof_rrcaprecord 6
+#define RR_CAPSIGNATURE "VGLCAP"
+#define RR_CAPVERSION 1
+enum rrcaptype {RRCAP_TILES=0, RRCAP_FRAMES};
+
 // Header from version 1 of the VirtualGL protocol (used to communicate with
 // older clients
 typedef struct _rrframeheader_v1
@@ -87,7 +221,9 @@ enum {
   RR_EOF=1, /* this tile is an End-of-Frame marker and contains no real
                image data */
   RR_LEFT,  /* this tile goes to the left buffer of a stereo frame */
-  RR_RIGHT  /* this tile goes to the right buffer of a stereo frame */
+  RR_RIGHT, /* this tile goes to the right buffer of a stereo frame */
+  RR_JOIN   /* this connection is an additional stream belonging to an
+               existing connection (see rrstripeinfo) */
 };
 
 /* Transport types */
@@ -141,6 +277,9 @@ enum rrdrawable {RRDRAWABLE_PBUFFER=0, RRDRAWABLE_PIXMAP};
 #endif
 #define RR_DEFAULTTILESIZE    256
 
+/* Maximum number of frame buffers in each image transport's pool */
+#define RR_MAXPOOLSIZE 16
+
 /* Maximum CPUs that be can be used for parallel image compression */
 /* (the algorithms don't scale beyond 3) */
 #define MAXPROCS 4
@@ -202,6 +341,14 @@ typedef struct _FakerConfig
   char xcbkeysymslib[MAXSTR];
   char xcbx11lib[MAXSTR];
   char excludeddpys[MAXSTR];
+  char zerocopy;
+  int credits;
+  char shm;
+  int streams;
+  char capture[MAXSTR];
+  char captureframes[MAXSTR];
+  int poolsize;
+  int downscale;
 } FakerConfig;
 
 #if !defined(__SUNPRO_CC) && !defined(__SUNPRO_C)
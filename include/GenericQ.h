@@ -32,7 +32,7 @@ namespace vglutil
 			GenericQ(void);
 			~GenericQ(void);
 			void add(void *item);
-			void spoil(void *item, SpoilCallback spoilCallback);
+			int spoil(void *item, SpoilCallback spoilCallback);
 			void get(void **item, bool nonBlocking=false);
 			void release(void);
 			int items(void);
@@ -33,6 +33,7 @@ namespace vglutil
 			Event(void);
 			~Event(void);
 			void wait(void);
+			bool wait(double timeout);
 			void signal(void);
 			bool isLocked(void);
 
@@ -26,10 +26,27 @@
 #if defined(sun) || defined(sgi)
 #include <openssl/rand.h>
 #endif
+// Kernel TLS offload (OpenSSL 3.0 and later, Linux or FreeBSD)
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define USEKTLS
+#endif
 #endif
 
 #include "Error.h"
 #include "Mutex.h"
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <sys/socket.h>
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define USEZEROCOPY
+#endif
+#else
+// Scatter/gather element (compatible with the POSIX definition)
+struct iovec
+{
+	void *iov_base;  size_t iov_len;
+};
+#endif
 
 
 namespace vglutil
@@ -151,15 +168,39 @@ namespace vglutil
 			unsigned short listen(unsigned short port, bool reuseAddr=false);
 			Socket *accept(void);
 			void send(char *buf, int len);
+			// Send the contents of multiple buffers using as few system calls as
+			// possible.  The contents of iov may be modified.
+			void send(struct iovec *iov, int count);
 			void recv(char *buf, int len);
+			#ifndef _WIN32
+			// Receive up to len bytes without blocking (not supported with SSL.)
+			// Returns the number of bytes received, or 0 if no data is available.
+			int tryRecv(char *buf, int len);
+			#endif
+			SOCKET getSocket(void) { return sd; }
 			char *remoteName(void);
 
+			// Zero-copy transmission (Linux MSG_ZEROCOPY.)  Buffers passed to
+			// sendZeroCopy() must not be modified or freed until
+			// zeroCopyComplete() returns true for the ID that sendZeroCopy()
+			// returned.
+			bool setZeroCopy(bool enable);
+			bool isZeroCopy(void) { return zeroCopy; }
+			unsigned int sendZeroCopy(char *buf, int len);
+			bool zeroCopyComplete(unsigned int id, bool wait=false);
+
 		private:
 
 			unsigned short setupListener(unsigned short port, bool reuseAddr);
+			#ifdef USESSL
+			void sslFlush(void);
+			void checkKTLS(void);
+			#endif
 
 			#ifdef USESSL
 
+			// OpenSSL 1.1.0 and later handle their own locking.
+			#if OPENSSL_VERSION_NUMBER<0x10100000L
 			static void lockingCallback(int mode, int type, const char *file,
 				int line)
 			{
@@ -167,9 +208,17 @@ namespace vglutil
 				else cryptoLock[type].unlock();
 			}
 
-			static bool sslInit;
 			static CriticalSection cryptoLock[CRYPTO_NUM_LOCKS];
+			#endif
+			static bool sslInit;
 			bool doSSL;  SSL_CTX *sslctx;  SSL *ssl;
+			// If the kernel is encrypting outgoing data, then send() bypasses
+			// OpenSSL.
+			bool ktlsSend, ktlsRecv;
+
+			// Small buffers are coalesced into a single SSL record
+			static const int SSLBUFSIZE=16384;
+			char *sslBuf;  int sslBufBytes;
 
 			#endif
 
@@ -177,6 +226,15 @@ namespace vglutil
 			static int instanceCount;
 			static CriticalSection mutex;
 			SOCKET sd;
+
+			void readZeroCopyCompletions(bool wait);
+			bool zeroCopy;
+			// All zero-copy sends with an ID less than zcDone have completed.
+			// Completions that arrive out of order are stored in zcRanges until
+			// the gap is filled.
+			static const int MAXZCRANGES=64;
+			unsigned int zcNext, zcDone;
+			unsigned int zcRanges[MAXZCRANGES][2];  int nzcRanges;
 	};
 }
 
@@ -20,6 +20,7 @@
 #include <windows.h>
 #else
 #include <sys/time.h>
+#include <time.h>
 #endif
 #include <stdlib.h>
 
@@ -77,6 +78,21 @@ namespace vglutil
 				return time()-t1;
 			}
 
+			// Low 32 bits of a monotonic time in microseconds, for timestamps that
+			// are only compared with each other.  Unlike time(), this is not
+			// affected by changes to the system clock (on Windows, time() is
+			// already monotonic.)
+			unsigned int usec(void)
+			{
+				#if !defined(_WIN32) && defined(CLOCK_MONOTONIC)
+				struct timespec ts;
+				if(clock_gettime(CLOCK_MONOTONIC, &ts)==0)
+					return (unsigned int)((unsigned long long)ts.tv_sec*1000000ULL
+						+(unsigned long long)(ts.tv_nsec/1000));
+				#endif
+				return (unsigned int)(long long)(time()*1000000.);
+			}
+
 		private:
 
 			#ifdef _WIN32
@@ -84,12 +84,20 @@ typedef struct _fbx_struct
 	HDC hmdc;  HBITMAP hdib;
 	#else
 	#ifdef USESHM
-	XShmSegmentInfo shminfo;  int xattach;
+	XShmSegmentInfo shminfo;  int xattach, shmCompletion;
+	/* Allocated size of the shared memory segment and whether it is a memfd
+	   mapping (which is freed with munmap()) rather than a SysV segment */
+	size_t shmSize;  int memfd;
 	#endif
 	GC xgc;
 	XImage *xi;
 	Pixmap pm;
 	int pixmap;
+	int pending;  unsigned long serial;
+	/* XCB connection, GC, and sequence number of the request used to detect
+	   write completion (used only by the XCB backend) */
+	void *conn;  unsigned int xcbgc, sequence;
+	int xcb;
 	#endif
 } fbx_struct;
 
@@ -119,9 +127,20 @@ extern "C" {
   useShm = Use MIT-SHM extension, if available (Unix only.)
 
   NOTES:
+  -- If FBX was built with XCB support and the FBX_USEXCB environment variable
+     is set to 1, then shared memory buffers are created and drawn using XCB
+     rather than Xlib.  This avoids the Xlib display lock and uses fewer round
+     trips to the X server.  If the X server supports MIT-SHM v1.2 and is
+     connected via a Unix domain socket, then the XCB backend allocates the
+     shared memory using memfd_create() and passes its file descriptor to the
+     X server rather than using a SysV shared memory segment.  Setting the
+     FBX_HUGEPAGES environment variable to 1 causes it to try backing the
+     buffer with huge pages first.
   -- fbx_init() is idempotent.  If you call it multiple times, it will
      re-initialize the buffer only when it is necessary to do so (such as when
-     the window size has changed.)
+     the window size has changed.)  Shared memory segments are allocated with
+     some extra space, so a buffer that grows or shrinks only slightly reuses
+     the existing segment rather than allocating and attaching a new one.
   -- On Windows, fbx_init() will return a buffer configured with the same pixel
      format as the screen, unless the screen depth is < 24 bits, in which case
      it will always return a 32-bit BGRA buffer.
@@ -188,7 +207,8 @@ int fbx_write (fbx_struct *fb, int srcX, int srcY, int dstX, int dstY,
    int height)
 
   Same as fbx_write, but asynchronous.  The write isn't guaranteed to complete
-  until fbx_sync() is called.  On Windows, fbx_awrite is the same as fbx_write.
+  until fbx_sync() or fbx_wait() is called.  On Windows, fbx_awrite is the same
+  as fbx_write.
 */
 #ifdef _WIN32
 #define fbx_awrite fbx_write
@@ -198,6 +218,24 @@ int fbx_awrite (fbx_struct *fb, int srcX, int srcY, int dstX, int dstY,
 #endif
 
 
+/*
+  fbx_flush
+  (fbx_struct *fb, int srcX, int srcY, int dstX, int dstY, int width,
+   int height)
+
+  Same as fbx_write, but returns as soon as the blit has been sent to the X
+  server rather than waiting for the X server to complete it.  fbx_wait() must
+  be called before fb->bits is modified again or before another connection
+  draws into the same window.  On Windows, fbx_flush is the same as fbx_write.
+*/
+#ifdef _WIN32
+#define fbx_flush fbx_write
+#else
+int fbx_flush (fbx_struct *fb, int srcX, int srcY, int dstX, int dstY,
+	int width, int height);
+#endif
+
+
 /*
   fbx_flip
   (fbx_struct *fb, int srcX, int srcY, int width, int height)
@@ -227,6 +265,22 @@ int fbx_flip(fbx_struct *fb, int srcX, int srcY, int width, int height);
 int fbx_sync (fbx_struct *fb);
 
 
+/*
+  fbx_wait
+  (fbx_struct *fb)
+
+  Wait for the X server to complete the last write that was issued by
+  fbx_flush() or fbx_awrite().  This uses the completion events generated by
+  the X server, so it does not require a round trip if the write has already
+  completed.  On Windows, this does nothing.
+*/
+#ifdef _WIN32
+#define fbx_wait(fb) 0
+#else
+int fbx_wait (fbx_struct *fb);
+#endif
+
+
 /*
   fbx_term
   (fbx_struct *fb)
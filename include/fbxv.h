@@ -43,10 +43,11 @@ typedef struct _fbxv_struct
 	Display *dpy;  Window win;
 	int shm, reqwidth, reqheight, port, doexpose;
 	#ifdef USESHM
-	XShmSegmentInfo shminfo;  int xattach;
+	XShmSegmentInfo shminfo;  int xattach, shmCompletion;
 	#endif
 	GC xgc;
 	XvImage *xvi;
+	int pending;  unsigned long serial;
 } fbxv_struct;
 
 
@@ -106,6 +107,25 @@ int fbxv_write (fbxv_struct *fb, int srcX, int srcY, int srcWidth,
 	int srcHeight, int dstX, int dstY, int dstWidth, int dstHeight);
 
 
+/*
+  Same as fbxv_write, but returns as soon as the image has been sent to the X
+  server rather than waiting for the X server to draw it.  fbxv_wait() must be
+  called before fb->xvi->data is modified again or before another connection
+  draws into the same window.
+*/
+int fbxv_flush (fbxv_struct *fb, int srcX, int srcY, int srcWidth,
+	int srcHeight, int dstX, int dstY, int dstWidth, int dstHeight);
+
+
+/*
+  Wait for the X server to finish drawing the image that was sent by
+  fbxv_flush().  If the image is in shared memory, then this uses the
+  completion event generated by the X server, so it does not require a round
+  trip if the image has already been drawn.
+*/
+int fbxv_wait (fbxv_struct *fb);
+
+
 /*
   Frees the X Video image associated with fb (if any), then frees the memory
   used by fb.
@@ -0,0 +1,233 @@
+/* Copyright (C)2014 D. R. Commander
+ *
+ * This library is free software and may be redistributed and/or modified under
+ * the terms of the wxWindows Library License, Version 3.1 or (at your option)
+ * any later version.  The full license is in the LICENSE.txt file included
+ * with this distribution.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * wxWindows Library License for more details.
+ */
+
+#include "Capture.h"
+#include "Error.h"
+#include "vglutil.h"
+#include "Log.h"
+#include <string.h>
+#include <errno.h>
+
+using namespace vglutil;
+using namespace vglcommon;
+using namespace vglserver;
+
+
+#define ENDIANIZE(h) { \
+	if(!littleendian()) {  \
+		h.size=byteswap(h.size);  \
+		h.winid=byteswap(h.winid);  \
+		h.framew=byteswap16(h.framew);  \
+		h.frameh=byteswap16(h.frameh);  \
+		h.width=byteswap16(h.width);  \
+		h.height=byteswap16(h.height);  \
+		h.x=byteswap16(h.x);  \
+		h.y=byteswap16(h.y);  \
+		h.dpynum=byteswap16(h.dpynum);  \
+	}  \
+}
+
+
+Capture *Capture::captureList=NULL;
+CriticalSection Capture::captureMutex;
+
+
+// Return the capture for the given file, creating the file if no other window
+// is capturing to it.
+Capture *Capture::attach(char *fileName, int type)
+{
+	CriticalSection::SafeLock l(captureMutex);
+	Capture *capture;
+
+	if(!fileName || strlen(fileName)<1 || (type!=RRCAP_TILES
+		&& type!=RRCAP_FRAMES))
+		_throw("Invalid argument");
+	for(capture=captureList; capture; capture=capture->next)
+	{
+		if(!strcmp(capture->fileName, fileName))
+		{
+			if(capture->type!=type)
+				_throw("File is already being used for a different type of capture");
+			capture->refCount++;
+			return capture;
+		}
+	}
+
+	_newcheck(capture=new Capture(type));
+	try
+	{
+		capture->open(fileName);
+	}
+	catch(...)
+	{
+		delete capture;  throw;
+	}
+	capture->next=captureList;  captureList=capture;
+	return capture;
+}
+
+
+void Capture::detach(void)
+{
+	CriticalSection::SafeLock l(captureMutex);
+
+	if(--refCount>0) return;
+	for(Capture **ptr=&captureList; *ptr; ptr=&(*ptr)->next)
+	{
+		if(*ptr==this) { *ptr=next;  break; }
+	}
+	delete this;
+}
+
+
+Capture::Capture(int type_) : file(NULL), fileName(NULL), type(type_),
+	refCount(1), start(0.), next(NULL)
+{
+}
+
+
+Capture::~Capture(void)
+{
+	if(file) { fclose(file);  file=NULL; }
+	if(fileName) { free(fileName);  fileName=NULL; }
+}
+
+
+void Capture::open(char *fileName_)
+{
+	unsigned char sig[8];
+
+	_newcheck(fileName=strdup(fileName_));
+	if((file=fopen(fileName, "wb"))==NULL)
+		throw(Error("Capture::open()", strerror(errno)));
+	memcpy(sig, RR_CAPSIGNATURE, 6);
+	sig[6]=RR_CAPVERSION;  sig[7]=type;
+	write(sig, 8);
+	start=timer.time();
+	vglout.println("[VGL] Capturing %s to %s",
+		type==RRCAP_TILES? "compressed tiles":"uncompressed frames", fileName);
+}
+
+
+// A capture that fails (because the disk is full, for instance) is abandoned,
+// but the application keeps running.  The caller must hold the capture mutex.
+void Capture::write(void *buf, size_t len)
+{
+	if(!file || len<1) return;
+	if(fwrite(buf, len, 1, file)!=1)
+	{
+		vglout.println("[VGL] ERROR: Could not write to %s.  Capture stopped.",
+			fileName);
+		fclose(file);  file=NULL;
+	}
+}
+
+
+void Capture::writeRecord(rrframeheader &h, int pixelSize, int flags)
+{
+	rrcaprecord rec;  rrframeheader hdr=h;
+
+	rec.time=(unsigned int)((timer.time()-start)*1000000.);
+	rec.pixelSize=pixelSize;  rec.flags=flags;
+	if(!littleendian()) rec.time=byteswap(rec.time);
+	ENDIANIZE(hdr);
+	write(&rec, sizeof_rrcaprecord);
+	write(&hdr, sizeof_rrframeheader);
+}
+
+
+// Record a tile or EOF header and its payload, exactly as they were sent to
+// the client
+void Capture::writeTile(rrframeheader &h, unsigned char *bits)
+{
+	CriticalSection::SafeLock l(mutex);
+
+	if(!file) return;
+	writeRecord(h, 0, 0);
+	if(h.flags!=RR_EOF && bits) write(bits, h.size);
+}
+
+
+// Record an uncompressed frame.  Only the left eye of a stereo frame is
+// recorded.
+void Capture::writeFrame(Frame *f)
+{
+	CriticalSection::SafeLock l(mutex);
+
+	if(!file || !f || !f->bits) return;
+	rrframeheader h=f->hdr;
+	h.size=h.width*h.height*f->pixelSize;
+	writeRecord(h, f->pixelSize, f->flags);
+	for(int i=0; i<h.height; i++)
+		write(&f->bits[f->pitch*i], h.width*f->pixelSize);
+}
+
+
+CaptureReader::CaptureReader(char *fileName) : file(NULL), type(-1),
+	buf(NULL), bufSize(0)
+{
+	unsigned char sig[8];
+
+	if(!fileName) _throw("Invalid argument");
+	if((file=fopen(fileName, "rb"))==NULL)
+		throw(Error("CaptureReader::CaptureReader()", strerror(errno)));
+	if(fread(sig, 8, 1, file)!=1 || memcmp(sig, RR_CAPSIGNATURE, 6))
+	{
+		fclose(file);  file=NULL;
+		_throw("Not a VirtualGL capture file");
+	}
+	if(sig[6]!=RR_CAPVERSION || (sig[7]!=RRCAP_TILES && sig[7]!=RRCAP_FRAMES))
+	{
+		fclose(file);  file=NULL;
+		_throw("Unsupported capture file version");
+	}
+	type=sig[7];
+}
+
+
+CaptureReader::~CaptureReader(void)
+{
+	if(file) { fclose(file);  file=NULL; }
+	if(buf) { free(buf);  buf=NULL; }
+}
+
+
+// Read the next record.  data points to an internal buffer, which is valid
+// until the next call.  Returns false at the end of the file.
+bool CaptureReader::read(rrcaprecord &rec, rrframeheader &h,
+	unsigned char **data, unsigned int &size)
+{
+	if(!file || !data) _throw("Invalid argument");
+	if(fread(&rec, sizeof_rrcaprecord, 1, file)!=1) return false;
+	if(fread(&h, sizeof_rrframeheader, 1, file)!=1)
+		_throw("Truncated capture file");
+	if(!littleendian()) rec.time=byteswap(rec.time);
+	ENDIANIZE(h);
+	size=(type==RRCAP_TILES && h.flags==RR_EOF)? 0:h.size;
+	if(size>bufSize)
+	{
+		unsigned char *newBuf=(unsigned char *)realloc(buf, size);
+		if(!newBuf) _throw("Memory allocation error");
+		buf=newBuf;  bufSize=size;
+	}
+	if(size>0 && fread(buf, size, 1, file)!=1)
+		_throw("Truncated capture file");
+	*data=buf;
+	return true;
+}
+
+
+void CaptureReader::rewind(void)
+{
+	if(file) fseek(file, 8, SEEK_SET);
+}
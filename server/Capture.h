@@ -0,0 +1,76 @@
+/* Copyright (C)2014 D. R. Commander
+ *
+ * This library is free software and may be redistributed and/or modified under
+ * the terms of the wxWindows Library License, Version 3.1 or (at your option)
+ * any later version.  The full license is in the LICENSE.txt file included
+ * with this distribution.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * wxWindows Library License for more details.
+ */
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdio.h>
+#include "rr.h"
+#include "Frame.h"
+#include "Mutex.h"
+#include "Timer.h"
+
+
+namespace vglserver
+{
+	// A Capture records either the compressed tiles that the VGL Transport
+	// sends to the client (RRCAP_TILES) or the uncompressed frames that it
+	// receives from the 3D application (RRCAP_FRAMES) in a file that can be
+	// replayed with vglreplay.  All of the windows in a process that capture to
+	// the same file share one Capture instance.
+	class Capture
+	{
+		public:
+
+			static Capture *attach(char *fileName, int type);
+			void detach(void);
+			void writeTile(rrframeheader &h, unsigned char *bits);
+			void writeFrame(vglcommon::Frame *f);
+
+		private:
+
+			Capture(int type);
+			~Capture(void);
+			void open(char *fileName);
+			void writeRecord(rrframeheader &h, int pixelSize, int flags);
+			void write(void *buf, size_t len);
+
+			FILE *file;  char *fileName;  int type, refCount;
+			vglutil::Timer timer;  double start;
+			vglutil::CriticalSection mutex;
+			Capture *next;
+			static Capture *captureList;
+			static vglutil::CriticalSection captureMutex;
+	};
+
+
+	// Reads the records from a capture file
+	class CaptureReader
+	{
+		public:
+
+			CaptureReader(char *fileName);
+			~CaptureReader(void);
+			int getType(void) { return type; }
+			bool read(rrcaprecord &rec, rrframeheader &h, unsigned char **data,
+				unsigned int &size);
+			void rewind(void);
+
+		private:
+
+			FILE *file;  int type;
+			unsigned char *buf;  unsigned int bufSize;
+	};
+}
+
+#endif // __CAPTURE_H__
@@ -56,6 +56,12 @@ namespace vglserver
 				return HASH::find(DisplayString(dpy), pm);
 			}
 
+			VirtualPixmap *find(GLXDrawable glxd)
+			{
+				if(!glxd) return NULL;
+				return HASH::find(NULL, glxd);
+			}
+
 			Pixmap reverseFind(GLXDrawable glxd)
 			{
 				if(!glxd) return 0;
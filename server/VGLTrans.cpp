@@ -20,6 +20,16 @@
 #include "Log.h"
 #include <fcntl.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#endif
+#endif
 
 using namespace vglutil;
 using namespace vglcommon;
@@ -69,40 +79,133 @@ using namespace vglserver;
 }
 
 
-void VGLTrans::sendHeader(rrframeheader h, bool eof)
+// Encode a varint (see rrframeinfo) and return its length
+static int putVarint(unsigned char *buf, unsigned int value)
 {
-	if(version.major==0 && version.minor==0)
+	int n=0;
+	while(value>=0x80)
 	{
-		// Fake up an old (protocol v1.0) EOF packet and see if the client sends
-		// back a CTS signal.  If so, it needs protocol 1.0
-		rrframeheader_v1 h1;  char reply=0;
-		CONVERT_HEADER(h, h1);
-		h1.flags=RR_EOF;
-		ENDIANIZE_V1(h1);
-		if(socket)
+		buf[n++]=(unsigned char)(value|0x80);  value>>=7;
+	}
+	buf[n++]=(unsigned char)value;
+	return n;
+}
+
+
+// Encode a v3 frame record for the frame to which the tile header h belongs
+static int putFrameRecord(unsigned char *buf, rrframeheader &h,
+	unsigned int seq, int scale)
+{
+	rrframeinfo info;
+
+	info.winid=h.winid;  info.seq=seq;
+	info.framew=h.framew;  info.frameh=h.frameh;  info.dpynum=h.dpynum;
+	info.qual=h.qual;  info.subsamp=h.subsamp;  info.compress=h.compress;
+	if(!littleendian())
+	{
+		info.winid=byteswap(info.winid);  info.seq=byteswap(info.seq);
+		info.framew=byteswap16(info.framew);
+		info.frameh=byteswap16(info.frameh);
+		info.dpynum=byteswap16(info.dpynum);
+	}
+	buf[0]=RR3_FRAME;
+	memcpy(&buf[1], &info, sizeof_rrframeinfo);
+	if(scale<=1) return 1+sizeof_rrframeinfo;
+	buf[1+sizeof_rrframeinfo]=RR3_SCALE;
+	buf[2+sizeof_rrframeinfo]=(unsigned char)scale;
+	return 3+sizeof_rrframeinfo;
+}
+
+
+// Encode a v3 tile record.  If shm is true, then the record includes the
+// offset of the payload in the shared memory ring.
+static int putTileRecord(unsigned char *buf, rrframeheader &h, bool shm,
+	unsigned int offset)
+{
+	int n=1;
+
+	n+=putVarint(&buf[n], h.x);
+	n+=putVarint(&buf[n], h.y);
+	n+=putVarint(&buf[n], h.width);
+	n+=putVarint(&buf[n], h.height);
+	n+=putVarint(&buf[n], h.size);
+	if(shm) n+=putVarint(&buf[n], offset==RR_SHMINLINE? 0:offset+1);
+	buf[0]=(unsigned char)(((h.flags&3)<<5)|(n-1));
+	return n;
+}
+
+#define RR3_MAXRECORD (3+sizeof_rrframeinfo+1+RR3_MAXTILERECORD)
+
+
+// Exchange versions with the client and negotiate the optional features of
+// the protocol.  This is called when the first header is sent.
+void VGLSession::handshake(rrframeheader &h)
+{
+	// Fake up an old (protocol v1.0) EOF packet and see if the client sends
+	// back a CTS signal.  If so, it needs protocol 1.0
+	rrframeheader_v1 h1;  char reply=0;
+	CONVERT_HEADER(h, h1);
+	h1.flags=RR_EOF;
+	ENDIANIZE_V1(h1);
+	if(socket)
+	{
+		send((char *)&h1, sizeof_rrframeheader_v1);
+		recv(&reply, 1);
+		if(reply==1)
 		{
-			send((char *)&h1, sizeof_rrframeheader_v1);
-			recv(&reply, 1);
-			if(reply==1)
+			version.major=1;  version.minor=0;
+		}
+		else if(reply=='V')
+		{
+			rrversion v;
+			version.id[0]=reply;
+			recv((char *)&version.id[1], sizeof_rrversion-1);
+			if(strncmp(version.id, "VGL", 3) || version.major<1)
+				_throw("Error reading client version");
+			v=version;
+			v.major=RR_MAJOR_VERSION;  v.minor=RR_MINOR_VERSION;
+			send((char *)&v, sizeof_rrversion);
+			if(version.major>=3) compact=true;
+			if(version.major>3 || (version.major==3 && version.minor>=1))
+			{
+				CriticalSection::SafeLock l(mutex);
+				doScale=true;
+			}
+			else if(fconfig.downscale>1 && fconfig.verbose)
 			{
-				version.major=1;  version.minor=0;
+				vglout.println("[VGL] NOTICE: VGL_DOWNSCALE requires protocol v3.1");
+				vglout.println("[VGL]    or later.  Sending unscaled frames.");
 			}
-			else if(reply=='V')
+			if((version.major>2 || (version.major==2 && version.minor>=5))
+				&& !doSSL)
+				syncClock();
+			if((version.major>2 || (version.major==2 && version.minor>=3))
+				&& !doSSL)
+				negotiateShm(h);
+			if((version.major>2 || (version.major==2 && version.minor>=4))
+				&& !doSSL)
+				negotiateStreams();
+			if((version.major>2 || (version.major==2 && version.minor>=2))
+				&& !doSSL)
 			{
-				rrversion v;
-				version.id[0]=reply;
-				recv((char *)&version.id[1], sizeof_rrversion-1);
-				if(strncmp(version.id, "VGL", 3) || version.major<1)
-					_throw("Error reading client version");
-				v=version;
-				v.major=RR_MAJOR_VERSION;  v.minor=RR_MINOR_VERSION;
-				send((char *)&v, sizeof_rrversion);
+				doAcks=true;
+				_newcheck(ackReader=new AckReader(this));
+				_newcheck(ackThread=new Thread(ackReader));
+				ackThread->start();
 			}
-			if(fconfig.verbose)
-				vglout.println("[VGL] Client version: %d.%d", version.major,
-					version.minor);
 		}
+		if(fconfig.verbose)
+			vglout.println("[VGL] Client version: %d.%d", version.major,
+				version.minor);
 	}
+}
+
+
+// Send the header for a tile or, if eof is true, for the end of the frame.
+// offset is the location of the tile's payload in the shared memory ring.
+void VGLSession::sendHeader(rrframeheader h, bool eof, unsigned int offset)
+{
+	if(version.major==0 && version.minor==0) handshake(h);
 	if((version.major<2 || (version.major==2 && version.minor<1))
 		&& h.compress!=RRCOMP_JPEG)
 		_throw("This compression mode requires VirtualGL Client v2.1 or later");
@@ -124,51 +227,314 @@ void VGLTrans::sendHeader(rrframeheader h, bool eof)
 			}
 		}
 	}
+	else if(compact)
+	{
+		unsigned char buf[RR3_MAXRECORD];  int n=0;
+		if(!frameOpen)
+		{
+			n+=putFrameRecord(buf, h, seq, frameScale);  frameOpen=true;
+		}
+		if(eof)
+		{
+			buf[n++]=RR3_EOF;  frameOpen=false;
+		}
+		else n+=putTileRecord(&buf[n], h, shmBase!=NULL, offset);
+		send((char *)buf, n);
+	}
 	else
 	{
 		ENDIANIZE(h);
 		send((char *)&h, sizeof_rrframeheader);
+		if(nStreams>1 && !eof)
+		{
+			unsigned int s=seq;
+			if(!littleendian()) s=byteswap(s);
+			send((char *)&s, 4);
+		}
+		if(shmBase && !eof)
+		{
+			if(!littleendian()) offset=byteswap(offset);
+			send((char *)&offset, 4);
+		}
+	}
+}
+
+
+VGLSession *VGLSession::sessionList=NULL;
+const double VGLSession::ACKTIMEOUT=1.0;
+CriticalSection VGLSession::sessionMutex;
+
+
+// Return the session for the given client, connecting to it if no usable
+// session exists.
+VGLSession *VGLSession::attach(char *serverName, unsigned short port)
+{
+	CriticalSection::SafeLock l(sessionMutex);
+	VGLSession *session;
+
+	for(session=sessionList; session; session=session->next)
+	{
+		if(!session->failed && session->port==port
+			&& !strcmp(session->serverName, serverName))
+		{
+			session->refCount++;
+			return session;
+		}
 	}
+
+	_newcheck(session=new VGLSession());
+	try
+	{
+		session->connect(serverName, port);
+	}
+	catch(...)
+	{
+		delete session;  throw;
+	}
+	session->next=sessionList;  sessionList=session;
+	return session;
+}
+
+
+void VGLSession::detach(void)
+{
+	CriticalSection::SafeLock l(sessionMutex);
+
+	if(--refCount>0) return;
+	for(VGLSession **ptr=&sessionList; *ptr; ptr=&(*ptr)->next)
+	{
+		if(*ptr==this) { *ptr=next;  break; }
+	}
+	delete this;
 }
 
 
-VGLTrans::VGLTrans(void) : nprocs(fconfig.np), socket(NULL), thread(NULL),
-	deadYet(false), dpynum(0)
+VGLSession::VGLSession(void) : nprocs(fconfig.np), socket(NULL),
+	batchBuf(NULL), batchBytes(0), niov(0), inFlightStart(0), nInFlight(0),
+	transList(NULL), thread(NULL), deadYet(false), failed(false),
+	compact(false), frameOpen(false), doSSL(false), doAcks(false),
+	ackThread(NULL), shmBase(NULL), shmFD(-1),
+	shmHead(0), shmTail(0), shmUsed(0), regionStart(0), nRegions(0),
+	inRegion(false), nStreams(1), nextStream(0), seq(0), doStamps(false),
+	clockOffset(0), doScale(false), frameScale(1), capture(NULL),
+	serverName(NULL), port(0), refCount(1), next(NULL), ackReader(NULL)
 {
 	memset(&version, 0, sizeof(rrversion));
-	profTotal.setName("Total     ");
 }
 
 
-void VGLTrans::run(void)
+VGLSession::~VGLSession(void)
+{
+	deadYet=true;  work.signal();  shmFree.signal();
+	for(int i=1; i<nStreams; i++) stripes[i]->eofSent.signal();
+	if(thread) { thread->stop();  delete thread;  thread=NULL; }
+	for(int i=1; i<nStreams; i++) { delete stripes[i];  stripes[i]=NULL; }
+	nStreams=1;
+	if(ackThread)
+	{
+		// Closing the socket unblocks the acknowledgment thread
+		if(socket) socket->close();
+		ackThread->stop();  delete ackThread;  ackThread=NULL;
+	}
+	if(ackReader) { delete ackReader;  ackReader=NULL; }
+	if(socket) { delete socket;  socket=NULL; }
+	destroyShm();
+	if(batchBuf) { delete [] batchBuf;  batchBuf=NULL; }
+	for(int i=0; i<nInFlight; i++)
+		delete inFlight[(inFlightStart+i)%MAXINFLIGHT].cf;
+	nInFlight=0;
+	void *cf=NULL;
+	do
+	{
+		cf=NULL;  freeTiles.get(&cf, true);
+		if(cf) delete (CompressedFrame *)cf;
+	} while(cf);
+	if(serverName) { free(serverName);  serverName=NULL; }
+}
+
+
+void VGLSession::addTrans(VGLTrans *trans)
+{
+	CriticalSection::SafeLock l(mutex);
+
+	trans->next=NULL;
+	VGLTrans **ptr=&transList;
+	while(*ptr) ptr=&(*ptr)->next;
+	*ptr=trans;
+}
+
+
+// Detach a window from the session, discarding any frame that it has queued.
+// If the session is currently sending one of the window's frames, then wait
+// for it to finish, since the frame belongs to the window.  Also give the
+// client a chance to acknowledge the window's outstanding frames.  Otherwise,
+// the acknowledgments might arrive after the connection has been closed, which
+// would cause the connection to be reset before the client has read the last
+// frame.
+void VGLSession::removeTrans(VGLTrans *trans)
+{
+	CriticalSection::SafeLock l(mutex);
+	Timer timer;
+
+	if(trans->pending)
+	{
+		trans->pending->signalComplete();  trans->pending=NULL;
+	}
+	while(trans->busy)
+	{
+		mutex.unlock();
+		trans->idle.wait();
+		mutex.lock();
+	}
+	timer.start();
+	while(doAcks && !failed && trans->unacked>0)
+	{
+		double remaining=ACKTIMEOUT-timer.elapsed();
+		if(remaining<=0.) break;
+		mutex.unlock();
+		trans->acked.wait(remaining);
+		mutex.lock();
+	}
+	for(VGLTrans **ptr=&transList; *ptr; ptr=&(*ptr)->next)
+	{
+		if(*ptr==trans) { *ptr=trans->next;  break; }
+	}
+	trans->next=NULL;
+}
+
+
+// Pick the next window with a queued frame, skipping any window that is being
+// throttled by VGL_FPS or that has used up its credits.  The chosen window is
+// moved to the end of the list so that windows are serviced in round-robin
+// order.  If frames are queued but all of them are being throttled, then wait
+// receives the time until the earliest one can be sent.  The caller must hold
+// the session mutex.
+VGLTrans *VGLSession::nextTrans(double &wait)
+{
+	VGLTrans **ptr, *trans=NULL;
+	double now=0.;
+
+	wait=0.;
+	if(fconfig.fps>0.) { Timer timer;  now=timer.time(); }
+	for(ptr=&transList; *ptr; ptr=&(*ptr)->next)
+	{
+		if(!(*ptr)->pending) continue;
+		if(doAcks && fconfig.credits>0 && (*ptr)->unacked>=fconfig.credits)
+			continue;
+		if(fconfig.fps>0. && (*ptr)->nextTime>now)
+		{
+			if(wait==0. || (*ptr)->nextTime-now<wait) wait=(*ptr)->nextTime-now;
+			continue;
+		}
+		trans=*ptr;  *ptr=trans->next;  trans->next=NULL;
+		break;
+	}
+	if(trans)
+	{
+		while(*ptr) ptr=&(*ptr)->next;
+		*ptr=trans;  wait=0.;
+	}
+	return trans;
+}
+
+
+// Each acknowledgment returns one credit to the window that sent the frame.
+void VGLSession::readAcks(void)
+{
+	rrframeack ack;  rrframetimes times;
+
+	try
+	{
+		while(!deadYet)
+		{
+			socket->recv((char *)&ack, sizeof_rrframeack);
+			if(doStamps) socket->recv((char *)&times, sizeof_rrframetimes);
+			if(!littleendian())
+			{
+				ack.winid=byteswap(ack.winid);  ack.dpynum=byteswap16(ack.dpynum);
+				times.stamp.seq=byteswap(times.stamp.seq);
+				times.stamp.time=byteswap(times.stamp.time);
+				times.recvTime=byteswap(times.recvTime);
+				times.decodeTime=byteswap(times.decodeTime);
+				times.drawTime=byteswap(times.drawTime);
+			}
+			CriticalSection::SafeLock l(mutex);
+			for(VGLTrans *trans=transList; trans; trans=trans->next)
+			{
+				if(trans->unacked>0 && trans->winid==ack.winid
+					&& trans->dpynum==ack.dpynum)
+				{
+					trans->unacked--;  trans->acked.signal();
+					if(doStamps) addLatency(trans, times);
+					break;
+				}
+			}
+			if(shmBase) releaseShm(ack.winid, ack.dpynum);
+			work.signal();
+		}
+	}
+	catch(Error &e)
+	{
+		if(deadYet) return;
+		vglout.println("[VGL] ERROR: Could not receive data from client.  Client may have disconnected.");
+		CriticalSection::SafeLock l(mutex);
+		failed=true;
+		for(VGLTrans *trans=transList; trans; trans=trans->next)
+		{
+			trans->ready.signal();  trans->acked.signal();
+		}
+		work.signal();  shmFree.signal();
+		throw;
+	}
+}
+
+
+void VGLSession::run(void)
 {
 	Frame *lastf=NULL, *f=NULL;
+	VGLTrans *trans=NULL;
 	long bytes=0;
-	Timer timer, sleepTimer;  double err=0.;  bool first=true;
 	int i;
+	Timer timer;  unsigned int dequeued=0;
 
 	try
 	{
-		VGLTrans::Compressor *comp[MAXPROCS];  Thread *cthread[MAXPROCS];
+		VGLSession::Compressor *comp[MAXPROCS];  Thread *cthread[MAXPROCS];
 		if(fconfig.verbose)
 			vglout.println("[VGL] Using %d / %d CPU's for compression",
 				nprocs, numprocs());
 		for(i=0; i<nprocs; i++)
-			_newcheck(comp[i]=new VGLTrans::Compressor(i, this));
+			_newcheck(comp[i]=new VGLSession::Compressor(i, this));
 		if(nprocs>1) for(i=1; i<nprocs; i++)
 		{
 			_newcheck(cthread[i]=new Thread(comp[i]));
 			cthread[i]->start();
 		}
 
-		while(!deadYet)
+		while(!deadYet && !failed)
 		{
 			int np;
-			void *ftemp=NULL;
+			double wait=0.;
 
-			q.get(&ftemp);  f=(Frame *)ftemp;  if(deadYet) break;
-			if(!f) _throw("Queue has been shut down");
-			ready.signal();
+			{
+				CriticalSection::SafeLock l(mutex);
+				if((trans=nextTrans(wait))!=NULL)
+				{
+					f=trans->pending;  trans->pending=NULL;
+					lastf=trans->lastf;  trans->busy=true;
+					dequeued=timer.usec();
+				}
+			}
+			if(!trans)
+			{
+				if(wait>0.) usleep((long)(wait*1000000.));
+				else work.wait();
+				continue;
+			}
+			trans->ready.signal();
+			capture=trans->tileCapture;
+			frameScale=f->scale;
+			if(shmBase) beginShmFrame(f->hdr.winid, f->hdr.dpynum);
 			np=nprocs;  if(f->hdr.compress==RRCOMP_YUV) np=1;
 			if(np>1)
 			{
@@ -187,38 +553,62 @@ void VGLTrans::run(void)
 					bytes+=comp[i]->bytes;
 				}
 			}
+			rrframestamp stamp;
+			if(doAcks)
+			{
+				CriticalSection::SafeLock l(mutex);
+				trans->winid=f->hdr.winid;  trans->unacked++;
+				if(doStamps)
+				{
+					int index=(int)(f-trans->frames);
+					if(index<0 || index>=trans->nFrames)
+						_throw("Frame does not belong to window");
+					stamp.seq=trans->frameSeq++;
+					stamp.time=trans->readStart[index];
+					VGLTrans::FrameStamp *s=
+						&trans->stamps[stamp.seq%VGLTrans::MAXSTAMPS];
+					s->seq=stamp.seq;  s->readStart=stamp.time;
+					s->readEnd=trans->readEnd[index];  s->dequeued=dequeued;
+					s->compressed=timer.usec();
+					if(!littleendian())
+					{
+						stamp.seq=byteswap(stamp.seq);  stamp.time=byteswap(stamp.time);
+					}
+				}
+			}
+			endShmFrame();
 			sendHeader(f->hdr, true);
+			if(doStamps) send((char *)&stamp, sizeof_rrframestamp);
+			if(capture)
+			{
+				rrframeheader h=f->hdr;  h.flags=RR_EOF;
+				capture->writeTile(h, NULL);
+			}
+			flush();
+			if(nStreams>1) sendEOFToStripes(f->hdr);
 
-			profTotal.endFrame(f->hdr.width*f->hdr.height, bytes, 1);
+			trans->profTotal.endFrame(f->hdr.width*f->hdr.height, bytes, 1);
 			bytes=0;
-			profTotal.startFrame();
+			trans->profTotal.startFrame();
 
 			if(fconfig.flushdelay>0.)
 			{
 				long usec=(long)(fconfig.flushdelay*1000000.);
 				if(usec>0) usleep(usec);
 			}
-			if(fconfig.fps>0.)
+
 			{
-				double elapsed=timer.elapsed();
-				if(first) first=false;
-				else
+				CriticalSection::SafeLock l(mutex);
+				if(fconfig.fps>0.)
 				{
-					if(elapsed<1./fconfig.fps)
-					{
-						sleepTimer.start();
-						long usec=(long)((1./fconfig.fps-elapsed-err)*1000000.);
-						if(usec>0) usleep(usec);
-						double sleepTime=sleepTimer.elapsed();
-						err=sleepTime-(1./fconfig.fps-elapsed-err);
-						if(err<0.) err=0.;
-					}
+					Timer timer;
+					trans->nextTime=timer.time()+1./fconfig.fps;
 				}
-				timer.start();
+				if(trans->lastf) trans->lastf->signalComplete();
+				trans->lastf=f;
+				trans->busy=false;  trans->idle.signal();
 			}
-
-			if(lastf) lastf->signalComplete();
-			lastf=f;
+			trans=NULL;  capture=NULL;
 		}
 
 		for(i=0; i<nprocs; i++) comp[i]->shutdown();
@@ -234,29 +624,98 @@ void VGLTrans::run(void)
 	catch(Error &e)
 	{
 		if(thread) thread->setError(e);
-		ready.signal();
+		CriticalSection::SafeLock l(mutex);
+		failed=true;
+		if(trans) trans->busy=false;
+		for(VGLTrans *t=transList; t; t=t->next)
+		{
+			// Release the frames that the session is holding, in case getFrame()
+			// is waiting for one of them.
+			if(t->lastf) { t->lastf->signalComplete();  t->lastf=NULL; }
+			if(t->pending) { t->pending->signalComplete();  t->pending=NULL; }
+			t->ready.signal();  t->idle.signal();
+		}
  		throw;
 	}
 }
 
 
+static const int NSTAGES=7;
+static const char *stageNames[NSTAGES]=
+{
+	"Readback", "Queue", "Compress/send", "Network", "Decode", "Blit",
+	"End-to-end"
+};
+
+
+VGLTrans::VGLTrans(void) : frames(NULL), nFrames(0), frameAge(NULL),
+	nextAge(0), session(NULL), deadYet(false), dpynum(0), pending(NULL),
+	lastf(NULL), busy(false), unacked(0), winid(0),
+	nextTime(0.), next(NULL), frameSeq(0),
+	profLatency("Latency", NSTAGES, stageNames), tileCapture(NULL),
+	frameCapture(NULL)
+{
+	nFrames=fconfig.poolsize>0? fconfig.poolsize:DEFPOOLSIZE;
+	_newcheck(frames=new Frame[nFrames]);
+	_newcheck(frameAge=new unsigned int[nFrames]);
+	_newcheck(readStart=new unsigned int[nFrames]);
+	_newcheck(readEnd=new unsigned int[nFrames]);
+	memset(frameAge, 0, sizeof(unsigned int)*nFrames);
+	memset(readStart, 0, sizeof(unsigned int)*nFrames);
+	memset(readEnd, 0, sizeof(unsigned int)*nFrames);
+	memset(stamps, 0, sizeof(FrameStamp)*MAXSTAMPS);
+	profTotal.setName("Total     ");
+	profPool.setName("Pool      ");
+	profPool.setSize(nFrames);
+}
+
+
+VGLTrans::~VGLTrans(void)
+{
+	deadYet=true;
+	if(session)
+	{
+		session->removeTrans(this);
+		session->detach();  session=NULL;
+	}
+	if(tileCapture) { tileCapture->detach();  tileCapture=NULL; }
+	if(frameCapture) { frameCapture->detach();  frameCapture=NULL; }
+	delete [] frames;  delete [] frameAge;
+	delete [] readStart;  delete [] readEnd;
+}
+
+
 Frame *VGLTrans::getFrame(int width, int height, int ps, int flags,
 	bool stereo)
 {
-	Frame *f=NULL;
+	Frame *f=NULL;  bool blocked=false;  int index=-1;
 
 	if(deadYet) return NULL;
-	if(thread) thread->checkError();
+	if(session) session->checkError();
 	{
 		CriticalSection::SafeLock l(mutex);
 
-		int index=-1;
-		for(int i=0; i<NFRAMES; i++)
+		// Use a free buffer if there is one.  Otherwise, use the buffer that was
+		// handed out the longest time ago, since it will be released first.
+		int oldest=0;
+		for(int i=0; i<nFrames; i++)
+		{
 			if(frames[i].isComplete()) index=i;
-		if(index<0) _throw("No free buffers in pool");
-		f=&frames[index];  f->waitUntilComplete();
+			else if(nextAge-frameAge[i]>nextAge-frameAge[oldest]) oldest=i;
+		}
+		if(index<0)
+		{
+			index=oldest;  blocked=true;
+		}
+		f=&frames[index];  frameAge[index]=nextAge++;
 	}
 
+	double start=timer.time();
+	f->waitUntilComplete();
+	profPool.addGet(blocked? timer.time()-start:0.0);
+	if(blocked && session) session->checkError();
+	readStart[index]=timer.usec();
+
 	rrframeheader hdr;
 	memset(&hdr, 0, sizeof(rrframeheader));
 	hdr.x=hdr.y=0;
@@ -269,35 +728,57 @@ Frame *VGLTrans::getFrame(int width, int height, int ps, int flags,
 
 bool VGLTrans::isReady(void)
 {
-	if(thread) thread->checkError();
-	return(q.items()<=0);
+	if(!session) return pending==NULL;
+	session->checkError();
+	CriticalSection::SafeLock l(session->mutex);
+	return pending==NULL;
 }
 
 
-void VGLTrans::synchronize(void)
+// Returns true if the client is known to support frames that have been scaled
+// down by the faker (protocol v3.1 and later.)  Until the first frame has been
+// sent, the client's version is not known, so frames are sent unscaled.
+bool VGLTrans::canScale(void)
 {
-	ready.wait();
+	if(!session) return false;
+	CriticalSection::SafeLock l(session->mutex);
+	return session->doScale;
 }
 
 
-static void _VGLTrans_spoilfct(void *f)
+void VGLTrans::synchronize(void)
 {
-	if(f) ((Frame *)f)->signalComplete();
+	ready.wait();
 }
 
 
+// Queue a frame for the session, spoiling the previously queued frame if the
+// session has not picked it up yet
 void VGLTrans::sendFrame(Frame *f)
 {
-	if(thread) thread->checkError();
+	if(session) session->checkError();
 	f->hdr.dpynum=dpynum;
-	q.spoil((void *)f, _VGLTrans_spoilfct);
+	if(frameCapture) frameCapture->writeFrame(f);
+	if(session)
+	{
+		{
+			CriticalSection::SafeLock l(session->mutex);
+			if(f>=frames && f<&frames[nFrames]) readEnd[f-frames]=timer.usec();
+			if(pending) { pending->signalComplete();  profPool.addSpoiled(); }
+			pending=f;
+		}
+		session->schedule();
+	}
+	else
+	{
+		if(pending) { pending->signalComplete();  profPool.addSpoiled(); }
+		pending=f;
+	}
 }
 
 
-void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
+void VGLSession::Compressor::compressSend(Frame *f, Frame *lastf)
 {
-	CompressedFrame cframe;
-
 	if(!f) return;
 	int tilesizex=fconfig.tilesize? fconfig.tilesize:f->hdr.width;
 	int tilesizey=fconfig.tilesize? fconfig.tilesize:f->hdr.height;
@@ -305,11 +786,11 @@ void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
 
 	if(f->hdr.compress==RRCOMP_YUV)
 	{
+		CompressedFrame *cframe=parent->getCompressedFrame();
 		profComp.startFrame();
-		cframe=*f;
+		*cframe=*f;
 		profComp.endFrame(f->hdr.framew*f->hdr.frameh, 0, 1);
-		parent->sendHeader(cframe.hdr);
-		parent->send((char *)cframe.bits, cframe.hdr.size);
+		parent->sendTile(cframe);
 		return;
 	}
 
@@ -336,9 +817,7 @@ void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
 				if(f->tileEquals(lastf, x, y, width, height)) continue;
 			}
 			Frame *tile=f->getTile(x, y, width, height);
-			CompressedFrame *ctile=NULL;
-			if(myRank>0) { _newcheck(ctile=new CompressedFrame()); }
-			else ctile=&cframe;
+			CompressedFrame *ctile=parent->getCompressedFrame();
 			profComp.startFrame();
 			*ctile=*tile;
 			double frames=(double)(tile->hdr.width*tile->hdr.height)
@@ -347,53 +826,674 @@ void VGLTrans::Compressor::compressSend(Frame *f, Frame *lastf)
 			bytes+=ctile->hdr.size;
 			if(ctile->stereo) bytes+=ctile->rhdr.size;
 			delete tile;
-			if(myRank==0)
+			if(myRank==0) parent->sendTile(ctile);
+			else store(ctile);
+		}
+	}
+}
+
+
+// The buffer passed to this function can be reused as soon as the function
+// returns.  Small buffers are copied into the batch buffer, and large buffers
+// cause the batch to be flushed immediately.
+void VGLSession::send(char *buf, int len)
+{
+	if(!socket || !buf || len<=0) return;
+	if(!batchBuf) _newcheck(batchBuf=new char[BATCHSIZE]);
+
+	if(len<=MAXCOPY)
+	{
+		if(batchBytes+len>BATCHSIZE || niov>=MAXIOV) flush();
+		char *ptr=&batchBuf[batchBytes];
+		memcpy(ptr, buf, len);
+		batchBytes+=len;
+		// Merge with the previous element if it is contiguous in batchBuf
+		if(niov>0 && (char *)iov[niov-1].iov_base+iov[niov-1].iov_len==ptr)
+			iov[niov-1].iov_len+=len;
+		else
+		{
+			iov[niov].iov_base=ptr;  iov[niov].iov_len=len;  niov++;
+		}
+	}
+	else
+	{
+		if(niov>=MAXIOV) flush();
+		iov[niov].iov_base=buf;  iov[niov].iov_len=len;  niov++;
+		flush();
+	}
+}
+
+
+void VGLSession::flush(void)
+{
+	if(niov<1) return;
+	int count=niov;
+	niov=0;  batchBytes=0;
+	try
+	{
+		if(socket) socket->send(iov, count);
+	}
+	catch(...)
+	{
+		vglout.println("[VGL] ERROR: Could not send data to client.  Client may have disconnected.");
+		throw;
+	}
+}
+
+
+CompressedFrame *VGLSession::getCompressedFrame(void)
+{
+	void *cf=NULL;
+	freeTiles.get(&cf, true);
+	if(!cf) { _newcheck(cf=new CompressedFrame()); }
+	return (CompressedFrame *)cf;
+}
+
+
+// Send a compressed tile, then either return it to the pool or, if its
+// payload was sent using zero-copy transmission, hold onto it until the kernel
+// has released its buffers.
+void VGLSession::sendTile(CompressedFrame *cf)
+{
+	unsigned int id=0;  bool zeroCopy=false;
+
+	if(capture)
+	{
+		capture->writeTile(cf->hdr, cf->bits);
+		if(cf->stereo && cf->rbits) capture->writeTile(cf->rhdr, cf->rbits);
+	}
+	if(nStreams>1)
+	{
+		int stream=nextStream;
+		nextStream=(nextStream+1)%nStreams;
+		if(stream>0) { stripes[stream]->add(cf);  return; }
+	}
+
+	if(sendPayload(cf->hdr, (char *)cf->bits, id)) zeroCopy=true;
+	if(cf->stereo && cf->rbits)
+	{
+		if(sendPayload(cf->rhdr, (char *)cf->rbits, id)) zeroCopy=true;
+	}
+
+	if(zeroCopy)
+	{
+		if(nInFlight>=MAXINFLIGHT) reapTiles(true);
+		int index=(inFlightStart+nInFlight)%MAXINFLIGHT;
+		inFlight[index].cf=cf;  inFlight[index].id=id;
+		nInFlight++;
+	}
+	else freeTiles.add(cf);
+	reapTiles(false);
+}
+
+
+// Send a tile's header and payload.  Returns true if the payload was sent
+// using zero-copy transmission, in which case id receives the send ID.
+bool VGLSession::sendPayload(rrframeheader &h, char *buf, unsigned int &id)
+{
+	int len=h.size, index=-1;
+
+	if(version.major==0 && version.minor==0) handshake(h);
+	if(shmBase && (index=allocShm(len))>=0)
+		memcpy(&shmBase[RR_SHMHDRSIZE+index], buf, len);
+	sendHeader(h, false, index>=0? (unsigned int)index:RR_SHMINLINE);
+	if(index>=0) return false;
+	if(socket && socket->isZeroCopy() && len>=MINZEROCOPY)
+	{
+		flush();
+		try
+		{
+			id=socket->sendZeroCopy(buf, len);
+		}
+		catch(...)
+		{
+			vglout.println("[VGL] ERROR: Could not send data to client.  Client may have disconnected.");
+			throw;
+		}
+		return true;
+	}
+	send(buf, len);
+	return false;
+}
+
+
+// The in-flight list is ordered by send ID, so stop at the first tile that is
+// still pinned by the kernel.
+void VGLSession::reapTiles(bool waitOldest)
+{
+	while(nInFlight>0 && socket)
+	{
+		if(!socket->zeroCopyComplete(inFlight[inFlightStart].id, waitOldest))
+			break;
+		freeTiles.add(inFlight[inFlightStart].cf);
+		inFlightStart=(inFlightStart+1)%MAXINFLIGHT;  nInFlight--;
+		waitOldest=false;
+	}
+}
+
+
+// Offer a shared memory ring to the client.  This is called during the version
+// exchange, while the header h is being sent, so if the client accepts the
+// ring, then the frame to which h belongs must also be given a region.
+void VGLSession::negotiateShm(rrframeheader &h)
+{
+	rrshminfo info;  char reply=0;  int listenFD=-1;
+
+	memset(&info, 0, sizeof(rrshminfo));
+	if(fconfig.shm) createShm();
+	if(shmBase && (listenFD=listenShm(info.name, sizeof(info.name)))<0)
+		destroyShm();
+	if(shmBase)
+	{
+		info.size=SHMSIZE;
+		memcpy(info.cookie, shmBase, sizeof(info.cookie));
+	}
+	if(!littleendian())
+	{
+		info.size=byteswap(info.size);
+		info.cookie[0]=byteswap(info.cookie[0]);
+		info.cookie[1]=byteswap(info.cookie[1]);
+	}
+	send((char *)&info, sizeof_rrshminfo);
+	if(listenFD>=0)
+	{
+		flush();
+		passShm(listenFD);
+		close(listenFD);
+	}
+	recv(&reply, 1);
+	if(reply!=1) destroyShm();
+	if(shmBase) beginShmFrame(h.winid, h.dpynum);
+	if(fconfig.verbose && fconfig.shm)
+		vglout.println("[VGL] %s", shmBase? "Using shared memory transport":
+			"Shared memory transport is not available");
+}
+
+
+// The cookie is not a security measure.  It just allows the client to verify
+// that the descriptor it received belongs to the ring that was offered on this
+// connection.
+void VGLSession::createShm(void)
+{
+	#if defined(__linux__) && defined(SYS_memfd_create)
+	unsigned int cookie[2];  Timer timer;
+	int fd=-1;  void *ptr=MAP_FAILED;
+
+	if((fd=syscall(SYS_memfd_create, "vglshm", 1 /* MFD_CLOEXEC */))<0)
+		return;
+	if(ftruncate(fd, RR_SHMHDRSIZE+SHMSIZE)<0
+		|| (ptr=mmap(NULL, RR_SHMHDRSIZE+SHMSIZE, PROT_READ|PROT_WRITE,
+			MAP_SHARED, fd, 0))==MAP_FAILED)
+	{
+		close(fd);  return;
+	}
+	cookie[0]=(unsigned int)(timer.time()*1000000.);
+	cookie[1]=(unsigned int)getpid()^(unsigned int)(size_t)this;
+	memcpy(ptr, cookie, sizeof(cookie));
+	shmBase=(unsigned char *)ptr;  shmFD=fd;
+	#endif
+}
+
+
+// Listen on an abstract Unix domain socket, through which the ring's file
+// descriptor will be passed to the client.  The kernel chooses a unique name
+// for the socket, which is returned in name.
+int VGLSession::listenShm(char *name, int len)
+{
+	#if defined(__linux__) && defined(SYS_memfd_create)
+	struct sockaddr_un addr;  socklen_t addrLen=sizeof(addr);
+	int fd=-1;
+
+	// Binding to an empty address causes the kernel to choose the name.
+	memset(&addr, 0, sizeof(addr));  addr.sun_family=AF_UNIX;
+	if((fd=::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0))<0) return -1;
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(sa_family_t))<0
+		|| listen(fd, 1)<0
+		|| getsockname(fd, (struct sockaddr *)&addr, &addrLen)<0
+		|| addrLen<=sizeof(sa_family_t)+1 || addr.sun_path[0]!=0
+		|| (int)(addrLen-sizeof(sa_family_t)-1)>=len)
+	{
+		close(fd);  return -1;
+	}
+	memset(name, 0, len);
+	memcpy(name, &addr.sun_path[1], addrLen-sizeof(sa_family_t)-1);
+	return fd;
+	#else
+	return -1;
+	#endif
+}
+
+
+// Wait for the client to connect to the socket created by listenShm(), then
+// pass it the ring's file descriptor.  The client declines the ring by
+// replying on the main connection instead, for instance if it is on a
+// different machine or in a different network namespace.  Only a process
+// running as the same user is given the ring.
+void VGLSession::passShm(int listenFD)
+{
+	#if defined(__linux__) && defined(SYS_memfd_create)
+	struct pollfd pfd[2];  Timer timer;
+
+	timer.start();
+	while(1)
+	{
+		double remaining=ACKTIMEOUT-timer.elapsed();
+		if(remaining<=0.) return;
+		pfd[0].fd=listenFD;  pfd[0].events=POLLIN;  pfd[0].revents=0;
+		pfd[1].fd=socket->getSocket();  pfd[1].events=POLLIN;  pfd[1].revents=0;
+		int ret=poll(pfd, 2, (int)(remaining*1000.)+1);
+		if(ret<0 && errno==EINTR) continue;
+		if(ret<=0 || pfd[1].revents) return;
+
+		struct ucred cred;  socklen_t credLen=sizeof(cred);
+		int fd=accept4(listenFD, NULL, NULL, SOCK_CLOEXEC);
+		if(fd<0) continue;
+		if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen)<0
+			|| cred.uid!=geteuid())
+		{
+			close(fd);  continue;
+		}
+		char c=0;  struct iovec iov;  struct msghdr msg;
+		union
+		{
+			struct cmsghdr hdr;  char buf[CMSG_SPACE(sizeof(int))];
+		} control;
+		iov.iov_base=&c;  iov.iov_len=1;
+		memset(&msg, 0, sizeof(msg));  memset(&control, 0, sizeof(control));
+		msg.msg_iov=&iov;  msg.msg_iovlen=1;
+		msg.msg_control=control.buf;  msg.msg_controllen=sizeof(control.buf);
+		struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level=SOL_SOCKET;  cmsg->cmsg_type=SCM_RIGHTS;
+		cmsg->cmsg_len=CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &shmFD, sizeof(int));
+		if(sendmsg(fd, &msg, MSG_NOSIGNAL)<0) {}
+		close(fd);
+		return;
+	}
+	#endif
+}
+
+
+void VGLSession::destroyShm(void)
+{
+	#ifdef __linux__
+	if(shmBase)
+	{
+		munmap(shmBase, RR_SHMHDRSIZE+SHMSIZE);  shmBase=NULL;
+	}
+	if(shmFD>=0) { close(shmFD);  shmFD=-1; }
+	#endif
+}
+
+
+// Start a new region at the current head of the ring.  Acknowledgments are
+// matched to regions in order, so every frame sent after the ring was accepted
+// must have a region, even if the frame has no tiles.  If no region becomes
+// free within ACKTIMEOUT, then stop using the ring, since a frame without a
+// region would cause a later frame's region to be released too early.
+void VGLSession::beginShmFrame(unsigned int winid, unsigned short dpynum)
+{
+	CriticalSection::SafeLock l(mutex);
+	Timer timer;
+
+	if(inRegion) return;
+	timer.start();
+	while(nRegions>=MAXREGIONS && !failed && !deadYet)
+	{
+		double remaining=ACKTIMEOUT-timer.elapsed();
+		if(remaining<=0.) break;
+		mutex.unlock();
+		shmFree.wait(remaining);
+		mutex.lock();
+	}
+	if(nRegions>=MAXREGIONS)
+	{
+		if(fconfig.verbose && !failed && !deadYet)
+		{
+			vglout.println("[VGL] NOTICE: Client stopped releasing shared memory.");
+			vglout.println("[VGL]    Disabling shared memory transport.");
+		}
+		destroyShm();  return;
+	}
+	int index=(regionStart+nRegions)%MAXREGIONS;
+	regions[index].end=shmHead;  regions[index].bytes=0;
+	regions[index].winid=winid;  regions[index].dpynum=dpynum;
+	regions[index].released=false;
+	nRegions++;  inRegion=true;
+}
+
+
+void VGLSession::endShmFrame(void)
+{
+	CriticalSection::SafeLock l(mutex);
+
+	if(!inRegion) return;
+	regions[(regionStart+nRegions-1)%MAXREGIONS].end=shmHead;
+	inRegion=false;
+}
+
+
+// Allocate len contiguous bytes in the ring for the current frame and return
+// the offset, or -1 if the payload should be sent over the connection instead.
+// If the ring is full, then wait for the client to release earlier frames, but
+// if the current frame is the only one left in the ring, then waiting would
+// deadlock.
+int VGLSession::allocShm(int len)
+{
+	CriticalSection::SafeLock l(mutex);
+	Timer timer;
+
+	timer.start();
+	if(!inRegion || len<0 || len>SHMSIZE) return -1;
+	while(1)
+	{
+		unsigned int offset=0, bytes=0, n=(unsigned int)len;
+		bool found=false;
+
+		if(shmHead>=shmTail && shmUsed<(unsigned int)SHMSIZE)
+		{
+			if(n<=SHMSIZE-shmHead)
+			{
+				offset=shmHead;  bytes=n;  found=true;
+			}
+			else if(n<=shmTail)
 			{
-				parent->sendHeader(ctile->hdr);
-				parent->send((char *)ctile->bits, ctile->hdr.size);
-				if(ctile->stereo && ctile->rbits)
+				// Wrap around, wasting the space at the end of the ring
+				offset=0;  bytes=SHMSIZE-shmHead+n;  found=true;
+			}
+		}
+		else if(shmHead<shmTail && n<=shmTail-shmHead)
+		{
+			offset=shmHead;  bytes=n;  found=true;
+		}
+		if(found)
+		{
+			shmHead=offset+n;  shmUsed+=bytes;
+			regions[(regionStart+nRegions-1)%MAXREGIONS].bytes+=bytes;
+			return (int)offset;
+		}
+		double remaining=ACKTIMEOUT-timer.elapsed();
+		if(nRegions<=1 || failed || deadYet || remaining<=0.) return -1;
+		mutex.unlock();
+		shmFree.wait(remaining);
+		mutex.lock();
+	}
+}
+
+
+// Release the oldest region belonging to the acknowledged window, then return
+// the space used by all released regions at the tail of the ring.  The caller
+// must hold the session mutex.
+void VGLSession::releaseShm(unsigned int winid, unsigned short dpynum)
+{
+	int n=nRegions-(inRegion? 1:0);
+
+	for(int i=0; i<n; i++)
+	{
+		int index=(regionStart+i)%MAXREGIONS;
+		if(!regions[index].released && regions[index].winid==winid
+			&& regions[index].dpynum==dpynum)
+		{
+			regions[index].released=true;  break;
+		}
+	}
+	while(n>0 && regions[regionStart].released)
+	{
+		shmUsed-=regions[regionStart].bytes;  shmTail=regions[regionStart].end;
+		regionStart=(regionStart+1)%MAXREGIONS;  nRegions--;  n--;
+		shmFree.signal();
+	}
+}
+
+
+// Offer to stripe tiles across additional connections.  This is called during
+// the version exchange, so the first tile of the first frame may already be
+// striped.
+void VGLSession::negotiateStreams(void)
+{
+	rrstripeinfo info;  unsigned char reply=1;
+	int streams=shmBase? 1:fconfig.streams;
+	Timer timer;
+
+	info.token=(unsigned int)(timer.time()*1000000.)^(unsigned int)getpid();
+	info.streams=streams;
+	unsigned int token=info.token;
+	if(!littleendian()) info.token=byteswap(info.token);
+	send((char *)&info, sizeof_rrstripeinfo);
+	recv((char *)&reply, 1);
+	if(reply<1 || reply>streams) reply=1;
+
+	for(int i=1; i<reply; i++)
+	{
+		Socket *socket=NULL;
+		try
+		{
+			rrframeheader_v1 h1;
+			memset(&h1, 0, sizeof(rrframeheader_v1));
+			h1.flags=RR_JOIN;  h1.winid=token;  h1.x=i;
+			ENDIANIZE_V1(h1);
+			_newcheck(socket=new Socket(false));
+			socket->connect(serverName, port);
+			socket->send((char *)&h1, sizeof_rrframeheader_v1);
+			_newcheck(stripes[i]=new Stripe(this, socket));
+			socket=NULL;
+			stripes[i]->start();
+		}
+		catch(...)
+		{
+			if(socket) delete socket;
+			vglout.println("[VGL] ERROR: Could not open additional stream to VGL client.");
+			nStreams=i;  throw;
+		}
+	}
+	nStreams=reply;
+	if(fconfig.verbose && streams>1)
+		vglout.println("[VGL] Striping tiles across %d streams", nStreams);
+}
+
+
+// Send the EOF header on each additional stream, and wait until all of them
+// have been sent, so that the stripes never fall more than a frame behind.
+void VGLSession::sendEOFToStripes(rrframeheader &h)
+{
+	int i;
+
+	for(i=1; i<nStreams; i++)
+	{
+		CompressedFrame *cf=getCompressedFrame();
+		rrframeheader eofh=h;  eofh.flags=RR_EOF;
+		cf->init(eofh, 0);
+		stripes[i]->add(cf);
+	}
+	for(i=1; i<nStreams; i++)
+	{
+		stripes[i]->eofSent.wait();
+		stripes[i]->checkError();
+	}
+	seq++;
+}
+
+
+VGLSession::Stripe::~Stripe(void)
+{
+	// Closing the socket unblocks the thread if it is stuck sending
+	q.release();
+	if(socket) socket->close();
+	if(thread) { thread->stop();  delete thread;  thread=NULL; }
+	if(socket) { delete socket;  socket=NULL; }
+}
+
+
+void VGLSession::Stripe::start(void)
+{
+	_newcheck(thread=new Thread(this));
+	thread->start();
+}
+
+
+void VGLSession::Stripe::run(void)
+{
+	try
+	{
+		while(1)
+		{
+			void *ptr=NULL;
+			q.get(&ptr);  if(!ptr) break;
+			CompressedFrame *cf=(CompressedFrame *)ptr;
+			struct iovec iov[6];  int niov=0;
+			rrframeheader h[2];  unsigned int s=seq;
+			unsigned char buf[RR3_MAXRECORD], rbuf[RR3_MAXTILERECORD+1];
+			bool eof=(cf->hdr.flags==RR_EOF);
+			if(!littleendian()) s=byteswap(s);
+
+			if(parent->compact)
+			{
+				// The additional streams never use the shared memory ring.
+				int n=0;
+				if(!frameOpen)
 				{
-					parent->sendHeader(ctile->rhdr);
-					parent->send((char *)ctile->rbits, ctile->rhdr.size);
+					n+=putFrameRecord(buf, cf->hdr, seq, parent->frameScale);
+					frameOpen=true;
+				}
+				if(eof)
+				{
+					buf[n++]=RR3_EOF;  frameOpen=false;
+				}
+				else n+=putTileRecord(&buf[n], cf->hdr, false, 0);
+				iov[niov].iov_base=(char *)buf;  iov[niov++].iov_len=n;
+				if(!eof)
+				{
+					iov[niov].iov_base=(char *)cf->bits;
+					iov[niov++].iov_len=cf->hdr.size;
+					if(cf->stereo && cf->rbits)
+					{
+						iov[niov].iov_base=(char *)rbuf;
+						iov[niov++].iov_len=putTileRecord(rbuf, cf->rhdr, false, 0);
+						iov[niov].iov_base=(char *)cf->rbits;
+						iov[niov++].iov_len=cf->rhdr.size;
+					}
 				}
 			}
 			else
 			{
-				store(ctile);
+				h[0]=cf->hdr;  ENDIANIZE(h[0]);
+				iov[niov].iov_base=(char *)&h[0];
+				iov[niov++].iov_len=sizeof_rrframeheader;
+				if(!eof)
+				{
+					iov[niov].iov_base=(char *)&s;  iov[niov++].iov_len=4;
+					iov[niov].iov_base=(char *)cf->bits;
+					iov[niov++].iov_len=cf->hdr.size;
+					if(cf->stereo && cf->rbits)
+					{
+						h[1]=cf->rhdr;  ENDIANIZE(h[1]);
+						iov[niov].iov_base=(char *)&h[1];
+						iov[niov++].iov_len=sizeof_rrframeheader;
+						iov[niov].iov_base=(char *)&s;  iov[niov++].iov_len=4;
+						iov[niov].iov_base=(char *)cf->rbits;
+						iov[niov++].iov_len=cf->rhdr.size;
+					}
+				}
 			}
+			socket->send(iov, niov);
+			parent->freeTiles.add(cf);
+			if(eof) { seq++;  eofSent.signal(); }
 		}
 	}
+	catch(...)
+	{
+		eofSent.signal();  throw;
+	}
+}
+
+
+// Estimate the offset between the client's clock and ours, assuming that the
+// client read its clock halfway through the round trip
+void VGLSession::syncClock(void)
+{
+	Timer timer;  unsigned int t0, t1=0, t2;
+
+	t0=timer.usec();
+	recv((char *)&t1, 4);
+	t2=timer.usec();
+	if(!littleendian()) t1=byteswap(t1);
+	clockOffset=(int)(t1-t0)-(int)(t2-t0)/2;
+	doStamps=true;
+	if(fconfig.verbose)
+		vglout.println("[VGL] Client clock offset: %.3f ms (round trip %.3f ms)",
+			(double)clockOffset/1000., (double)(t2-t0)/1000.);
+}
+
+
+// Compute the latency of each stage of an acknowledged frame.  The caller must
+// hold the session mutex.
+void VGLSession::addLatency(VGLTrans *trans, rrframetimes &times)
+{
+	if(!trans->profLatency.isEnabled()) return;
+	VGLTrans::FrameStamp *s=
+		&trans->stamps[times.stamp.seq%VGLTrans::MAXSTAMPS];
+	if(s->seq!=times.stamp.seq || s->readStart!=times.stamp.time) return;
+
+	// Convert the client's times to our clock
+	unsigned int recvTime=times.recvTime-clockOffset,
+		drawTime=times.drawTime-clockOffset;
+	double stages[NSTAGES];
+	stages[0]=(double)(int)(s->readEnd-s->readStart)/1000000.;
+	stages[1]=(double)(int)(s->dequeued-s->readEnd)/1000000.;
+	stages[2]=(double)(int)(s->compressed-s->dequeued)/1000000.;
+	stages[3]=(double)(int)(recvTime-s->compressed)/1000000.;
+	stages[4]=(double)(int)(times.decodeTime-times.recvTime)/1000000.;
+	stages[5]=(double)(int)(times.drawTime-times.decodeTime)/1000000.;
+	stages[6]=(double)(int)(drawTime-s->readStart)/1000000.;
+	trans->profLatency.addSample(stages);
 }
 
 
-void VGLTrans::send(char *buf, int len)
+void VGLSession::recv(char *buf, int len)
 {
 	try
 	{
-		if(socket) socket->send(buf, len);
+		flush();
+		if(socket) socket->recv(buf, len);
 	}
 	catch(...)
 	{
-		vglout.println("[VGL] ERROR: Could not send data to client.  Client may have disconnected.");
+		vglout.println("[VGL] ERROR: Could not receive data from client.  Client may have disconnected.");
 		throw;
 	}
 }
 
 
-void VGLTrans::recv(char *buf, int len)
+void VGLSession::connect(char *serverName_, unsigned short port_)
 {
+	_newcheck(serverName=strdup(serverName_));
+	port=port_;  doSSL=(bool)fconfig.ssl;
+	_newcheck(socket=new Socket(doSSL));
 	try
 	{
-		if(socket) socket->recv(buf, len);
+		socket->connect(serverName, port);
 	}
 	catch(...)
 	{
-		vglout.println("[VGL] ERROR: Could not receive data from client.  Client may have disconnected.");
+		vglout.println("[VGL] ERROR: Could not connect to VGL client.  Make sure that vglclient is");
+		vglout.println("[VGL]    running and that either the DISPLAY or VGL_CLIENT environment");
+		vglout.println("[VGL]    variable points to the machine on which vglclient is running.");
 		throw;
 	}
+	if(fconfig.zerocopy)
+	{
+		bool zeroCopy=socket->setZeroCopy(true);
+		if(fconfig.verbose)
+			vglout.println("[VGL] %s", zeroCopy? "Using zero-copy transmission":
+				"Zero-copy transmission is not available");
+	}
+	_newcheck(thread=new Thread(this));
+	thread->start();
 }
 
 
+// Windows that send to the same client share a connection, regardless of
+// which X display on the client they are drawn to.
 void VGLTrans::connect(char *displayName, unsigned short port)
 {
 	char *serverName=NULL;
@@ -413,20 +1513,8 @@ void VGLTrans::connect(char *displayName, unsigned short port)
 		{
 			free(serverName);  serverName=strdup("localhost");
 		}
-		_newcheck(socket=new Socket((bool)fconfig.ssl));
-		try
-		{
-			socket->connect(serverName, port);
-		}
-		catch(...)
-		{
-			vglout.println("[VGL] ERROR: Could not connect to VGL client.  Make sure that vglclient is");
-			vglout.println("[VGL]    running and that either the DISPLAY or VGL_CLIENT environment");
-			vglout.println("[VGL]    variable points to the machine on which vglclient is running.");
-			throw;
-		}
-		_newcheck(thread=new Thread(this));
-		thread->start();
+		session=VGLSession::attach(serverName, port);
+		session->addTrans(this);
 	}
 	catch(...)
 	{
@@ -436,20 +1524,25 @@ void VGLTrans::connect(char *displayName, unsigned short port)
 }
 
 
-void VGLTrans::Compressor::send(void)
+// Record this window's compressed tiles (RRCAP_TILES) or uncompressed frames
+// (RRCAP_FRAMES) to the given file, which can be shared with other windows.
+// This must be called before the first frame is sent.
+void VGLTrans::save(char *fileName, int type)
+{
+	Capture *capture=Capture::attach(fileName, type);
+	Capture *&slot=(type==RRCAP_TILES? tileCapture:frameCapture);
+	if(slot) slot->detach();
+	slot=capture;
+}
+
+
+void VGLSession::Compressor::send(void)
 {
 	for(int i=0; i<storedFrames; i++)
 	{
 		CompressedFrame *cf=cframes[i];
 		_errifnot(cf);
-		parent->sendHeader(cf->hdr);
-		parent->send((char *)cf->bits, cf->hdr.size);
-		if(cf->stereo && cf->rbits)
-		{
-			parent->sendHeader(cf->rhdr);
-			parent->send((char *)cf->rbits, cf->rhdr.size);
-		}
-		delete cf;
+		parent->sendTile(cf);
 	}
 	storedFrames=0;
 }
@@ -22,54 +22,198 @@
 #include "Frame.h"
 #include "GenericQ.h"
 #include "Profiler.h"
+#include "Capture.h"
 
 
 namespace vglserver
 {
-	class VGLTrans : public vglutil::Runnable
+	class VGLTrans;
+
+	// A VGLSession is a single connection to a VGL client, along with the
+	// sender thread and compressor threads that feed it.  All of the windows in
+	// a process that send to the same client share a session, and the session
+	// services their frames in round-robin order.
+	class VGLSession : public vglutil::Runnable
 	{
 		public:
 
-			VGLTrans(void);
-
-			virtual ~VGLTrans(void)
+			static VGLSession *attach(char *serverName, unsigned short port);
+			void detach(void);
+			void addTrans(VGLTrans *trans);
+			void removeTrans(VGLTrans *trans);
+			void schedule(void) { work.signal(); }
+			void checkError(void)
 			{
-				deadYet=true;  q.release();
-				if(thread) { thread->stop();  delete thread;  thread=NULL; }
-				if(socket) { delete socket;  socket=NULL; }
+				if(thread) thread->checkError();
+				if(ackThread) ackThread->checkError();
+				for(int i=1; i<nStreams; i++) stripes[i]->checkError();
 			}
-
-			vglcommon::Frame *getFrame(int, int, int, int, bool stereo);
-			bool isReady(void);
-			void synchronize(void);
-			void sendFrame(vglcommon::Frame *);
 			void run(void);
-			void sendHeader(rrframeheader h, bool eof=false);
+			void sendHeader(rrframeheader h, bool eof=false,
+				unsigned int offset=RR_SHMINLINE);
 			void send(char *, int);
-			void save(char *, int);
+			void flush(void);
+			vglcommon::CompressedFrame *getCompressedFrame(void);
+			void sendTile(vglcommon::CompressedFrame *);
 			void recv(char *, int);
-			void connect(char *, unsigned short);
 
 			int nprocs;
 
 		private:
 
+			VGLSession(void);
+			virtual ~VGLSession(void);
+			void connect(char *, unsigned short);
+			void handshake(rrframeheader &h);
+			VGLTrans *nextTrans(double &wait);
+			void readAcks(void);
+			void negotiateShm(rrframeheader &h);
+			void createShm(void);
+			void destroyShm(void);
+			int listenShm(char *name, int len);
+			void passShm(int listenFD);
+			void beginShmFrame(unsigned int winid, unsigned short dpynum);
+			void endShmFrame(void);
+			int allocShm(int len);
+			void releaseShm(unsigned int winid, unsigned short dpynum);
+			void negotiateStreams(void);
+			void sendEOFToStripes(rrframeheader &h);
+			void syncClock(void);
+			void addLatency(VGLTrans *trans, rrframetimes &times);
+
 			vglutil::Socket *socket;
-			static const int NFRAMES=4;
+			// Headers and small tiles are copied into batchBuf and sent along with
+			// the next large tile or the EOF header in a single gather send.
+			static const int BATCHSIZE=65536, MAXCOPY=8192, MAXIOV=64;
+			char *batchBuf;  int batchBytes;
+			struct iovec iov[MAXIOV];  int niov;
+
+			// Compressed tiles are recycled through freeTiles.  When zero-copy
+			// transmission is enabled, tiles whose payloads are still pinned by the
+			// kernel are held in inFlight until the kernel releases them.
+			bool sendPayload(rrframeheader &h, char *buf, unsigned int &id);
+			void reapTiles(bool waitOldest);
+			static const int MINZEROCOPY=65536, MAXINFLIGHT=256;
+			vglutil::GenericQ freeTiles;
+			struct
+			{
+				vglcommon::CompressedFrame *cf;  unsigned int id;
+			} inFlight[MAXINFLIGHT];
+			int inFlightStart, nInFlight;
+
+			// Windows attached to this session.  The window that was serviced most
+			// recently is moved to the end of the list.
 			vglutil::CriticalSection mutex;
-			vglcommon::Frame frames[NFRAMES];
-			vglutil::Event ready;
-			vglutil::GenericQ q;
-			vglutil::Thread *thread;  bool deadYet;
-			vglcommon::Profiler profTotal;
-			int dpynum;
+			VGLTrans *transList;
+			vglutil::Event work;
+			vglutil::Thread *thread;  bool deadYet, failed;
 			rrversion version;
 
+			// With protocol v3.0 and later, tiles are described by compact records
+			// (see rrframeinfo.)  frameOpen is true if the frame record for the
+			// current frame has been sent on the main connection.
+			bool compact, frameOpen;
+
+			// With protocol v2.2 and later, the client acknowledges each frame
+			// after displaying it, and no more than fconfig.credits frames per
+			// window are allowed to be unacknowledged at any given time.
+			static const double ACKTIMEOUT;
+			bool doSSL, doAcks;
+			vglutil::Thread *ackThread;
+
+			// With protocol v2.3 and later, if the client can map our memory (which
+			// implies that it is running on the same machine), then tile payloads
+			// are written to a shared memory ring, and only their offsets are sent
+			// over the connection.  Each frame occupies a region of the ring, which
+			// is released when the client acknowledges the frame.  The regions are
+			// protected by the session mutex, and shmFree is signaled whenever
+			// space is returned to the ring.
+			static const int SHMSIZE=64*1024*1024, MAXREGIONS=256;
+			unsigned char *shmBase;  int shmFD;
+			vglutil::Event shmFree;
+			unsigned int shmHead, shmTail, shmUsed;
+			struct
+			{
+				unsigned int end, bytes, winid;  unsigned short dpynum;
+				bool released;
+			} regions[MAXREGIONS];
+			int regionStart, nRegions;  bool inRegion;
+
+			// With protocol v2.4 and later, tiles can be striped across multiple
+			// connections (see VGL_STREAMS.)  Stream 0 is the main connection, which
+			// is serviced by the session thread, and each additional stream has a
+			// Stripe thread.  seq is the number of frames sent since striping began.
+			class Stripe;
+			Stripe *stripes[RR_MAXSTREAMS];  int nStreams, nextStream;
+			unsigned int seq;
+
+			// With protocol v2.5 and later, each frame carries a latency stamp,
+			// which the client returns with its acknowledgment.  clockOffset is the
+			// estimated difference (in microseconds) between the client's clock and
+			// ours.
+			bool doStamps;  int clockOffset;
+
+			// With protocol v3.1 and later, the frame record of a frame that was
+			// scaled down by the faker is followed by an RR3_SCALE record.
+			// frameScale is the scaling factor of the frame being sent.  doScale is
+			// protected by the session mutex.
+			bool doScale;  int frameScale;
+
+			// Tile capture of the window that is currently being serviced
+			Capture *capture;
+
+			char *serverName;  unsigned short port;  int refCount;
+			VGLSession *next;
+			static VGLSession *sessionList;
+			static vglutil::CriticalSection sessionMutex;
+
+			friend class VGLTrans;
+
+		class AckReader : public vglutil::Runnable
+		{
+			public:
+
+				AckReader(VGLSession *parent_) : parent(parent_) {}
+				void run(void) { parent->readAcks(); }
+
+			private:
+
+				VGLSession *parent;
+		};
+		AckReader *ackReader;
+
+		class Stripe : public vglutil::Runnable
+		{
+			public:
+
+				Stripe(VGLSession *parent_, vglutil::Socket *socket_) : seq(0),
+					frameOpen(false), socket(socket_), thread(NULL), parent(parent_)
+				{
+					eofSent.wait();
+				}
+				virtual ~Stripe(void);
+				void start(void);
+				void run(void);
+				void add(vglcommon::CompressedFrame *cf) { q.add(cf); }
+				void checkError(void) { if(thread) thread->checkError(); }
+
+				// Signaled after each EOF header has been sent
+				vglutil::Event eofSent;
+
+			private:
+
+				unsigned int seq;  bool frameOpen;
+				vglutil::Socket *socket;
+				vglutil::Thread *thread;
+				vglutil::GenericQ q;
+				VGLSession *parent;
+		};
+
 		class Compressor : public vglutil::Runnable
 		{
 			public:
 
-				Compressor(int myRank_, VGLTrans *parent_) : bytes(0),
+				Compressor(int myRank_, VGLSession *parent_) : bytes(0),
 					storedFrames(0), cframes(NULL), frame(NULL), lastFrame(NULL),
 					myRank(myRank_), deadYet(false), parent(parent_)
 				{
@@ -138,9 +282,67 @@ namespace vglserver
 				vglutil::Event ready, complete;  bool deadYet;
 				vglutil::CriticalSection mutex;
 				vglcommon::Profiler profComp;
-				VGLTrans *parent;
+				VGLSession *parent;
 		};
 	};
+
+
+	// A VGLTrans instance sends the frames from a single window.  Frames are
+	// queued in a one-deep spoiling slot until the window's session picks them
+	// up.
+	class VGLTrans
+	{
+		public:
+
+			VGLTrans(void);
+			virtual ~VGLTrans(void);
+			vglcommon::Frame *getFrame(int, int, int, int, bool stereo);
+			bool isReady(void);
+			void synchronize(void);
+			void sendFrame(vglcommon::Frame *);
+			bool canScale(void);
+			void save(char *fileName, int type);
+			void connect(char *, unsigned short);
+
+		private:
+
+			// The pool has VGL_POOLSIZE buffers (default: DEFPOOLSIZE.)  frameAge
+			// records when each buffer was last handed out.
+			static const int DEFPOOLSIZE=4;
+			vglutil::CriticalSection mutex;
+			vglcommon::Frame *frames;  int nFrames;
+			unsigned int *frameAge, nextAge;
+			vglutil::Event ready;
+			VGLSession *session;  bool deadYet;
+			int dpynum;
+
+			// The following are protected by the session mutex.
+			vglcommon::Frame *pending, *lastf;  bool busy;
+			int unacked;  unsigned int winid;
+			vglutil::Event idle, acked;
+			vglcommon::Profiler profTotal;
+			vglcommon::PoolProfiler profPool;
+			double nextTime;  VGLTrans *next;
+
+			// Latency measurement.  The readback times of each frame buffer are
+			// recorded by getFrame() and sendFrame(), and the session records the
+			// remaining server-side times of each frame it sends in stamps, which is
+			// indexed by the frame's sequence number.
+			static const int MAXSTAMPS=64;
+			unsigned int *readStart, *readEnd, frameSeq;
+			typedef struct
+			{
+				unsigned int seq, readStart, readEnd, dequeued, compressed;
+			} FrameStamp;
+			FrameStamp stamps[MAXSTAMPS];
+			vglcommon::LatencyProfiler profLatency;
+			vglutil::Timer timer;
+
+			// See save()
+			Capture *tileCapture, *frameCapture;
+
+			friend class VGLSession;
+	};
 }
 
 #endif // __VGLTRANS_H__
@@ -19,12 +19,14 @@
 #include <string.h>
 #include "glxvisual.h"
 #include "glext-vgl.h"
+#include "PixelConv.h"
 #include "TempContext.h"
 #include "vglutil.h"
 #include "faker.h"
 
 using namespace vglutil;
 using namespace vglserver;
+using namespace vglcommon;
 
 
 #define CHECKGL(m) if(glError()) _throw("Could not "m);
@@ -200,6 +202,10 @@ VirtualDrawable::VirtualDrawable(Display *dpy_, Drawable x11Draw_)
 	config=0;
 	ctx=0;
 	direct=-1;
+	scaleFBO[0]=scaleFBO[1]=scaleRBO[0]=scaleRBO[1]=0;
+	scaleWidth[0]=scaleWidth[1]=scaleHeight[0]=scaleHeight[1]=0;
+	useGPUScale=-1;
+	scaleBuf=NULL;  scaleBufSize=0;
 }
 
 
@@ -208,6 +214,7 @@ VirtualDrawable::~VirtualDrawable(void)
 	mutex.lock(false);
 	if(oglDraw) { delete oglDraw;  oglDraw=NULL; }
 	if(ctx) { _glXDestroyContext(_dpy3D, ctx);  ctx=0; }
+	if(scaleBuf) { delete [] scaleBuf;  scaleBuf=NULL; }
 	mutex.unlock(false);
 }
 
@@ -317,8 +324,13 @@ static const char *formatString(int format)
 }
 
 
+// If scale is greater than 1, then the drawable is scaled down by that factor
+// and stored in bits, which must be width x height pixels, where width and
+// height are the dimensions of the drawable divided by scale and rounded up.
+// x and y must be 0 in that case.
 void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
-	GLint height, GLenum format, int ps, GLubyte *bits, GLint buf, bool stereo)
+	GLint height, GLenum format, int ps, GLubyte *bits, GLint buf, bool stereo,
+	int scale)
 {
 	#ifdef GL_VERSION_1_5
 	static GLuint pbo=0;
@@ -352,15 +364,44 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 		if((ctx=_glXCreateNewContext(_dpy3D, config, GLX_RGBA_TYPE, NULL,
 			direct))==0)
 			_throw("Could not create OpenGL context for readback");
+		// Any scaling FBOs belonged to the previous context.
+		scaleFBO[0]=scaleFBO[1]=scaleRBO[0]=scaleRBO[1]=0;
+		scaleWidth[0]=scaleWidth[1]=scaleHeight[0]=scaleHeight[1]=0;
 	}
 	TempContext tc(_dpy3D, draw, read, ctx, config, GLX_RGBA_TYPE);
 
 	_glReadBuffer(buf);
 
-	if(pitch%8==0) _glPixelStorei(GL_PACK_ALIGNMENT, 8);
-	else if(pitch%4==0) _glPixelStorei(GL_PACK_ALIGNMENT, 4);
-	else if(pitch%2==0) _glPixelStorei(GL_PACK_ALIGNMENT, 2);
-	else if(pitch%1==0) _glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	// If the drawable cannot be scaled down on the GPU, then it is read back at
+	// full size into scaleBuf, the dimensions of which are padded to a multiple
+	// of the scaling factor.
+	GLint readWidth=width, readHeight=height, readPitch=pitch;
+	GLubyte *readBits=bits;
+	bool gpuScale=false, cpuScale=false;
+	if(scale>1)
+	{
+		if(!(gpuScale=downscaleGPU(width, height, scale)))
+		{
+			cpuScale=true;
+			readWidth=min(width*scale, oglDraw->getWidth());
+			readHeight=min(height*scale, oglDraw->getHeight());
+			readPitch=(width*scale*ps+3)&(~3);
+			if(!scaleBuf || scaleBufSize<readPitch*height*scale)
+			{
+				if(scaleBuf) { delete [] scaleBuf;  scaleBuf=NULL; }
+				scaleBufSize=0;
+				_newcheck(scaleBuf=new unsigned char[readPitch*height*scale]);
+				scaleBufSize=readPitch*height*scale;
+			}
+			readBits=scaleBuf;
+			_glPixelStorei(GL_PACK_ROW_LENGTH, width*scale);
+		}
+	}
+
+	if(readPitch%8==0) _glPixelStorei(GL_PACK_ALIGNMENT, 8);
+	else if(readPitch%4==0) _glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	else if(readPitch%2==0) _glPixelStorei(GL_PACK_ALIGNMENT, 2);
+	else if(readPitch%1==0) _glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
 	if(usePBO)
 	{
@@ -382,11 +423,11 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 		_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, pbo);
 		int size=0;
 		_glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER_EXT, GL_BUFFER_SIZE, &size);
-		if(size!=pitch*height)
-			_glBufferData(GL_PIXEL_PACK_BUFFER_EXT, pitch*height, NULL,
+		if(size!=readPitch*readHeight)
+			_glBufferData(GL_PIXEL_PACK_BUFFER_EXT, readPitch*readHeight, NULL,
 				GL_STREAM_READ);
 		_glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER_EXT, GL_BUFFER_SIZE, &size);
-		if(size!=pitch*height)
+		if(size!=readPitch*readHeight)
 			_throw("Could not set PBO size");
 		#else
 		_throw("PBO support not compiled in.  Rebuild VGL on a system that has OpenGL 1.5 or later.");
@@ -406,8 +447,8 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 	while(e!=GL_NO_ERROR) e=_glGetError();  // Clear previous error
 	profReadback.startFrame();
 	if(usePBO) t0=getTime();
-	_glReadPixels(x, y, width, height, format, GL_UNSIGNED_BYTE,
-		usePBO? NULL:bits);
+	_glReadPixels(x, y, readWidth, readHeight, format, GL_UNSIGNED_BYTE,
+		usePBO? NULL:readBits);
 
 	if(usePBO)
 	{
@@ -417,7 +458,7 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 		pboBits=(unsigned char *)_glMapBuffer(GL_PIXEL_PACK_BUFFER_EXT,
 			GL_READ_ONLY);
 		if(!pboBits) _throw("Could not map pixel buffer object");
-		memcpy(bits, pboBits, pitch*height);
+		memcpy(readBits, pboBits, readPitch*readHeight);
 		if(!_glUnmapBuffer(GL_PIXEL_PACK_BUFFER_EXT))
 			_throw("Could not unmap pixel buffer object");
 		_glBindBuffer(GL_PIXEL_PACK_BUFFER_EXT, 0);
@@ -449,7 +490,28 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 		}
 	}
 
-	profReadback.endFrame(width*height, 0, stereo? 0.5 : 1);
+	if(gpuScale) _glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, 0);
+	if(cpuScale)
+	{
+		_glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		// Replicate the last column and row of the drawable into the padding, so
+		// that the blocks along the right and top edges are not darkened.
+		int rowSize=width*scale*ps;
+		for(int i=0; i<readHeight; i++)
+		{
+			unsigned char *row=&scaleBuf[(long)readPitch*i];
+			for(int j=readWidth; j<width*scale; j++)
+				memcpy(&row[j*ps], &row[(readWidth-1)*ps], ps);
+		}
+		for(int i=readHeight; i<height*scale; i++)
+			memcpy(&scaleBuf[(long)readPitch*i],
+				&scaleBuf[(long)readPitch*(readHeight-1)], rowSize);
+		for(int i=0; i<height; i++)
+			PixelConv::downscale(&scaleBuf[(long)readPitch*i*scale], readPitch,
+				&bits[(long)pitch*i], width, ps, scale);
+	}
+
+	profReadback.endFrame(readWidth*readHeight, 0, stereo? 0.5 : 1);
 	CHECKGL("Read Pixels");
 
 	// If automatic faker testing is enabled, store the FB color in an
@@ -497,6 +559,72 @@ void VirtualDrawable::readPixels(GLint x, GLint y, GLint width, GLint pitch,
 }
 
 
+// Scale the drawable down into scaleFBO[0] on the GPU, and bind that FBO as
+// the read framebuffer.  Returns false if the GPU cannot do this.
+bool VirtualDrawable::downscaleGPU(int width, int height, int scale)
+{
+	if(useGPUScale<0)
+	{
+		const char *ext=(const char *)_glGetString(GL_EXTENSIONS);
+		useGPUScale=(ext && strstr(ext, "GL_EXT_framebuffer_object")
+			&& strstr(ext, "GL_EXT_framebuffer_blit"));
+		if(fconfig.verbose)
+			vglout.println("[VGL] Downscaling frames using the %s",
+				useGPUScale? "GPU":"CPU");
+	}
+	if(!useGPUScale) return false;
+
+	int e=_glGetError();
+	while(e!=GL_NO_ERROR) e=_glGetError();  // Clear previous error
+
+	// Linear filtering averages 2x2 blocks, so a factor of 4 requires two blits.
+	int srcWidth=oglDraw->getWidth(), srcHeight=oglDraw->getHeight();
+	GLuint readFBO=0;
+	for(int i=(scale==4? 1:0); i>=0; i--)
+	{
+		int w=i? (srcWidth+1)/2:width, h=i? (srcHeight+1)/2:height;
+		if(!scaleFBO[i])
+		{
+			_glGenFramebuffersEXT(1, &scaleFBO[i]);
+			_glGenRenderbuffersEXT(1, &scaleRBO[i]);
+		}
+		_glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, scaleFBO[i]);
+		if(w!=scaleWidth[i] || h!=scaleHeight[i])
+		{
+			_glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, scaleRBO[i]);
+			_glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, w, h);
+			_glFramebufferRenderbufferEXT(GL_DRAW_FRAMEBUFFER_EXT,
+				GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, scaleRBO[i]);
+			_glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+			scaleWidth[i]=w;  scaleHeight[i]=h;
+		}
+		if(readFBO)
+		{
+			_glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, readFBO);
+			_glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+		}
+		_glBlitFramebufferEXT(0, 0, srcWidth, srcHeight, 0, 0, w, h,
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		readFBO=scaleFBO[i];  srcWidth=w;  srcHeight=h;
+	}
+	_glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, 0);
+	_glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, readFBO);
+	_glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+
+	if(_glGetError()!=GL_NO_ERROR)
+	{
+		// This can happen if the drawable is multisampled, for instance.
+		while(_glGetError()!=GL_NO_ERROR) {}
+		_glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, 0);
+		if(fconfig.verbose)
+			vglout.println("[VGL] Could not downscale frames using the GPU.  Using the CPU instead.");
+		useGPUScale=0;
+		return false;
+	}
+	return true;
+}
+
+
 void VirtualDrawable::copyPixels(GLint srcX, GLint srcY, GLint width,
 	GLint height, GLint destX, GLint destY, GLXDrawable draw)
 {
@@ -86,7 +86,9 @@ namespace vglserver
 			};
 
 			void readPixels(GLint x, GLint y, GLint width, GLint pitch, GLint height,
-				GLenum format, int pixelSize, GLubyte *bits, GLint buf, bool stereo);
+				GLenum format, int pixelSize, GLubyte *bits, GLint buf, bool stereo,
+				int scale=1);
+			bool downscaleGPU(int width, int height, int scale);
 
 			vglutil::CriticalSection mutex;
 			Display *dpy;  Drawable x11Draw;
@@ -96,6 +98,16 @@ namespace vglserver
 			X11Trans *x11Trans;
 			vglcommon::Profiler profReadback;
 			int autotestFrameCount;
+
+			// If readPixels() is asked to scale the drawable down (see
+			// VGL_DOWNSCALE), then it blits the drawable into scaleFBO[0] on the GPU
+			// (through scaleFBO[1], which is half the size of the drawable, if the
+			// factor is 4) and reads back the result.  If the GPU cannot do that,
+			// then the drawable is read back at full size into scaleBuf and scaled
+			// down using a box filter.
+			GLuint scaleFBO[2], scaleRBO[2];  int scaleWidth[2], scaleHeight[2];
+			int useGPUScale;
+			unsigned char *scaleBuf;  int scaleBufSize;
 	};
 }
 
@@ -22,18 +22,24 @@ using namespace vglserver;
 
 
 VirtualPixmap::VirtualPixmap(Display *dpy_, XVisualInfo *vis, Pixmap pm)
-	: VirtualDrawable(dpy_, pm)
+	: VirtualDrawable(dpy_, pm), curFrame(0), dirty(true), reuseLast(false),
+	nCurrent(0)
 {
 	CriticalSection::SafeLock l(mutex);
 	profPMBlit.setName("PMap Blit ");
-	_newcheck(frame=new FBXFrame(dpy_, pm, vis->visual, true));
+	frames[0]=frames[1]=NULL;
+	_newcheck(frames[0]=new FBXFrame(dpy_, pm, vis->visual, true));
+	_newcheck(frames[1]=new FBXFrame(dpy_, pm, vis->visual, true));
 }
 
 
 VirtualPixmap::~VirtualPixmap()
 {
 	CriticalSection::SafeLock l(mutex);
-	if(frame) { delete frame;  frame=NULL; }
+	for(int i=0; i<2; i++)
+	{
+		if(frames[i]) { delete frames[i];  frames[i]=NULL; }
+	}
 }
 
 
@@ -53,10 +59,33 @@ int VirtualPixmap::init(int width, int height, int depth, GLXFBConfig config_,
 		_glXDestroyContext(_dpy3D, ctx);  ctx=0;
 	}
 	config=config_;
+	dirty=true;  reuseLast=false;
 	return 1;
 }
 
 
+// The GLX pixmap can only be rendered into while it is the current drawable of
+// some thread, so glXMake[Context]Current() tells us when that starts and
+// stops.  Until it is made current again, the pixels in the 3D pixmap cannot
+// change after the next readback.
+void VirtualPixmap::setCurrent(bool current)
+{
+	CriticalSection::SafeLock l(mutex);
+	if(current) { nCurrent++;  dirty=true; }
+	else if(nCurrent>0) nCurrent--;
+}
+
+
+// The 2D pixmap has been drawn into by something other than readback(), so it
+// no longer matches the last readback.  The next readback must draw all of
+// the tiles, even if the 3D pixmap has not changed.
+void VirtualPixmap::invalidate(void)
+{
+	CriticalSection::SafeLock l(mutex);
+	dirty=true;  reuseLast=false;
+}
+
+
 // Returns the X11 Pixmap on the 3D X server corresponding to the GLX Pixmap
 Pixmap VirtualPixmap::get3DX11Pixmap(void)
 {
@@ -72,8 +101,18 @@ void VirtualPixmap::readback(void)
 	fconfig_reloadenv();
 
 	CriticalSection::SafeLock l(mutex);
+	// Nothing has been rendered into the 3D pixmap since the last readback, so
+	// the 2D pixmap is already up to date.
+	if(!dirty && !nCurrent) return;
+
 	int width=oglDraw->getWidth(), height=oglDraw->getHeight();
 
+	// Alternate between two frames so that only the tiles that changed since
+	// the last readback have to be drawn into the 2D pixmap.
+	FBXFrame *last=frames[curFrame], *frame;
+	curFrame=(curFrame+1)%2;
+	frame=frames[curFrame];
+
 	rrframeheader hdr;
 	memset(&hdr, 0, sizeof(hdr));
 	hdr.x=hdr.y=0;
@@ -118,5 +157,8 @@ void VirtualPixmap::readback(void)
 		min(height, frame->hdr.frameh), format, frame->pixelSize, bits, GL_FRONT,
 		false);
 
-	frame->redraw();
+	frame->redraw(true, fconfig.interframe && reuseLast ? last : NULL,
+		fconfig.tilesize);
+	reuseLast=true;
+	if(!nCurrent) dirty=false;
 }
@@ -28,6 +28,8 @@ namespace vglserver
 			int init(int width, int height, int depth, GLXFBConfig config,
 				const int *attribs);
 			void readback(void);
+			void setCurrent(bool current);
+			void invalidate(void);
 			Pixmap get3DX11Pixmap(void);
 
 			XVisualInfo *getVisual(void)
@@ -38,7 +40,8 @@ namespace vglserver
 		private:
 
 			vglcommon::Profiler profPMBlit;
-			vglcommon::FBXFrame *frame;
+			vglcommon::FBXFrame *frames[2];  int curFrame;
+			bool dirty, reuseLast;  int nCurrent;
 	};
 }
 
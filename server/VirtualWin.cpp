@@ -243,6 +243,15 @@ void VirtualWin::wmDelete(void)
 }
 
 
+// The X server discarded part of the window's contents, so the X11 Transport
+// can't assume that the window still contains the previous frame.
+void VirtualWin::expose(void)
+{
+	CriticalSection::SafeLock l(mutex);
+	if(x11trans) x11trans->invalidate();
+}
+
+
 void VirtualWin::readback(GLint drawBuf, bool spoilLast, bool sync)
 {
 	fconfig_reloadenv();
@@ -319,6 +328,10 @@ void VirtualWin::readback(GLint drawBuf, bool spoilLast, bool sync)
 				_newcheck(vglconn=new VGLTrans());
 				vglconn->connect(strlen(fconfig.client)>0?
 					fconfig.client:DisplayString(dpy), fconfig.port);
+				if(strlen(fconfig.capture)>0)
+					vglconn->save(fconfig.capture, RRCAP_TILES);
+				if(strlen(fconfig.captureframes)>0)
+					vglconn->save(fconfig.captureframes, RRCAP_FRAMES);
 			}
 			sendVGL(drawBuf, spoilLast, doStereo, stereoMode, (int)compress,
 				fconfig.qual, fconfig.subsamp);
@@ -419,12 +432,20 @@ void VirtualWin::sendPlugin(GLint drawBuf, bool spoilLast, bool sync,
 void VirtualWin::sendVGL(GLint drawBuf, bool spoilLast, bool doStereo,
 	int stereoMode, int compress, int qual, int subsamp)
 {
-	int w=oglDraw->getWidth(), h=oglDraw->getHeight();
+	int w=oglDraw->getWidth(), h=oglDraw->getHeight(), scale=1;
 
 	if(spoilLast && fconfig.spoil && !vglconn->isReady())
 		return;
 	Frame *f;
 
+	// Anaglyphic and passive stereo frames are never scaled down.
+	if(fconfig.downscale>1 && vglconn->canScale()
+		&& !(doStereo && (isAnaglyphic(stereoMode) || isPassive(stereoMode))))
+	{
+		scale=fconfig.downscale;
+		w=(w+scale-1)/scale;  h=(h+scale-1)/scale;
+	}
+
 	int flags=FRAME_BOTTOMUP, format=GL_RGB, pixelsize=3;
 	if(compress!=RRCOMP_RGB)
 	{
@@ -444,6 +465,7 @@ void VirtualWin::sendVGL(GLint drawBuf, bool spoilLast, bool doStereo,
 	if(!fconfig.spoil) vglconn->synchronize();
 	_errifnot(f=vglconn->getFrame(w, h, pixelsize, flags,
 		doStereo && stereoMode==RRSTEREO_QUADBUF));
+	f->scale=scale;
 	if(doStereo && isAnaglyphic(stereoMode))
 	{
 		stereoFrame.deInit();
@@ -461,10 +483,10 @@ void VirtualWin::sendVGL(GLint drawBuf, bool spoilLast, bool doStereo,
 		if(doStereo || stereoMode==RRSTEREO_LEYE) buf=leye(drawBuf);
 		if(stereoMode==RRSTEREO_REYE) buf=reye(drawBuf);
 		readPixels(0, 0, f->hdr.framew, f->pitch, f->hdr.frameh, format,
-			f->pixelSize, f->bits, buf, doStereo);
+			f->pixelSize, f->bits, buf, doStereo, scale);
 		if(doStereo && f->rbits)
 			readPixels(0, 0, f->hdr.framew, f->pitch, f->hdr.frameh, format,
-				f->pixelSize, f->rbits, reye(drawBuf), doStereo);
+				f->pixelSize, f->rbits, reye(drawBuf), doStereo, scale);
 	}
 	f->hdr.winid=x11Draw;
 	f->hdr.framew=f->hdr.width;
@@ -602,7 +624,7 @@ void VirtualWin::sendXV(GLint drawBuf, bool spoilLast, bool sync,
 
 	if(fconfig.logo) frame.addLogo();
 
-	*f=frame;
+	xvtrans->encode(f, frame);
 	xvtrans->sendFrame(f, sync);
 }
 
@@ -651,10 +673,11 @@ void VirtualWin::makePassive(Frame *f, int drawBuf, int format, int stereoMode)
 
 
 void VirtualWin::readPixels(GLint x, GLint y, GLint width, GLint pitch,
-	GLint height, GLenum format, int ps, GLubyte *bits, GLint buf, bool stereo)
+	GLint height, GLenum format, int ps, GLubyte *bits, GLint buf, bool stereo,
+	int scale)
 {
 	VirtualDrawable::readPixels(x, y, width, pitch, height, format, ps, bits,
-		buf, stereo);
+		buf, stereo, scale);
 
 	// Gamma correction
 	if(fconfig.gamma!=0.0 && fconfig.gamma!=1.0 && fconfig.gamma!=-1.0)
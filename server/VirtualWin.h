@@ -44,6 +44,7 @@ namespace vglserver
 			void swapBuffers(void);
 			bool isStereo(void);
 			void wmDelete(void);
+			void expose(void);
 			int getSwapInterval(void) { return swapInterval; }
 			void setSwapInterval(int swapInterval_) { swapInterval=swapInterval_; }
 
@@ -53,7 +54,8 @@ namespace vglserver
 
 			int init(int w, int h, GLXFBConfig config);
 			void readPixels(GLint x, GLint y, GLint width, GLint pitch, GLint height,
-				GLenum format, int pixelSize, GLubyte *bits, GLint buf, bool stereo);
+				GLenum format, int pixelSize, GLubyte *bits, GLint buf, bool stereo,
+				int scale=1);
 			void makeAnaglyph(vglcommon::Frame *f, int drawBuf, int stereoMode);
 			void makePassive(vglcommon::Frame *f, int drawBuf, int format,
 				int stereoMode);
@@ -24,13 +24,19 @@ using namespace vglcommon;
 using namespace vglserver;
 
 
-X11Trans::X11Trans(void) : thread(NULL), deadYet(false)
+X11Trans::X11Trans(void) : nextAge(0), thread(NULL), deadYet(false),
+	fullRedraw(false)
 {
-	for(int i=0; i<NFRAMES; i++) frames[i]=NULL;
+	nFrames=fconfig.poolsize>0? fconfig.poolsize:DEFPOOLSIZE;
+	_newcheck(frames=new FBXFrame *[nFrames]);
+	_newcheck(frameAge=new unsigned int[nFrames]);
+	for(int i=0; i<nFrames; i++) { frames[i]=NULL;  frameAge[i]=0; }
 	_newcheck(thread=new Thread(this));
 	thread->start();
 	profBlit.setName("Blit      ");
 	profTotal.setName("Total     ");
+	profPool.setName("Pool      ");
+	profPool.setSize(nFrames);
 	if(fconfig.verbose) fbx_printwarnings(vglout.getFile());
 }
 
@@ -38,6 +44,7 @@ X11Trans::X11Trans(void) : thread(NULL), deadYet(false)
 void X11Trans::run(void)
 {
 	Timer timer, sleepTimer;  double err=0.;  bool first=true;
+	FBXFrame *lastFrame=NULL;
 
 	try
 	{
@@ -48,9 +55,24 @@ void X11Trans::run(void)
 			q.get(&ftemp);  f=(FBXFrame *)ftemp;  if(deadYet) return;
 			if(!f) _throw("Queue has been shut down");
 			ready.signal();
+
+			// Each frame has its own X connection, so the previous blit has to
+			// finish before this one is issued, or the X server could draw them
+			// out of order.  The previous frame isn't returned to the pool until
+			// this frame has been compared with it, and the X server may still be
+			// reading from its shared memory segment until the blit finishes.
+			if(lastFrame) lastFrame->waitUntilDrawn();
+
+			Frame *last=lastFrame;
+			{
+				CriticalSection::SafeLock l(mutex);
+				if(fullRedraw || !fconfig.interframe) last=NULL;
+				fullRedraw=false;
+			}
 			profBlit.startFrame();
-			f->redraw();
+			f->redraw(false, last, fconfig.tilesize);
 			profBlit.endFrame(f->hdr.width*f->hdr.height, 0, 1);
+			if(lastFrame) lastFrame->signalComplete();
 
 			profTotal.endFrame(f->hdr.width*f->hdr.height, 0, 1);
 			profTotal.startFrame();
@@ -79,13 +101,15 @@ void X11Trans::run(void)
 				timer.start();
 			}
 
-			f->signalComplete();
+			lastFrame=f;
 		}
 
 	}
 	catch(Error &e)
 	{
 		if(thread) thread->setError(e);
+		// Release the previous frame, in case getFrame() is waiting for it.
+		if(lastFrame) lastFrame->signalComplete();
 		ready.signal();  throw;
 	}
 }
@@ -93,22 +117,36 @@ void X11Trans::run(void)
 
 FBXFrame *X11Trans::getFrame(Display *dpy, Window win, int width, int height)
 {
-	FBXFrame *f=NULL;
+	FBXFrame *f=NULL;  bool blocked=false;
 
 	if(thread) thread->checkError();
 	{
 		CriticalSection::SafeLock l(mutex);
 
-		int index=-1;
-		for(int i=0; i<NFRAMES; i++)
-			if(!frames[i] || (frames[i] && frames[i]->isComplete()))
-				index=i;
-		if(index<0) _throw("No free buffers in pool");
+		// Use a free buffer if there is one.  Otherwise, use the buffer that was
+		// handed out the longest time ago, since it will be released first.
+		int index=-1, oldest=0;
+		for(int i=0; i<nFrames; i++)
+		{
+			if(!frames[i] || frames[i]->isComplete()) index=i;
+			else if(nextAge-frameAge[i]>nextAge-frameAge[oldest]) oldest=i;
+		}
+		if(index<0)
+		{
+			index=oldest;  blocked=true;
+		}
 		if(!frames[index])
 			_newcheck(frames[index]=new FBXFrame(dpy, win));
-		f=frames[index];  f->waitUntilComplete();
+		f=frames[index];  frameAge[index]=nextAge++;
 	}
 
+	// Don't hold the mutex while waiting, so the transport thread is never
+	// blocked by it.
+	Timer timer;
+	f->waitUntilComplete();
+	profPool.addGet(blocked? timer.elapsed():0.0);
+	if(blocked && thread) thread->checkError();
+
 	rrframeheader hdr;
 	memset(&hdr, 0, sizeof(hdr));
 	hdr.x=hdr.y=0;
@@ -147,7 +185,22 @@ void X11Trans::sendFrame(FBXFrame *f, bool sync)
 		f->redraw();
 		f->signalComplete();
 		profBlit.endFrame(f->hdr.width*f->hdr.height, 0, 1);
+		invalidate();
 		ready.signal();
 	}
-	else q.spoil((void *)f, __X11Trans_spoilfct);
+	else
+	{
+		int spoiled=q.spoil((void *)f, __X11Trans_spoilfct);
+		for(int i=0; i<spoiled; i++) profPool.addSpoiled();
+	}
+}
+
+
+// The next frame will be drawn in its entirety rather than only the parts of
+// it that have changed since the previous frame.  This is necessary if the
+// contents of the window may no longer match the previous frame.
+void X11Trans::invalidate(void)
+{
+	CriticalSection::SafeLock l(mutex);
+	fullRedraw=true;
 }
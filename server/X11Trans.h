@@ -35,29 +35,35 @@ namespace vglserver
 				deadYet=true;
 				q.release();
 				if(thread) { thread->stop();  delete thread;  thread=NULL; }
-				for(int i=0; i<NFRAMES; i++)
+				for(int i=0; i<nFrames; i++)
 				{
 					if(frames[i]) delete frames[i];  frames[i]=NULL;
 				}
+				delete [] frames;  delete [] frameAge;
 			}
 
 			bool isReady(void);
 			void synchronize(void);
 			void sendFrame(vglcommon::FBXFrame *, bool sync=false);
+			void invalidate(void);
 			void run(void);
 			vglcommon::FBXFrame *getFrame(Display *dpy, Window win, int width,
 				int height);
 
 		private:
 
-			static const int NFRAMES=3;
+			// The pool has VGL_POOLSIZE buffers (default: DEFPOOLSIZE.)  frameAge
+			// records when each buffer was last handed out.
+			static const int DEFPOOLSIZE=3;
 			vglutil::CriticalSection mutex;
-			vglcommon::FBXFrame *frames[NFRAMES];
+			vglcommon::FBXFrame **frames;  int nFrames;
+			unsigned int *frameAge, nextAge;
 			vglutil::Event ready;
 			vglutil::GenericQ q;
 			vglutil::Thread *thread;
-			bool deadYet;
+			bool deadYet, fullRedraw;
 			vglcommon::Profiler profBlit, profTotal;
+			vglcommon::PoolProfiler profPool;
 	};
 }
 
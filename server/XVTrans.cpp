@@ -24,13 +24,20 @@ using namespace vglcommon;
 using namespace vglserver;
 
 
-XVTrans::XVTrans(void) : thread(NULL), deadYet(false)
+XVTrans::XVTrans(void) : nextAge(0), thread(NULL), deadYet(false),
+	nEncoders(0), encoders(NULL), encoderThreads(NULL)
 {
-	for(int i=0; i<NFRAMES; i++) frames[i]=NULL;
+	nFrames=fconfig.poolsize>0? fconfig.poolsize:DEFPOOLSIZE;
+	_newcheck(frames=new XVFrame *[nFrames]);
+	_newcheck(frameAge=new unsigned int[nFrames]);
+	for(int i=0; i<nFrames; i++) { frames[i]=NULL;  frameAge[i]=0; }
 	_newcheck(thread=new Thread(this));
 	thread->start();
 	profXV.setName("XV        ");
 	profTotal.setName("Total     ");
+	profEncode.setName("Convert   ");
+	profPool.setName("Pool      ");
+	profPool.setSize(nFrames);
 	if(fconfig.verbose) fbxv_printwarnings(vglout.getFile());
 }
 
@@ -38,6 +45,7 @@ XVTrans::XVTrans(void) : thread(NULL), deadYet(false)
 void XVTrans::run(void)
 {
 	Timer timer, sleepTimer;  double err=0.;  bool first=true;
+	XVFrame *lastFrame=NULL;
 
 	try
 	{
@@ -48,8 +56,19 @@ void XVTrans::run(void)
 			q.get(&ftemp);  f=(XVFrame *)ftemp;  if(deadYet) return;
 			if(!f) throw("Queue has been shut down");
 			ready.signal();
+
+			// Each frame has its own X connection, so the previous image has to be
+			// drawn before this one is sent, or the X server could draw them out
+			// of order.  The previous frame isn't returned to the pool until then,
+			// since the X server may still be reading from its shared memory
+			// segment.
+			if(lastFrame)
+			{
+				lastFrame->waitUntilDrawn();  lastFrame->signalComplete();
+			}
+
 			profXV.startFrame();
-			f->redraw();
+			f->redraw(false);
 			profXV.endFrame(f->hdr.width*f->hdr.height, 0, 1);
 
 			profTotal.endFrame(f->hdr.width*f->hdr.height, 0, 1);
@@ -79,13 +98,15 @@ void XVTrans::run(void)
 				timer.start();
 			}
 
-			f->signalComplete();
+			lastFrame=f;
 		}
 
 	}
 	catch(Error &e)
 	{
 		if(thread) thread->setError(e);
+		// Release the previous frame, in case getFrame() is waiting for it.
+		if(lastFrame) lastFrame->signalComplete();
 		ready.signal();  throw;
 	}
 }
@@ -93,22 +114,36 @@ void XVTrans::run(void)
 
 XVFrame *XVTrans::getFrame(Display *dpy, Window win, int width, int height)
 {
-	XVFrame *f=NULL;
+	XVFrame *f=NULL;  bool blocked=false;
 
 	if(thread) thread->checkError();
 	{
 		CriticalSection::SafeLock l(mutex);
 
-		int index=-1;
-		for(int i=0; i<NFRAMES; i++)
-			if(!frames[i] || (frames[i] && frames[i]->isComplete()))
-				index=i;
-		if(index<0) _throw("No free buffers in pool");
+		// Use a free buffer if there is one.  Otherwise, use the buffer that was
+		// handed out the longest time ago, since it will be released first.
+		int index=-1, oldest=0;
+		for(int i=0; i<nFrames; i++)
+		{
+			if(!frames[i] || frames[i]->isComplete()) index=i;
+			else if(nextAge-frameAge[i]>nextAge-frameAge[oldest]) oldest=i;
+		}
+		if(index<0)
+		{
+			index=oldest;  blocked=true;
+		}
 		if(!frames[index])
 			_newcheck(frames[index]=new XVFrame(dpy, win));
-		f=frames[index];  f->waitUntilComplete();
+		f=frames[index];  frameAge[index]=nextAge++;
 	}
 
+	// Don't hold the mutex while waiting, so the transport thread is never
+	// blocked by it.
+	Timer timer;
+	f->waitUntilComplete();
+	profPool.addGet(blocked? timer.elapsed():0.0);
+	if(blocked && thread) thread->checkError();
+
 	rrframeheader hdr;
 	memset(&hdr, 0, sizeof(hdr));
 	hdr.x=hdr.y=0;
@@ -119,6 +154,92 @@ XVFrame *XVTrans::getFrame(Display *dpy, Window win, int width, int height)
 }
 
 
+// Convert src to YUV and store the result in f.  If VGL_NPROCS>1, then the
+// conversion is split into horizontal stripes, which are converted in
+// parallel.
+void XVTrans::encode(XVFrame *f, Frame &src)
+{
+	if(thread) thread->checkError();
+	if(!encoders)
+	{
+		int n=max(fconfig.np, 1);
+		_newcheck(encoders=new Encoder *[n]);
+		_newcheck(encoderThreads=new Thread *[n]);
+		for(int i=0; i<n; i++)
+		{
+			encoders[i]=NULL;  encoderThreads[i]=NULL;
+		}
+		nEncoders=n;
+		for(int i=0; i<nEncoders; i++)
+		{
+			_newcheck(encoders[i]=new Encoder());
+			if(i>0)
+			{
+				_newcheck(encoderThreads[i]=new Thread(encoders[i]));
+				encoderThreads[i]->start();
+			}
+		}
+	}
+
+	profEncode.startFrame();
+	f->init(src);
+
+	// Each stripe must start on an even row, since each row of chroma samples
+	// is shared by two rows of pixels.
+	int stripeHeight=(src.hdr.height/nEncoders)&(~1), n=nEncoders;
+	if(stripeHeight<2) { stripeHeight=src.hdr.height;  n=1; }
+	int started=1;
+	try
+	{
+		for(; started<n; started++)
+		{
+			int startY=started*stripeHeight;
+			int height=(started==n-1)? src.hdr.height-startY:stripeHeight;
+			encoderThreads[started]->checkError();
+			encoders[started]->go(f, &src, startY, height);
+		}
+		encoders[0]->encode(f, &src, 0, stripeHeight);
+	}
+	catch(...)
+	{
+		// Wait for the stripes that were started, so that they are no longer
+		// writing into f and their completion is not mistaken for that of the
+		// next frame's stripes.
+		for(int i=1; i<started; i++) encoders[i]->stop();
+		throw;
+	}
+	// Wait for all of the stripes before checking for errors.
+	for(int i=1; i<n; i++) encoders[i]->stop();
+	for(int i=1; i<n; i++) encoderThreads[i]->checkError();
+	profEncode.endFrame(src.hdr.width*src.hdr.height, 0, 1);
+}
+
+
+void XVTrans::Encoder::encode(XVFrame *dst, Frame *src, int startY,
+	int height)
+{
+	if(!tjhnd)
+	{
+		if((tjhnd=tjInitCompress())==NULL)
+			throw(Error("XVTrans::Encoder::encode", tjGetErrorStr()));
+	}
+	if(height<src->hdr.height)
+	{
+		unsigned long size=tjBufSizeYUV(src->hdr.width, height, TJ_420);
+		if(size>bufSize)
+		{
+			if(buf) free(buf);
+			if((buf=(unsigned char *)malloc(size))==NULL)
+			{
+				bufSize=0;  _throw("Memory allocation error");
+			}
+			bufSize=size;
+		}
+	}
+	dst->encode(*src, startY, height, tjhnd, buf);
+}
+
+
 bool XVTrans::isReady(void)
 {
 	if(thread) thread->checkError();
@@ -149,5 +270,9 @@ void XVTrans::sendFrame(XVFrame *f, bool sync)
 		profXV.endFrame(f->hdr.width*f->hdr.height, 0, 1);
 		ready.signal();
 	}
-	else q.spoil((void *)f, __XVTrans_spoilfct);
+	else
+	{
+		int spoiled=q.spoil((void *)f, __XVTrans_spoilfct);
+		for(int i=0; i<spoiled; i++) profPool.addSpoiled();
+	}
 }
@@ -35,10 +35,21 @@ namespace vglserver
 				deadYet=true;
 				q.release();
 				if(thread) { thread->stop();  delete thread;  thread=NULL; }
-				for(int i=0; i<NFRAMES; i++)
+				for(int i=0; i<nEncoders; i++)
+				{
+					if(encoders[i]) encoders[i]->shutdown();
+					if(encoderThreads[i])
+					{
+						encoderThreads[i]->stop();  delete encoderThreads[i];
+					}
+					delete encoders[i];
+				}
+				delete [] encoders;  delete [] encoderThreads;
+				for(int i=0; i<nFrames; i++)
 				{
 					if(frames[i]) delete frames[i];  frames[i]=NULL;
 				}
+				delete [] frames;  delete [] frameAge;
 			}
 
 			bool isReady(void);
@@ -46,17 +57,80 @@ namespace vglserver
 			void sendFrame(vglcommon::XVFrame *f, bool sync=false);
 			void run(void);
 			vglcommon::XVFrame *getFrame(Display *dpy, Window win, int w, int h);
+			void encode(vglcommon::XVFrame *f, vglcommon::Frame &src);
 
 		private:
 
-			static const int NFRAMES=3;
+			// Converts one horizontal stripe of each frame to YUV.  Encoder 0 runs
+			// in the application's thread, and the others run in their own threads.
+			class Encoder : public vglutil::Runnable
+			{
+				public:
+
+					Encoder(void) : tjhnd(NULL), buf(NULL), bufSize(0), dst(NULL),
+						src(NULL), startY(0), height(0), deadYet(false)
+					{
+						ready.wait();  complete.wait();
+					}
+
+					virtual ~Encoder(void)
+					{
+						if(tjhnd) tjDestroy(tjhnd);
+						if(buf) free(buf);
+					}
+
+					void run(void)
+					{
+						while(!deadYet)
+						{
+							try
+							{
+								ready.wait();  if(deadYet) break;
+								encode(dst, src, startY, height);
+								complete.signal();
+							}
+							catch(...)
+							{
+								complete.signal();  throw;
+							}
+						}
+					}
+
+					void go(vglcommon::XVFrame *dst_, vglcommon::Frame *src_,
+						int startY_, int height_)
+					{
+						dst=dst_;  src=src_;  startY=startY_;  height=height_;
+						ready.signal();
+					}
+
+					void stop(void) { complete.wait(); }
+					void shutdown(void) { deadYet=true;  ready.signal(); }
+					void encode(vglcommon::XVFrame *dst, vglcommon::Frame *src,
+						int startY, int height);
+
+				private:
+
+					tjhandle tjhnd;
+					unsigned char *buf;  unsigned long bufSize;
+					vglcommon::XVFrame *dst;  vglcommon::Frame *src;
+					int startY, height;
+					vglutil::Event ready, complete;  bool deadYet;
+			};
+
+			// The pool has VGL_POOLSIZE buffers (default: DEFPOOLSIZE.)  frameAge
+			// records when each buffer was last handed out.
+			static const int DEFPOOLSIZE=3;
 			vglutil::CriticalSection mutex;
-			vglcommon::XVFrame *frames[NFRAMES];
+			vglcommon::XVFrame **frames;  int nFrames;
+			unsigned int *frameAge, nextAge;
 			vglutil::Event ready;
 			vglutil::GenericQ q;
 			vglutil::Thread *thread;
 			bool deadYet;
-			vglcommon::Profiler profXV, profTotal;
+			int nEncoders;  Encoder **encoders;
+			vglutil::Thread **encoderThreads;
+			vglcommon::Profiler profXV, profTotal, profEncode;
+			vglcommon::PoolProfiler profPool;
 	};
 }
 
@@ -1701,10 +1701,13 @@ Bool glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
 	// it.
 	if(winhash.find(drawable, vw)) { vw->clear();  vw->cleanup(); }
 	VirtualPixmap *vpm;
+	if(retval && curdraw!=drawable && (vpm=pmhash.find(curdraw))!=NULL)
+		vpm->setCurrent(false);
 	if((vpm=pmhash.find(dpy, drawable))!=NULL)
 	{
 		vpm->clear();
 		vpm->setDirect(direct);
+		if(retval && curdraw!=drawable) vpm->setCurrent(true);
 	}
 
 	done:
@@ -1824,10 +1827,13 @@ Bool glXMakeContextCurrent(Display *dpy, GLXDrawable draw, GLXDrawable read,
 	if(winhash.find(draw, drawVW)) { drawVW->clear();  drawVW->cleanup(); }
 	if(winhash.find(read, readVW)) readVW->cleanup();
 	VirtualPixmap *vpm;
+	if(retval && curdraw!=draw && (vpm=pmhash.find(curdraw))!=NULL)
+		vpm->setCurrent(false);
 	if((vpm=pmhash.find(dpy, draw))!=NULL)
 	{
 		vpm->clear();
 		vpm->setDirect(direct);
+		if(retval && curdraw!=draw) vpm->setCurrent(true);
 	}
 
 	done:
@@ -298,6 +298,19 @@ namespace vglfaker
 		return retval; \
 	}
 
+#define VFUNCDEF10(f, at1, a1, at2, a2, at3, a3, at4, a4, at5, a5, at6, a6, \
+	at7, a7, at8, a8, at9, a9, at10, a10) \
+	typedef void (*_##f##Type)(at1, at2, at3, at4, at5, at6, at7, at8, at9, \
+		at10); \
+	SYMDEF(f); \
+	static inline void _##f(at1 a1, at2 a2, at3 a3, at4 a4, at5 a5, at6 a6, \
+		at7 a7, at8 a8, at9 a9, at10 a10) { \
+		CHECKSYM(f); \
+		DISABLE_FAKEXCB(); \
+		__##f(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10); \
+		ENABLE_FAKEXCB(); \
+	}
+
 #define FUNCDEF12(RetType, f, at1, a1, at2, a2, at3, a3, at4, a4, at5, a5, \
 	at6, a6, at7, a7, at8, a8, at9, a9, at10, a10, at11, a11, at12, a12) \
 	typedef RetType (*_##f##Type)(at1, at2, at3, at4, at5, at6, at7, at8, at9, \
@@ -633,9 +646,17 @@ FUNCDEF1(xcb_generic_event_t *, xcb_wait_for_event, xcb_connection_t *, conn);
 
 VFUNCDEF2(glBindBuffer, GLenum, target, GLuint, buffer);
 
+VFUNCDEF2(glBindFramebufferEXT, GLenum, target, GLuint, framebuffer);
+
+VFUNCDEF2(glBindRenderbufferEXT, GLenum, target, GLuint, renderbuffer);
+
 VFUNCDEF7(glBitmap, GLsizei, width, GLsizei, height, GLfloat, xorig,
 	GLfloat, yorig, GLfloat, xmove, GLfloat, ymove, const GLubyte *, bitmap);
 
+VFUNCDEF10(glBlitFramebufferEXT, GLint, srcX0, GLint, srcY0, GLint, srcX1,
+	GLint, srcY1, GLint, dstX0, GLint, dstY0, GLint, dstX1, GLint, dstY1,
+	GLbitfield, mask, GLenum, filter);
+
 VFUNCDEF4(glBufferData, GLenum, target, GLsizeiptr, size, const GLvoid *, data,
 	GLenum, usage);
 
@@ -657,8 +678,15 @@ VFUNCDEF5(glCopyPixels, GLint, x, GLint, y, GLsizei, width, GLsizei, height,
 
 VFUNCDEF0(glEndList);
 
+VFUNCDEF4(glFramebufferRenderbufferEXT, GLenum, target, GLenum, attachment,
+	GLenum, renderbuffertarget, GLuint, renderbuffer);
+
 VFUNCDEF2(glGenBuffers, GLsizei, n, GLuint *, buffers);
 
+VFUNCDEF2(glGenFramebuffersEXT, GLsizei, n, GLuint *, framebuffers);
+
+VFUNCDEF2(glGenRenderbuffersEXT, GLsizei, n, GLuint *, renderbuffers);
+
 VFUNCDEF3(glGetBufferParameteriv, GLenum, target, GLenum, value, GLint *,
 	data);
 
@@ -695,6 +723,9 @@ VFUNCDEF2(glRasterPos2i, GLint, x, GLint, y);
 
 VFUNCDEF1(glReadBuffer, GLenum, mode);
 
+VFUNCDEF4(glRenderbufferStorageEXT, GLenum, target, GLenum, internalformat,
+	GLsizei, width, GLsizei, height);
+
 VFUNCDEF7(glReadPixels, GLint, x, GLint, y, GLsizei, width, GLsizei, height,
 	GLenum, format, GLenum, type, GLvoid*, pixels);
 
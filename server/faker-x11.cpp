@@ -159,7 +159,11 @@ int XCopyArea(Display *dpy, Drawable src, Drawable dst, GC gc, int src_x,
 	}
 
 	if(copy2d)
+	{
 		_XCopyArea(dpy, src, dst, gc, src_x, src_y, width, height, dest_x, dest_y);
+		// The 2D pixmap no longer holds the last readback of the 3D pixmap.
+		if(dstVW && !dstWin) ((VirtualPixmap *)dstVW)->invalidate();
+	}
 
 	if(copy3d)
 	{
@@ -521,8 +525,8 @@ char *XServerVendor(Display *dpy)
 
 
 // The following functions are interposed so that VirtualGL can detect window
-// resizes, key presses (to pop up the VGL configuration dialog), and window
-// delete events from the window manager.
+// resizes, exposures, key presses (to pop up the VGL configuration dialog), and
+// window delete events from the window manager.
 
 static void handleEvent(Display *dpy, XEvent *xe)
 {
@@ -540,6 +544,10 @@ static void handleEvent(Display *dpy, XEvent *xe)
 				stoptrace();  closetrace();
 		}
 	}
+	else if(xe && xe->type==Expose)
+	{
+		if(winhash.find(dpy, xe->xexpose.window, vw)) vw->expose();
+	}
 	else if(xe && xe->type==KeyPress)
 	{
 		unsigned int state2, state=(xe->xkey.state)&(~(LockMask));
@@ -139,8 +139,8 @@ xcb_glx_query_version_reply_t *
 
 
 // The following functions are interposed so that VirtualGL can detect window
-// resizes, key presses (to pop up the VGL configuration dialog), and window
-// delete events from the window manager.
+// resizes, exposures, key presses (to pop up the VGL configuration dialog), and
+// window delete events from the window manager.
 
 static void handleXCBEvent(xcb_connection_t *conn, xcb_generic_event_t *e)
 {
@@ -169,6 +169,17 @@ static void handleXCBEvent(xcb_connection_t *conn, xcb_generic_event_t *e)
 
 			break;
 		}
+		case XCB_EXPOSE:
+		{
+			xcb_expose_event_t *ee=(xcb_expose_event_t *)e;
+			Display *dpy=xcbconnhash.getX11Display(conn);
+
+			if(!dpy || dpyhash.find(dpy)) break;
+
+			if(winhash.find(dpy, ee->window, vw)) vw->expose();
+
+			break;
+		}
 		case XCB_KEY_PRESS:
 		{
 			xcb_key_press_event_t *kpe=(xcb_key_press_event_t *)e;
@@ -161,6 +161,8 @@ static void fconfig_init(void)
 	memset(&fconfig_env, 0, sizeof(FakerConfig));
 	fconfig.compress=-1;
 	strncpy(fconfig.config, VGLCONFIG_PATH, MAXSTR);
+	fconfig.credits=2;
+	fconfig.downscale=1;
 	#ifdef FAKEXCB
 	fconfig.fakeXCB=1;
 	#endif
@@ -179,9 +181,11 @@ static void fconfig_init(void)
 	fconfig.readback=RRREAD_PBO;
 	fconfig.refreshrate=60.0;
 	fconfig.samples=-1;
+	fconfig.shm=1;
 	fconfig.spoil=1;
 	fconfig.spoillast=1;
 	fconfig.stereo=RRSTEREO_QUADBUF;
+	fconfig.streams=1;
 	fconfig.subsamp=-1;
 	fconfig.tilesize=RR_DEFAULTTILESIZE;
 	fconfig.transpixel=-1;
@@ -262,7 +266,10 @@ void fconfig_reloadenv(void)
 
 	fetchenv_bool("VGL_ALLOWINDIRECT", allowindirect);
 	fetchenv_bool("VGL_AUTOTEST", autotest);
+	fetchenv_str("VGL_CAPTURE", capture);
+	fetchenv_str("VGL_CAPTUREFRAMES", captureframes);
 	fetchenv_str("VGL_CLIENT", client);
+	fetchenv_int("VGL_CREDITS", credits, 0, 16);
 	if((env=getenv("VGL_SUBSAMP"))!=NULL && strlen(env)>0)
 	{
 		int subsamp=-1;
@@ -307,6 +314,13 @@ void fconfig_reloadenv(void)
 	}
 	fetchenv_str("VGL_CONFIG", config);
 	fetchenv_str("VGL_DEFAULTFBCONFIG", defaultfbconfig);
+	if((env=getenv("VGL_DOWNSCALE"))!=NULL && strlen(env)>0)
+	{
+		char *t=NULL;  int itemp=strtol(env, &t, 10);
+		if(t && t!=env && (itemp==1 || itemp==2 || itemp==4)
+			&& (!fconfig_envset || fconfig_env.downscale!=itemp))
+			fconfig.downscale=fconfig_env.downscale=itemp;
+	}
 	if((env=getenv("VGL_DISPLAY"))!=NULL && strlen(env)>0)
 	{
 		if(!fconfig_envset || strncmp(env, fconfig_env.localdpystring, MAXSTR-1))
@@ -397,6 +411,7 @@ void fconfig_reloadenv(void)
 	fetchenv_str("VGL_LOG", log);
 	fetchenv_bool("VGL_LOGO", logo);
 	fetchenv_int("VGL_NPROCS", np, 1, min(numprocs(), MAXPROCS));
+	fetchenv_int("VGL_POOLSIZE", poolsize, 2, RR_MAXPOOLSIZE);
 	fetchenv_int("VGL_PORT", port, 0, 65535);
 	fetchenv_bool("VGL_PROBEGLX", probeglx);
 	fetchenv_int("VGL_QUAL", qual, 1, 100);
@@ -416,9 +431,11 @@ void fconfig_reloadenv(void)
 	}
 	fetchenv_dbl("VGL_REFRESHRATE", refreshrate, 0.0, 1000000.0);
 	fetchenv_int("VGL_SAMPLES", samples, 0, 64);
+	fetchenv_bool("VGL_SHM", shm);
 	fetchenv_bool("VGL_SPOIL", spoil);
 	fetchenv_bool("VGL_SPOILLAST", spoillast);
 	fetchenv_bool("VGL_SSL", ssl);
+	fetchenv_int("VGL_STREAMS", streams, 1, RR_MAXSTREAMS);
 	{
 		if((env=getenv("VGL_STEREO"))!=NULL && strlen(env)>0)
 		{
@@ -450,6 +467,7 @@ void fconfig_reloadenv(void)
 	fetchenv_bool("VGL_VERBOSE", verbose);
 	fetchenv_bool("VGL_WM", wm);
 	fetchenv_str("VGL_X11LIB", x11lib);
+	fetchenv_bool("VGL_ZEROCOPY", zerocopy);
 	#ifdef FAKEXCB
 	fetchenv_str("VGL_XCBLIB", xcblib);
 	fetchenv_str("VGL_XCBGLXLIB", xcbglxlib);
@@ -578,10 +596,14 @@ void fconfig_setcompress(FakerConfig &fc, int i)
 void fconfig_print(FakerConfig &fc)
 {
 	prconfint(allowindirect);
+	prconfstr(capture);
+	prconfstr(captureframes);
 	prconfstr(client);
 	prconfint(compress);
 	prconfstr(config);
+	prconfint(credits);
 	prconfstr(defaultfbconfig);
+	prconfint(downscale);
 	prconfint(drawable);
 	prconfstr(excludeddpys);
 	prconfdbl(fps);
@@ -599,14 +621,17 @@ void fconfig_print(FakerConfig &fc)
 	prconfstr(log);
 	prconfint(logo);
 	prconfint(np);
+	prconfint(poolsize);
 	prconfint(port);
 	prconfint(qual);
 	prconfint(readback);
 	prconfint(samples);
+	prconfint(shm);
 	prconfint(spoil);
 	prconfint(spoillast);
 	prconfint(ssl);
 	prconfint(stereo);
+	prconfint(streams);
 	prconfint(subsamp);
 	prconfint(sync);
 	prconfint(tilesize);
@@ -620,6 +645,7 @@ void fconfig_print(FakerConfig &fc)
 	prconfint(verbose);
 	prconfint(wm);
 	prconfstr(x11lib);
+	prconfint(zerocopy);
 	#ifdef FAKEXCB
 	prconfstr(xcblib);
 	prconfstr(xcbglxlib);
@@ -0,0 +1,342 @@
+/* Copyright (C)2014 D. R. Commander
+ *
+ * This library is free software and may be redistributed and/or modified under
+ * the terms of the wxWindows Library License, Version 3.1 or (at your option)
+ * any later version.  The full license is in the LICENSE.txt file included
+ * with this distribution.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * wxWindows Library License for more details.
+ */
+
+// Replays a capture file recorded with VGL_CAPTURE or VGL_CAPTUREFRAMES.
+// Frames are compressed and tiles are decompressed in this process, using the
+// same code paths as the VGL Transport and vglclient, so no GPU or X server is
+// needed unless the frames are sent to a VirtualGL Client.
+
+#include "VGLTrans.h"
+#include "Capture.h"
+#include "vglutil.h"
+#include "Timer.h"
+#include "fakerconfig.h"
+
+using namespace vglutil;
+using namespace vglcommon;
+using namespace vglserver;
+
+
+bool pace=false;  int loops=1, compress=-1, qual=-1, subsamp=-1;
+Timer timer;  double start=0.;
+
+
+void usage(char **argv)
+{
+	printf("\nUSAGE: %s <capture file> [-pace] [-loop <n>]\n", argv[0]);
+	printf("       [-client <machine:x.x>] [-samp <n>] [-qual <n>] [-rgb] [-jpeg]\n");
+	printf("       [-tilesize <n>] [-interframe]\n\n");
+	printf("-pace = Replay the capture with its original timing [default = full speed]\n");
+	printf("-loop <n> = Replay the capture n times [default = 1]\n\n");
+	printf("The following options apply only to frame captures:\n\n");
+	printf("-client = X Display where the frames should be sent through the VGL Transport\n");
+	printf("          (VGL client must be running on that machine) [default = compress\n");
+	printf("          the frames locally and discard them]\n");
+	printf("-samp = JPEG chrominance subsampling factor: 0 (gray), 1, 2, or 4\n");
+	printf("        [default = same as capture]\n");
+	printf("-qual = JPEG quality, 1-100 inclusive [default = same as capture]\n");
+	printf("-rgb = Use RGB (uncompressed) encoding [default = same as capture]\n");
+	printf("-jpeg = Use JPEG encoding [default = same as capture]\n");
+	printf("-tilesize = width/height of each tile [default = %d]\n",
+		fconfig.tilesize);
+	printf("-interframe = Skip tiles that have not changed since the previous frame\n");
+	printf("\n");
+	exit(1);
+}
+
+
+// Wait until the time at which the record was captured
+void wait(rrcaprecord &rec, double loopStart)
+{
+	if(!pace) return;
+	double delay=loopStart+(double)rec.time/1000000.-timer.time();
+	if(delay>0.) usleep((long)(delay*1000000.));
+}
+
+
+// Compress the frames from a frame capture, splitting them into tiles in the
+// same manner as the VGL Transport
+void compressFrames(CaptureReader &reader)
+{
+	rrcaprecord rec;  rrframeheader h;
+	unsigned char *data=NULL;  unsigned int size;
+	Frame frames[2], *f=NULL, *lastf=NULL;
+	double pixels=0., bytes=0., elapsed=0.;  int nFrames=0, n=0;
+
+	for(int loop=0; loop<loops; loop++)
+	{
+		double loopStart=timer.time();
+		reader.rewind();
+		while(reader.read(rec, h, &data, size))
+		{
+			wait(rec, loopStart);
+			if(h.width!=h.framew || h.height!=h.frameh || rec.pixelSize<1
+				|| size!=(unsigned int)(h.width*h.height*rec.pixelSize))
+				_throw("Invalid frame record");
+			if(compress>=0) h.compress=compress;
+			if(qual>=0) h.qual=qual;
+			if(subsamp>=0) h.subsamp=subsamp;
+			f=&frames[n];  n=1-n;
+			h.size=0;  h.flags=0;
+			f->init(h, rec.pixelSize, rec.flags);
+			memcpy(f->bits, data, size);
+
+			double t0=timer.time();
+			if(h.compress==RRCOMP_YUV)
+			{
+				CompressedFrame cf;
+				cf=*f;  bytes+=cf.hdr.size;
+			}
+			else
+			{
+				int tilesizex=fconfig.tilesize? fconfig.tilesize:h.width;
+				int tilesizey=fconfig.tilesize? fconfig.tilesize:h.height;
+				for(int i=0; i<h.height; i+=tilesizey)
+				{
+					int height=tilesizey, y=i;
+					if(h.height-i<(3*tilesizey/2))
+					{
+						height=h.height-i;  i+=tilesizey;
+					}
+					for(int j=0; j<h.width; j+=tilesizex)
+					{
+						int width=tilesizex, x=j;
+						if(h.width-j<(3*tilesizex/2))
+						{
+							width=h.width-j;  j+=tilesizex;
+						}
+						if(fconfig.interframe && lastf
+							&& f->tileEquals(lastf, x, y, width, height))
+							continue;
+						Frame *tile=f->getTile(x, y, width, height);
+						CompressedFrame cf;
+						cf=*tile;  bytes+=cf.hdr.size;
+						delete tile;
+					}
+				}
+			}
+			elapsed+=timer.time()-t0;
+			pixels+=(double)h.width*(double)h.height;  nFrames++;
+			lastf=f;
+		}
+	}
+
+	printf("Compressed %d frames\n", nFrames);
+	if(elapsed>0. && bytes>0.)
+	{
+		printf("%f Megapixels/sec\n", pixels/1000000./elapsed);
+		printf("%f frames/sec\n", (double)nFrames/elapsed);
+		printf("Compression ratio: %.2f:1 (%f Megabits/frame)\n",
+			pixels*3./bytes, bytes*8./1000000./(double)nFrames);
+	}
+}
+
+
+// Send the frames from a frame capture to a VirtualGL Client
+void sendFrames(CaptureReader &reader)
+{
+	rrcaprecord rec;  rrframeheader h;
+	unsigned char *data=NULL;  unsigned int size;
+	Display *dpy=NULL;  Window win=0;
+	double pixels=0.;  int nFrames=0;
+
+	if(!XInitThreads()) _throw("Could not initialize X threads");
+	if((dpy=XOpenDisplay(0))==NULL) _throw("Could not open display");
+	try
+	{
+		VGLTrans vglconn;
+		Frame *f;
+
+		fconfig_setdefaultsfromdpy(dpy);
+		vglconn.connect(fconfig.client, fconfig.port);
+		start=timer.time();
+		for(int loop=0; loop<loops; loop++)
+		{
+			double loopStart=timer.time();
+			reader.rewind();
+			while(reader.read(rec, h, &data, size))
+			{
+				wait(rec, loopStart);
+				if(h.width!=h.framew || h.height!=h.frameh || rec.pixelSize<1
+					|| size!=(unsigned int)(h.width*h.height*rec.pixelSize))
+					_throw("Invalid frame record");
+				if(!win)
+				{
+					if((win=XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0,
+						h.width, h.height, 0, WhitePixel(dpy, DefaultScreen(dpy)),
+						BlackPixel(dpy, DefaultScreen(dpy))))==0)
+						_throw("Could not create window");
+					_errifnot(XMapRaised(dpy, win));
+					XSync(dpy, False);
+				}
+				vglconn.synchronize();
+				_errifnot(f=vglconn.getFrame(h.width, h.height, rec.pixelSize,
+					rec.flags, false));
+				memcpy(f->bits, data, size);
+				f->hdr.qual=qual>=0? qual:h.qual;
+				f->hdr.subsamp=subsamp>=0? subsamp:h.subsamp;
+				f->hdr.compress=compress>=0? compress:h.compress;
+				f->hdr.winid=win;
+				vglconn.sendFrame(f);
+				pixels+=(double)h.width*(double)h.height;  nFrames++;
+			}
+		}
+		vglconn.synchronize();
+		double elapsed=timer.time()-start;
+		printf("Sent %d frames\n", nFrames);
+		if(elapsed>0.)
+		{
+			printf("%f Megapixels/sec\n", pixels/1000000./elapsed);
+			printf("%f frames/sec\n", (double)nFrames/elapsed);
+		}
+	}
+	catch(...)
+	{
+		if(win) XDestroyWindow(dpy, win);
+		XCloseDisplay(dpy);
+		throw;
+	}
+	if(win) XDestroyWindow(dpy, win);
+	XCloseDisplay(dpy);
+}
+
+
+// Decompress the tiles from a tile capture into a frame buffer, in the same
+// manner as vglclient
+void decompressTiles(CaptureReader &reader)
+{
+	rrcaprecord rec;  rrframeheader h;
+	unsigned char *data=NULL;  unsigned int size;
+	Frame fb;  CompressedFrame cf;
+	tjhandle tjhnd=NULL;
+	double pixels=0., bytes=0., elapsed=0.;  int nFrames=0, nTiles=0;
+
+	if((tjhnd=tjInitDecompress())==NULL) _throw(tjGetErrorStr());
+	try
+	{
+		for(int loop=0; loop<loops; loop++)
+		{
+			double loopStart=timer.time();
+			reader.rewind();
+			while(reader.read(rec, h, &data, size))
+			{
+				wait(rec, loopStart);
+				if(h.flags==RR_EOF)
+				{
+					nFrames++;  continue;
+				}
+				bytes+=size;  nTiles++;
+				// YUV images are decoded by X Video, and right-eye tiles are
+				// decoded in the same manner as left-eye tiles, so neither is
+				// decoded here.
+				if(h.compress==RRCOMP_YUV || h.flags==RR_RIGHT) continue;
+
+				double t0=timer.time();
+				if(h.framew!=fb.hdr.framew || h.frameh!=fb.hdr.frameh)
+				{
+					rrframeheader fbh=h;
+					fbh.x=fbh.y=0;  fbh.width=h.framew;  fbh.height=h.frameh;
+					fbh.size=0;
+					fb.init(fbh, 4, FRAME_BGR);
+				}
+				int width=min(h.width, fb.hdr.framew-h.x);
+				int height=min(h.height, fb.hdr.frameh-h.y);
+				if(width<1 || height<1 || h.width>width || h.height>height)
+					_throw("Invalid tile record");
+				if(h.compress==RRCOMP_RGB)
+				{
+					cf.init(h, h.flags);
+					cf.setBits(data, h.flags);
+					fb.decompressRGB(cf, width, height, false);
+				}
+				else
+				{
+					if(tjDecompress(tjhnd, data, size,
+						&fb.bits[fb.pitch*h.y+h.x*fb.pixelSize], width, fb.pitch,
+						height, fb.pixelSize, TJ_BGR)==-1)
+						_throw(tjGetErrorStr());
+				}
+				elapsed+=timer.time()-t0;
+				pixels+=(double)width*(double)height;
+			}
+		}
+	}
+	catch(...)
+	{
+		tjDestroy(tjhnd);  throw;
+	}
+	tjDestroy(tjhnd);
+
+	printf("Decompressed %d tiles (%d frames)\n", nTiles, nFrames);
+	if(elapsed>0.)
+	{
+		printf("%f Megapixels/sec\n", pixels/1000000./elapsed);
+		printf("%f Megabits/sec of compressed input\n",
+			bytes*8./1000000./elapsed);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	bool send=false;
+
+	try
+	{
+		if(argc<2) usage(argv);
+		fconfig.interframe=0;
+
+		for(int i=2; i<argc; i++)
+		{
+			if(!stricmp(argv[i], "-pace")) pace=true;
+			else if(!stricmp(argv[i], "-loop") && i<argc-1)
+			{
+				loops=atoi(argv[++i]);  if(loops<1) usage(argv);
+			}
+			else if(!strnicmp(argv[i], "-cl", 3) && i<argc-1)
+			{
+				strncpy(fconfig.client, argv[++i], MAXSTR-1);  send=true;
+			}
+			else if(!strnicmp(argv[i], "-sa", 3) && i<argc-1)
+				subsamp=atoi(argv[++i]);
+			else if(!strnicmp(argv[i], "-q", 2) && i<argc-1)
+				qual=atoi(argv[++i]);
+			else if(!stricmp(argv[i], "-rgb")) compress=RRCOMP_RGB;
+			else if(!stricmp(argv[i], "-jpeg")) compress=RRCOMP_JPEG;
+			else if(!stricmp(argv[i], "-tilesize") && i<argc-1)
+				fconfig.tilesize=atoi(argv[++i]);
+			else if(!stricmp(argv[i], "-interframe")) fconfig.interframe=1;
+			else usage(argv);
+		}
+
+		CaptureReader reader(argv[1]);
+		if(reader.getType()==RRCAP_FRAMES)
+		{
+			printf("Frame capture: %s\n", argv[1]);
+			if(send) sendFrames(reader);
+			else compressFrames(reader);
+		}
+		else
+		{
+			printf("Tile capture: %s\n", argv[1]);
+			if(send) _throw("-client cannot be used with tile captures");
+			decompressTiles(reader);
+		}
+	}
+	catch(Error &e)
+	{
+		printf("%s--\n%s\n", e.getMethod(), e.getMessage());
+		return 1;
+	}
+	return 0;
+}
@@ -52,19 +52,22 @@ void GenericQ::release(void)
 }
 
 
-void GenericQ::spoil(void *item, SpoilCallback spoilCallback)
+// Returns the number of items that were spoiled
+int GenericQ::spoil(void *item, SpoilCallback spoilCallback)
 {
-	if(deadYet) return;
+	int spoiled=0;
+	if(deadYet) return 0;
 	if(item==NULL) _throw("NULL argument in GenericQ::spoil()");
 	CriticalSection::SafeLock l(mutex);
-	if(deadYet) return;
+	if(deadYet) return 0;
 	void *dummy=NULL;
 	while(1)
 	{
 		get(&dummy, true);   if(!dummy) break;
-		spoilCallback(dummy);
+		spoilCallback(dummy);  spoiled++;
 	}
 	add(item);
+	return spoiled;
 }
 
 
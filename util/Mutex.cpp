@@ -16,6 +16,8 @@
 #include "Mutex.h"
 #ifndef _WIN32
 #include <string.h>
+#include <errno.h>
+#include <sys/time.h>
 #endif
 #include "Error.h"
 
@@ -87,6 +89,44 @@ void Event::wait(void)
 }
 
 
+// Wait for no more than timeout seconds.  Returns false if the event was not
+// signaled within that time.
+bool Event::wait(double timeout)
+{
+	#ifdef _WIN32
+
+	DWORD dw=WaitForSingleObject(event, (DWORD)(timeout*1000.));
+	if(dw==WAIT_FAILED) throw(W32Error("Event::wait()"));
+	return dw==WAIT_OBJECT_0;
+
+	#else
+
+	struct timeval now;  struct timespec until;
+	bool ret;  int err=0;
+
+	if(timeout<0.) timeout=0.;
+	gettimeofday(&now, NULL);
+	long long nsec=(long long)now.tv_usec*1000LL
+		+(long long)((timeout-(double)(long)timeout)*1000000000.);
+	until.tv_sec=now.tv_sec+(long)timeout+(long)(nsec/1000000000LL);
+	until.tv_nsec=(long)(nsec%1000000000LL);
+	if((err=pthread_mutex_lock(&mutex))!=0)
+		throw(Error("Event::wait()", strerror(err)));
+	while(!ready && !deadYet)
+	{
+		if((err=pthread_cond_timedwait(&cond, &mutex, &until))!=0) break;
+	}
+	ret=ready || deadYet;
+	ready=false;
+	pthread_mutex_unlock(&mutex);
+	if(err!=0 && err!=ETIMEDOUT)
+		throw(Error("Event::wait()", strerror(err)));
+	return ret;
+
+	#endif
+}
+
+
 void Event::signal(void)
 {
 	#ifdef _WIN32
@@ -25,6 +25,11 @@
  #include <arpa/inet.h>
  #include <netdb.h>
  #include <netinet/tcp.h>
+ #include <limits.h>
+ #ifdef USEZEROCOPY
+ #include <poll.h>
+ #include <linux/errqueue.h>
+ #endif
  #define SOCKET_ERROR -1
  #define INVALID_SOCKET -1
 #endif
@@ -43,8 +48,10 @@ typedef socklen_t SOCKLEN_T;
 
 #ifdef USESSL
 bool Socket::sslInit=false;
+#if OPENSSL_VERSION_NUMBER<0x10100000L
 CriticalSection Socket::cryptoLock[CRYPTO_NUM_LOCKS];
 #endif
+#endif
 CriticalSection Socket::mutex;
 int Socket::instanceCount=0;
 
@@ -159,8 +166,10 @@ Socket::Socket(bool doSSL_=false)
 		OpenSSL_add_all_algorithms();
 		SSL_load_error_strings();
 		ERR_load_crypto_strings();
+		#if OPENSSL_VERSION_NUMBER<0x10100000L
 		CRYPTO_set_id_callback(Thread::threadID);
 		CRYPTO_set_locking_callback(lockingCallback);
+		#endif
 		SSL_library_init();
 		sslInit=true;
 		char *env=NULL;
@@ -169,18 +178,22 @@ Socket::Socket(bool doSSL_=false)
 			fprintf(stderr, "[VGL] Using OpenSSL version %s\n",
 				SSLeay_version(SSLEAY_VERSION));
 	}
-	ssl=NULL;  sslctx=NULL;
+	ssl=NULL;  sslctx=NULL;  sslBuf=NULL;  sslBufBytes=0;
+	ktlsSend=ktlsRecv=false;
 	#endif
 
 	sd=INVALID_SOCKET;
+	zeroCopy=false;  zcNext=zcDone=0;  nzcRanges=0;
 }
 
 
 #ifdef USESSL
 Socket::Socket(SOCKET sd_, SSL *ssl_)
-	: sslctx(NULL), ssl(ssl_), sd(sd_)
+	: sslctx(NULL), ssl(ssl_), ktlsSend(false), ktlsRecv(false), sslBuf(NULL),
+	sslBufBytes(0), sd(sd_), zeroCopy(false), zcNext(0), zcDone(0), nzcRanges(0)
 {
 	if(ssl) doSSL=true;  else doSSL=false;
+	if(ssl) checkKTLS();
 	#ifdef _WIN32
 	CriticalSection::SafeLock l(mutex);
 	instanceCount++;
@@ -188,7 +201,7 @@ Socket::Socket(SOCKET sd_, SSL *ssl_)
 }
 #else
 Socket::Socket(SOCKET sd_)
-	: sd(sd_)
+	: sd(sd_), zeroCopy(false), zcNext(0), zcDone(0), nzcRanges(0)
 {
 	#ifdef _WIN32
 	CriticalSection::SafeLock l(mutex);
@@ -220,6 +233,11 @@ void Socket::close(void)
 	{
 		SSL_CTX_free(sslctx);  sslctx=NULL;
 	}
+	if(sslBuf)
+	{
+		delete [] sslBuf;  sslBuf=NULL;
+	}
+	sslBufBytes=0;  ktlsSend=ktlsRecv=false;
 	#endif
 	if(sd!=INVALID_SOCKET)
 	{
@@ -265,11 +283,14 @@ void Socket::connect(char *serverName, unsigned short port)
 	if(doSSL)
 	{
 		if((sslctx=SSL_CTX_new(SSLv23_client_method()))==NULL) _throwssl();
+		#ifdef USEKTLS
+		SSL_CTX_set_options(sslctx, SSL_OP_ENABLE_KTLS);
+		#endif
 		if((ssl=SSL_new(sslctx))==NULL) _throwssl();
 		if(!SSL_set_fd(ssl, (int)sd)) _throwssl();
 		int ret=SSL_connect(ssl);
 		if(ret!=1) throw(SSLError("Socket::connect", ssl, ret));
-		SSL_set_connect_state(ssl);
+		checkKTLS();
 	}
 	#endif
 }
@@ -327,7 +348,10 @@ unsigned short Socket::listen(unsigned short port, bool reuseAddr)
 		try
 		{
 			if((sslctx=SSL_CTX_new(SSLv23_server_method()))==NULL) _throwssl();
-			_errifnot(priv=newPrivateKey(1024));
+			#ifdef USEKTLS
+			SSL_CTX_set_options(sslctx, SSL_OP_ENABLE_KTLS);
+			#endif
+			_errifnot(priv=newPrivateKey(2048));
 			_errifnot(cert=newCert(priv));
 			if(SSL_CTX_use_certificate(sslctx, cert)<=0)
 				_throwssl();
@@ -374,7 +398,6 @@ Socket *Socket::accept(void)
 		if(!(SSL_set_fd(tempssl, (int)clientsd))) _throwssl();
 		int ret=SSL_accept(tempssl);
 		if(ret!=1) throw(SSLError("Socket::accept", tempssl, ret));
-		SSL_set_accept_state(tempssl);
 	}
 	return new Socket(clientsd, tempssl);
 	#else
@@ -404,9 +427,9 @@ void Socket::send(char *buf, int len)
 	while(bytesSent<len)
 	{
 		#ifdef USESSL
-		if(doSSL)
+		if(doSSL && !ktlsSend)
 		{
-			retval=SSL_write(ssl, &buf[bytesSent], len);
+			retval=SSL_write(ssl, &buf[bytesSent], len-bytesSent);
 			if(retval<=0) throw(SSLError("Socket::send", ssl, retval));
 		}
 		else
@@ -422,6 +445,117 @@ void Socket::send(char *buf, int len)
 }
 
 
+#ifdef USESSL
+
+// OpenSSL hands the session keys to the kernel after the handshake if the
+// kernel supports the negotiated cipher (AES-GCM, in most cases.)  Outgoing
+// data can then be written to the socket directly, which avoids encrypting it
+// in user space and allows it to be gathered from multiple buffers.  Incoming
+// data is still read with SSL_read(), since OpenSSL must process any TLS
+// control messages, but OpenSSL no longer decrypts it if receive offload is
+// also enabled.
+void Socket::checkKTLS(void)
+{
+	#ifdef USEKTLS
+	ktlsSend=BIO_get_ktls_send(SSL_get_wbio(ssl));
+	ktlsRecv=BIO_get_ktls_recv(SSL_get_rbio(ssl));
+	#endif
+	char *env=NULL;
+	if((env=getenv("VGL_VERBOSE"))!=NULL && strlen(env)>0
+		&& !strncmp(env, "1", 1))
+		fprintf(stderr, "[VGL] SSL cipher: %s  Kernel TLS: %s\n",
+			SSL_get_cipher(ssl), ktlsSend && ktlsRecv? "send/receive":
+			ktlsSend? "send":ktlsRecv? "receive":"disabled");
+}
+
+
+void Socket::sslFlush(void)
+{
+	if(sslBufBytes>0)
+	{
+		int bytes=sslBufBytes;
+		sslBufBytes=0;
+		send(sslBuf, bytes);
+	}
+}
+
+#endif
+
+
+void Socket::send(struct iovec *iov, int count)
+{
+	if(sd==INVALID_SOCKET) _throw("Not connected");
+	if(!iov || count<0) _throw("Invalid argument");
+	#ifdef USESSL
+	if(doSSL && !ssl) _throw("SSL not connected");
+
+	// SSL has no gather API, so copy small buffers into a single record and
+	// send large buffers directly.  This is unnecessary if the kernel is
+	// encrypting the data.
+	if(doSSL && !ktlsSend)
+	{
+		if(!sslBuf) _newcheck(sslBuf=new char[SSLBUFSIZE]);
+		for(int i=0; i<count; i++)
+		{
+			int len=(int)iov[i].iov_len;
+			if(len<=0) continue;
+			if(sslBufBytes+len>SSLBUFSIZE) sslFlush();
+			if(len<=SSLBUFSIZE/4)
+			{
+				memcpy(&sslBuf[sslBufBytes], iov[i].iov_base, len);
+				sslBufBytes+=len;
+			}
+			else
+			{
+				sslFlush();
+				send((char *)iov[i].iov_base, len);
+			}
+		}
+		sslFlush();
+		return;
+	}
+	#endif
+
+	#ifdef _WIN32
+
+	for(int i=0; i<count; i++)
+		if(iov[i].iov_len>0) send((char *)iov[i].iov_base, (int)iov[i].iov_len);
+
+	#else
+
+	#ifdef IOV_MAX
+	const int maxiov=IOV_MAX;
+	#else
+	const int maxiov=16;
+	#endif
+	while(count>0)
+	{
+		if(iov->iov_len==0) { iov++;  count--;  continue; }
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov=iov;  msg.msg_iovlen=count<maxiov? count:maxiov;
+		ssize_t retval=::sendmsg(sd, &msg, 0);
+		if(retval==SOCKET_ERROR) _throwsock();
+		if(retval==0) _throw("Incomplete send");
+
+		// Skip the buffers that were completely sent, and adjust the first
+		// partially-sent buffer so that the next sendmsg() picks up where this one
+		// left off.
+		while(count>0 && retval>=(ssize_t)iov->iov_len)
+		{
+			retval-=iov->iov_len;  iov++;  count--;
+		}
+		if(count>0 && retval>0)
+		{
+			iov->iov_base=(char *)iov->iov_base+retval;
+			iov->iov_len-=retval;
+		}
+	}
+
+	#endif
+}
+
+
 void Socket::recv(char *buf, int len)
 {
 	if(sd==INVALID_SOCKET) _throw("Not connected");
@@ -434,7 +568,7 @@ void Socket::recv(char *buf, int len)
 		#ifdef USESSL
 		if(doSSL)
 		{
-			retval=SSL_read(ssl, &buf[bytesRead], len);
+			retval=SSL_read(ssl, &buf[bytesRead], len-bytesRead);
 			if(retval<=0) throw(SSLError("Socket::recv", ssl, retval));
 		}
 		else
@@ -449,3 +583,176 @@ void Socket::recv(char *buf, int len)
 	if(bytesRead!=len) _throw("Incomplete receive");
 }
 
+
+#ifndef _WIN32
+
+int Socket::tryRecv(char *buf, int len)
+{
+	if(sd==INVALID_SOCKET) _throw("Not connected");
+	#ifdef USESSL
+	if(doSSL) _throw("Non-blocking receive is not supported with SSL");
+	#endif
+	int retval=::recv(sd, buf, len, MSG_DONTWAIT);
+	if(retval==SOCKET_ERROR)
+	{
+		if(errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR) return 0;
+		_throwsock();
+	}
+	if(retval==0 && len>0) _throw("Connection closed");
+	return retval;
+}
+
+#endif
+
+
+
+bool Socket::setZeroCopy(bool enable)
+{
+	if(sd==INVALID_SOCKET) _throw("Not connected");
+	#ifdef USEZEROCOPY
+	#ifdef USESSL
+	if(doSSL) return false;
+	#endif
+	int m=enable? 1:0;
+	if(setsockopt(sd, SOL_SOCKET, SO_ZEROCOPY, (char *)&m,
+		sizeof(int))==SOCKET_ERROR)
+		zeroCopy=false;
+	else zeroCopy=enable;
+	#endif
+	return zeroCopy;
+}
+
+
+unsigned int Socket::sendZeroCopy(char *buf, int len)
+{
+	#ifdef USEZEROCOPY
+	if(zeroCopy)
+	{
+		if(sd==INVALID_SOCKET) _throw("Not connected");
+		int bytesSent=0;  bool sentZeroCopy=false;
+		while(bytesSent<len)
+		{
+			ssize_t retval=::send(sd, &buf[bytesSent], len-bytesSent, MSG_ZEROCOPY);
+			if(retval==SOCKET_ERROR)
+			{
+				// ENOBUFS means that too many pages are pinned by outstanding
+				// zero-copy sends.  Wait for some of them to complete and try again,
+				// or copy the rest of the buffer if nothing is outstanding.
+				if(errno!=ENOBUFS) _throwsock();
+				if(zcNext!=zcDone) { readZeroCopyCompletions(true);  continue; }
+				send(&buf[bytesSent], len-bytesSent);
+				bytesSent=len;  break;
+			}
+			if(retval==0) break;
+			// Each successful zero-copy send call is assigned the next ID.
+			zcNext++;  sentZeroCopy=true;
+			bytesSent+=(int)retval;
+		}
+		if(bytesSent!=len) _throw("Incomplete send");
+		return sentZeroCopy? zcNext-1 : zcDone-1;
+	}
+	#endif
+	send(buf, len);
+	return zcDone-1;
+}
+
+
+bool Socket::zeroCopyComplete(unsigned int id, bool wait)
+{
+	#ifdef USEZEROCOPY
+	bool first=true;
+	while(1)
+	{
+		if((int)(id-zcDone)<0 || zcNext==zcDone) return true;
+		for(int i=0; i<nzcRanges; i++)
+		{
+			if((int)(id-zcRanges[i][0])>=0 && (int)(zcRanges[i][1]-id)>=0)
+				return true;
+		}
+		if(!first && !wait) return false;
+		readZeroCopyCompletions(!first);
+		first=false;
+	}
+	#else
+	return true;
+	#endif
+}
+
+
+#ifdef USEZEROCOPY
+
+void Socket::readZeroCopyCompletions(bool wait)
+{
+	if(sd==INVALID_SOCKET) _throw("Not connected");
+
+	if(wait)
+	{
+		// The socket reports POLLERR when there are completions waiting in the
+		// error queue.
+		struct pollfd pfd;
+		pfd.fd=sd;  pfd.events=0;  pfd.revents=0;
+		if(poll(&pfd, 1, -1)==SOCKET_ERROR && errno!=EINTR) _throwsock();
+	}
+
+	while(1)
+	{
+		struct msghdr msg;  char control[128];
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control=control;  msg.msg_controllen=sizeof(control);
+		if(recvmsg(sd, &msg, MSG_ERRQUEUE)==SOCKET_ERROR)
+		{
+			if(errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
+			{
+				// If poll() returned POLLERR because of a real socket error rather
+				// than a completion, then report it.
+				int err=0;  SOCKLEN_T errlen=sizeof(int);
+				if(wait && getsockopt(sd, SOL_SOCKET, SO_ERROR, (char *)&err,
+					&errlen)!=SOCKET_ERROR && err!=0)
+				{
+					errno=err;  _throwsock();
+				}
+				return;
+			}
+			_throwsock();
+		}
+		wait=false;
+
+		for(struct cmsghdr *cm=CMSG_FIRSTHDR(&msg); cm; cm=CMSG_NXTHDR(&msg, cm))
+		{
+			if(!(cm->cmsg_level==SOL_IP && cm->cmsg_type==IP_RECVERR)
+				&& !(cm->cmsg_level==SOL_IPV6 && cm->cmsg_type==IPV6_RECVERR))
+				continue;
+			struct sock_extended_err *serr=
+				(struct sock_extended_err *)CMSG_DATA(cm);
+			if(serr->ee_errno!=0 || serr->ee_origin!=SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			// The kernel had to copy the data anyway (which always happens with
+			// the loopback device), so zero-copy would only add overhead.
+			if(serr->ee_code&SO_EE_CODE_ZEROCOPY_COPIED) zeroCopy=false;
+
+			unsigned int lo=serr->ee_info, hi=serr->ee_data;
+			if(lo!=zcDone)
+			{
+				if(nzcRanges>=MAXZCRANGES)
+					_throw("Too many out-of-order zero-copy completions");
+				zcRanges[nzcRanges][0]=lo;  zcRanges[nzcRanges][1]=hi;
+				nzcRanges++;
+				continue;
+			}
+			zcDone=hi+1;
+			for(int i=0; i<nzcRanges; i++)
+			{
+				if(zcRanges[i][0]==zcDone)
+				{
+					zcDone=zcRanges[i][1]+1;
+					zcRanges[i][0]=zcRanges[nzcRanges-1][0];
+					zcRanges[i][1]=zcRanges[nzcRanges-1][1];
+					nzcRanges--;  i=-1;
+				}
+			}
+		}
+	}
+}
+
+#endif
@@ -103,8 +103,37 @@ typedef struct _BMINFO
 #else
 
 #include <errno.h>
+#include <poll.h>
+
+#ifdef USEXCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/shm.h>
+#endif
 
 #ifdef USESHM
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* Passing memfd file descriptors to the X server requires MIT-SHM v1.2, which
+   is only exposed through XCB. */
+#if defined(USESHM) && defined(USEXCB) && defined(SYS_memfd_create) \
+	&& XCB_SHM_MINOR_VERSION>=2
+#define USEMEMFD
+#include <sys/socket.h>
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+#endif
+
+#if defined(USESHM) && !defined(USEXCB)
 
 static unsigned long serial=0;  static int extok=1;
 static XErrorHandler prevHandler=NULL;
@@ -149,6 +178,296 @@ const char *fbx_formatname(int format)
 }
 
 
+#ifndef _WIN32
+
+#ifdef USEMEMFD
+
+/* File descriptors can only be passed to the X server if it supports MIT-SHM
+   v1.2 and is connected via a Unix domain socket. */
+static int canPassFD(Display *dpy)
+{
+	xcb_connection_t *conn;  const xcb_query_extension_reply_t *ext;
+	xcb_shm_query_version_reply_t *reply;
+	struct sockaddr_storage addr;  socklen_t addrLen=sizeof(addr);
+	int retval=0;
+
+	if(!(conn=XGetXCBConnection(dpy))) return 0;
+	if(getsockname(xcb_get_file_descriptor(conn), (struct sockaddr *)&addr,
+		&addrLen)==-1 || addr.ss_family!=AF_UNIX)
+		return 0;
+	ext=xcb_get_extension_data(conn, &xcb_shm_id);
+	if(!ext || !ext->present) return 0;
+	if((reply=xcb_shm_query_version_reply(conn, xcb_shm_query_version(conn),
+		NULL))!=NULL)
+	{
+		retval=reply->major_version>1
+			|| (reply->major_version==1 && reply->minor_version>=2);
+		free(reply);
+	}
+	return retval;
+}
+
+#endif
+
+
+#ifdef USESHM
+
+/* Allocate a shared memory segment that is at least size bytes long.  Extra
+   space is reserved so that the segment can be reused if the buffer grows
+   slightly.  If fd is non-NULL, then the segment is allocated with
+   memfd_create() if possible, and *fd receives its file descriptor (or -1 if
+   a SysV segment was allocated instead.) */
+static int allocShm(fbx_struct *fb, size_t size, int *fd)
+{
+	size_t pageSize=(size_t)sysconf(_SC_PAGESIZE);
+
+	size+=size/4;
+
+	#ifdef USEMEMFD
+	if(fd)
+	{
+		char *env=getenv("FBX_HUGEPAGES");
+		unsigned int flags=MFD_CLOEXEC;
+
+		if(env && !strcmp(env, "1")) flags|=MFD_HUGETLB;
+		while(1)
+		{
+			struct stat sb;  size_t blockSize=pageSize, allocSize;
+			char *addr;
+
+			if((*fd=syscall(SYS_memfd_create, "fbx", flags))!=-1)
+			{
+				/* Huge page mappings must be a multiple of the huge page size */
+				if(fstat(*fd, &sb)!=-1 && sb.st_blksize>0)
+					blockSize=(size_t)sb.st_blksize;
+				allocSize=(size+blockSize-1)/blockSize*blockSize;
+				if(ftruncate(*fd, allocSize)!=-1
+					&& (addr=(char *)mmap(NULL, allocSize, PROT_READ|PROT_WRITE,
+						MAP_SHARED, *fd, 0))!=MAP_FAILED)
+				{
+					fb->shminfo.shmaddr=addr;  fb->shminfo.shmid=-1;
+					fb->shmSize=allocSize;  fb->memfd=1;
+					return 0;
+				}
+				close(*fd);  *fd=-1;
+			}
+			/* Huge pages may not be available, so try again without them. */
+			if(!(flags&MFD_HUGETLB)) break;
+			flags&=~MFD_HUGETLB;
+		}
+	}
+	#else
+	if(fd) *fd=-1;
+	#endif
+
+	size=(size+pageSize-1)/pageSize*pageSize;
+	if((fb->shminfo.shmid=shmget(IPC_PRIVATE, size, IPC_CREAT|0777))==-1)
+		return -1;
+	if((fb->shminfo.shmaddr=(char *)shmat(fb->shminfo.shmid, 0, 0))
+		==(char *)-1)
+	{
+		shmctl(fb->shminfo.shmid, IPC_RMID, 0);
+		fb->shminfo.shmid=-1;  fb->shminfo.shmaddr=NULL;
+		return -1;
+	}
+	fb->shmSize=size;
+	return 0;
+}
+
+
+/* Attach the shared memory segment to the X server.  This fails on remote
+   connections. */
+static int attachShm(fbx_struct *fb, int fd)
+{
+	#ifndef USEMEMFD
+	(void)fd;
+	#endif
+
+	#ifdef USEXCB
+
+	xcb_connection_t *conn=XGetXCBConnection(fb->wh.dpy);
+	xcb_void_cookie_t cookie;  xcb_generic_error_t *error;
+
+	fb->shminfo.shmseg=xcb_generate_id(conn);
+	#ifdef USEMEMFD
+	if(fd!=-1)
+		/* XCB closes the file descriptor once it has been sent. */
+		cookie=xcb_shm_attach_fd_checked(conn, fb->shminfo.shmseg, fd, 0);
+	else
+	#endif
+	cookie=xcb_shm_attach_checked(conn, fb->shminfo.shmseg, fb->shminfo.shmid,
+		0);
+	if((error=xcb_request_check(conn, cookie))!=NULL)
+	{
+		free(error);  return -1;
+	}
+
+	#else
+
+	int shmok;
+
+	XLockDisplay(fb->wh.dpy);
+	XSync(fb->wh.dpy, False);
+	prevHandler=XSetErrorHandler(xhandler);
+	extok=1;
+	serial=NextRequest(fb->wh.dpy);
+	XShmAttach(fb->wh.dpy, &fb->shminfo);
+	XSync(fb->wh.dpy, False);
+	XSetErrorHandler(prevHandler);
+	shmok=extok;
+	XUnlockDisplay(fb->wh.dpy);
+	if(!shmok) return -1;
+
+	#endif
+
+	fb->shminfo.readOnly=False;
+	fb->xattach=1;
+	if(fb->shminfo.shmid!=-1) shmctl(fb->shminfo.shmid, IPC_RMID, 0);
+	return 0;
+}
+
+
+/* Detach the shared memory segment from the X server and free it */
+static void freeShm(fbx_struct *fb)
+{
+	if(fb->xattach)
+	{
+		XShmDetach(fb->wh.dpy, &fb->shminfo);  XSync(fb->wh.dpy, False);
+		fb->xattach=0;
+	}
+	if(fb->shminfo.shmaddr)
+	{
+		#ifdef USEMEMFD
+		if(fb->memfd) munmap(fb->shminfo.shmaddr, fb->shmSize);
+		else
+		#endif
+		shmdt(fb->shminfo.shmaddr);
+		if(fb->shminfo.shmid!=-1) shmctl(fb->shminfo.shmid, IPC_RMID, 0);
+	}
+	fb->shminfo.shmaddr=NULL;  fb->shminfo.shmid=-1;
+	fb->shmSize=0;  fb->memfd=0;
+}
+
+
+/* Ensure that the buffer has an attached shared memory segment that is at
+   least size bytes long.  An existing segment is reused unless it is too small
+   or more than twice as large as necessary. */
+static int getShm(fbx_struct *fb, size_t size)
+{
+	int fd=-1;
+
+	if(fb->shminfo.shmaddr)
+	{
+		if(size<=fb->shmSize && size>=fb->shmSize/2) return 0;
+		freeShm(fb);
+	}
+	#ifdef USEMEMFD
+	if(canPassFD(fb->wh.dpy))
+	{
+		if(allocShm(fb, size, &fd)==-1) return -1;
+	}
+	else
+	#endif
+	if(allocShm(fb, size, NULL)==-1) return -1;
+	if(attachShm(fb, fd)==-1)
+	{
+		freeShm(fb);  return -1;
+	}
+	return 0;
+}
+
+#endif
+
+
+/* Free the image and its associated X resources, but leave the shared memory
+   segment (if any) attached so that fbx_init() can reuse it. */
+static void termImage(fbx_struct *fb)
+{
+	if(fb->pm)
+	{
+		XFreePixmap(fb->wh.dpy, fb->pm);  fb->pm=0;
+	}
+	if(fb->xi)
+	{
+		if(fb->xi->data && !fb->shm) free(fb->xi->data);
+		/* Shared memory belongs to the segment, and the XCB backend's image was
+		   created with XCreateImage(), so XDestroyImage() would otherwise try to
+		   free it. */
+		fb->xi->data=NULL;
+		XDestroyImage(fb->xi);  fb->xi=NULL;
+	}
+	#ifdef USEXCB
+	if(fb->xcb)
+	{
+		if(fb->pending) xcb_discard_reply(fb->conn, fb->sequence);
+		xcb_free_gc(fb->conn, fb->xcbgc);
+		fb->pending=0;  fb->xcbgc=0;
+	}
+	#endif
+	if(fb->xgc)
+	{
+		XFreeGC(fb->wh.dpy, fb->xgc);  fb->xgc=0;
+	}
+}
+
+#endif
+
+
+#if !defined(_WIN32) && defined(USEXCB)
+
+/* Create a shared memory image and attach it to the X server using XCB rather
+   than Xlib.  Returns -1 if this isn't possible, in which case the caller
+   falls back to Xlib. */
+static int initXCB(fbx_struct *fb, XWindowAttributes *xwa, int width,
+	int height)
+{
+	xcb_connection_t *conn;  const xcb_query_extension_reply_t *ext;
+	xcb_format_iterator_t iter;  XImage *xi=NULL;  int pad=32;
+	uint32_t value=0;
+	static int alreadyWarned=0;
+
+	if(!(conn=XGetXCBConnection(fb->wh.dpy))) goto finally;
+	ext=xcb_get_extension_data(conn, &xcb_shm_id);
+	if(!ext || !ext->present) goto finally;
+
+	/* The X server expects each scanline to be padded to the scanline pad of
+	   the pixmap format, so the XImage has to use the same pad. */
+	iter=xcb_setup_pixmap_formats_iterator(xcb_get_setup(conn));
+	for(; iter.rem; xcb_format_next(&iter))
+		if(iter.data->depth==xwa->depth) { pad=iter.data->scanline_pad;  break; }
+	if(!(xi=XCreateImage(fb->wh.dpy, xwa->visual, xwa->depth, ZPixmap, 0, NULL,
+		width, height, pad, 0)))
+		goto finally;
+	if(getShm(fb, xi->bytes_per_line*xi->height+1)==-1) goto finally;
+
+	fb->xcbgc=xcb_generate_id(conn);
+	xcb_create_gc(conn, fb->xcbgc, fb->wh.d, XCB_GC_GRAPHICS_EXPOSURES, &value);
+
+	xi->data=fb->shminfo.shmaddr;
+	fb->xi=xi;  fb->conn=conn;  fb->xcb=1;  fb->shm=1;
+	if(!alreadyWarned && warningFile)
+	{
+		fprintf(warningFile, "[FBX] Using XCB%s\n",
+			fb->memfd ? " with memfd shared memory" : "");
+		alreadyWarned=1;
+	}
+	return 0;
+
+	finally:
+	if(xi) XDestroyImage(xi);
+	if(!alreadyWarned && warningFile)
+	{
+		fprintf(warningFile,
+			"[FBX] WARNING: XCB MIT-SHM extension failed to initialize.  Will use Xlib\n");
+		fprintf(warningFile, "[FBX]    instead.\n");
+		alreadyWarned=1;
+	}
+	return -1;
+}
+
+#endif
+
+
 int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 {
 	int width, height;
@@ -157,6 +476,13 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 	BMINFO bminfo;  HBITMAP hmembmp=0;  RECT rect;  HDC hdc=NULL;
 	#else
 	XWindowAttributes xwa;  int shmok=1, alphaFirst, pixmap=0;
+	#ifdef USESHM
+	fbx_struct shm;  int keepShm=0;
+	#endif
+	#ifdef USEXCB
+	char *xcbEnv=getenv("FBX_USEXCB");
+	int useXCB=(xcbEnv && !strcmp(xcbEnv, "1"));
+	#endif
 	#endif
 
 	if(!fb) _throw("Invalid argument");
@@ -268,12 +594,27 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 	{
 		if(width==fb->width && height==fb->height && fb->xi && fb->xgc && fb->bits)
 			return 0;
+		#ifdef USESHM
+		else if(fb->shm)
+		{
+			/* Keep the shared memory segment, since it may be large enough for the
+			   new buffer. */
+			termImage(fb);
+			shm=*fb;  keepShm=1;
+		}
+		#endif
 		else if(fbx_term(fb)==-1) return -1;
 	}
 	memset(fb, 0, sizeof(fbx_struct));
 	fb->wh.dpy=wh.dpy;  fb->wh.d=wh.d;
 
 	#ifdef USESHM
+	fb->shminfo.shmid=-1;
+	if(keepShm)
+	{
+		fb->shminfo=shm.shminfo;  fb->xattach=shm.xattach;
+		fb->shmSize=shm.shmSize;  fb->memfd=shm.memfd;
+	}
 	if(!useShm)
 	{
 		static int alreadyWarned=0;
@@ -283,36 +624,22 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 			alreadyWarned=1;
 		}
 	}
+	#ifdef USEXCB
+	if(useShm && useXCB && initXCB(fb, &xwa, width, height)==0)
+	{
+		/* Nothing else to do */
+	}
+	else
+	#endif
 	if(useShm && XShmQueryExtension(fb->wh.dpy))
 	{
 		static int alreadyWarned=0;
-		fb->shminfo.shmid=-1;
 		if(!(fb->xi=XShmCreateImage(fb->wh.dpy, xwa.visual, xwa.depth,
 			ZPixmap, NULL, &fb->shminfo, width, height)))
 		{
 			useShm=0;  goto noshm;
 		}
-		if((fb->shminfo.shmid=shmget(IPC_PRIVATE,
-			fb->xi->bytes_per_line*fb->xi->height+1, IPC_CREAT|0777))==-1)
-		{
-			useShm=0;  XDestroyImage(fb->xi);  goto noshm;
-		}
-		if((fb->shminfo.shmaddr=fb->xi->data
-			=(char *)shmat(fb->shminfo.shmid, 0, 0))==(char *)-1)
-		{
-			useShm=0;  XDestroyImage(fb->xi);
-			shmctl(fb->shminfo.shmid, IPC_RMID, 0);  goto noshm;
-		}
-		fb->shminfo.readOnly=False;
-		XLockDisplay(fb->wh.dpy);
-		XSync(fb->wh.dpy, False);
-		prevHandler=XSetErrorHandler(xhandler);
-		extok=1;
-		serial=NextRequest(fb->wh.dpy);
-		XShmAttach(fb->wh.dpy, &fb->shminfo);
-		XSync(fb->wh.dpy, False);
-		XSetErrorHandler(prevHandler);
-		shmok=extok;
+		shmok=(getShm(fb, fb->xi->bytes_per_line*fb->xi->height+1)!=-1);
 		if(!alreadyWarned && !shmok && warningFile)
 		{
 			fprintf(warningFile,
@@ -321,10 +648,10 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 				"[FBX]    remote connection.)  Will use X Pixmap drawing instead.\n");
 			alreadyWarned=1;
 		}
-		XUnlockDisplay(fb->wh.dpy);
 		if(shmok)
 		{
 			char *env=getenv("FBX_USESHMPIXMAPS");
+			fb->xi->data=fb->shminfo.shmaddr;
 			if(env && !strcmp(env, "1"))
 			{
 				static int alreadyWarned=0;
@@ -338,13 +665,13 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 				if(!fb->pm) shmok=0;
 			}
 		}
-		shmctl(fb->shminfo.shmid, IPC_RMID, 0);
 		if(!shmok)
 		{
-			useShm=0;  XDestroyImage(fb->xi);  shmdt(fb->shminfo.shmaddr);
-			shmctl(fb->shminfo.shmid, IPC_RMID, 0);  goto noshm;
+			useShm=0;  fb->xi->data=NULL;  XDestroyImage(fb->xi);  fb->xi=NULL;
+			goto noshm;
 		}
-		fb->xattach=1;  fb->shm=1;
+		fb->shm=1;
+		fb->shmCompletion=XShmGetEventBase(fb->wh.dpy)+ShmCompletion;
 	}
 	else if(useShm)
 	{
@@ -362,6 +689,9 @@ int fbx_init(fbx_struct *fb, fbx_wh wh, int width_, int height_, int useShm)
 	if(!useShm)
 	#endif
 	{
+		#ifdef USESHM
+		freeShm(fb);
+		#endif
 		if(!pixmap)
 			_x11(fb->pm=XCreatePixmap(fb->wh.dpy, fb->wh.d, width, height,
 				xwa.depth));
@@ -440,6 +770,18 @@ int fbx_read(fbx_struct *fb, int x_, int y_)
 	}
 	#endif
 
+	#ifdef USEXCB
+	if(fb->xcb)
+	{
+		xcb_shm_get_image_reply_t *reply;
+		reply=xcb_shm_get_image_reply(fb->conn,
+			xcb_shm_get_image(fb->conn, fb->wh.d, x, y, fb->width, fb->height,
+				~0U, XCB_IMAGE_FORMAT_Z_PIXMAP, fb->shminfo.shmseg, 0), NULL);
+		_x11(reply);
+		free(reply);
+	}
+	else
+	#endif
 	#ifdef USESHM
 	if(fb->shm)
 	{
@@ -499,16 +841,12 @@ int fbx_write(fbx_struct *fb, int srcX_, int srcY_, int dstX_, int dstY_,
 
 	#else
 
-	if(!fb->pm || !fb->shm)
-		if(fbx_awrite(fb, srcX, srcY, dstX, dstY, width, height)==-1) return -1;
-	if(fb->pm)
-	{
-		XCopyArea(fb->wh.dpy, fb->pm, fb->wh.d, fb->xgc, srcX, srcY, width,
-			height, dstX, dstY);
-	}
-	XFlush(fb->wh.dpy);
+	if(fbx_flush(fb, srcX, srcY, dstX, dstY, width, height)==-1) return -1;
+	#ifdef USEXCB
+	if(!fb->xcb)
+	#endif
 	XSync(fb->wh.dpy, False);
-	return 0;
+	return fbx_wait(fb);
 
 	#endif
 
@@ -555,6 +893,105 @@ int fbx_flip(fbx_struct *fb, int x_, int y_, int width_, int height_)
 
 #ifndef _WIN32
 
+/* The X server notifies us that it has finished a write by sending a
+   ShmCompletion event (XShmPutImage) or a NoExpose/GraphicsExpose event
+   (XCopyArea.) */
+static Bool isCompletion(Display *dpy, XEvent *e, XPointer arg)
+{
+	fbx_struct *fb=(fbx_struct *)arg;
+
+	(void)dpy;
+
+	#ifdef USESHM
+	if(fb->shm && e->type==fb->shmCompletion)
+		return ((XShmCompletionEvent *)e)->drawable==fb->wh.d;
+	#endif
+	if(e->type==NoExpose) return e->xnoexpose.drawable==fb->wh.d;
+	if(e->type==GraphicsExpose)
+		return e->xgraphicsexpose.drawable==fb->wh.d;
+	return False;
+}
+
+
+int fbx_flush(fbx_struct *fb, int srcX_, int srcY_, int dstX_, int dstY_,
+	int width_, int height_)
+{
+	int srcX, srcY, dstX, dstY, width, height;
+
+	if(!fb) _throw("Invalid argument");
+
+	srcX=srcX_>=0? srcX_:0;  srcY=srcY_>=0? srcY_:0;
+	dstX=dstX_>=0? dstX_:0;  dstY=dstY_>=0? dstY_:0;
+	width=width_>0? width_:fb->width;
+	height=height_>0? height_:fb->height;
+
+	if(width>fb->width) width=fb->width;
+	if(height>fb->height) height=fb->height;
+	if(srcX+width>fb->width) width=fb->width-srcX;
+	if(srcY+height>fb->height) height=fb->height-srcY;
+
+	if(!fb->pm || !fb->shm)
+		if(fbx_awrite(fb, srcX, srcY, dstX, dstY, width, height)==-1) return -1;
+	if(fb->pm)
+	{
+		fb->serial=NextRequest(fb->wh.dpy);  fb->pending=1;
+		XCopyArea(fb->wh.dpy, fb->pm, fb->wh.d, fb->xgc, srcX, srcY, width,
+			height, dstX, dstY);
+	}
+	#ifdef USEXCB
+	if(fb->xcb) xcb_flush(fb->conn);
+	else
+	#endif
+	XFlush(fb->wh.dpy);
+	return 0;
+
+	finally:
+	return -1;
+}
+
+
+int fbx_wait(fbx_struct *fb)
+{
+	XEvent e;  struct pollfd pfd;
+
+	if(!fb) _throw("Invalid argument");
+	if(!fb->pending) return 0;
+	if(!fb->wh.dpy) _throw("Not initialized");
+
+	#ifdef USEXCB
+	if(fb->xcb)
+	{
+		xcb_get_input_focus_cookie_t cookie;
+		xcb_get_input_focus_reply_t *reply;
+		cookie.sequence=fb->sequence;
+		reply=xcb_get_input_focus_reply(fb->conn, cookie, NULL);
+		fb->pending=0;
+		_x11(reply);
+		free(reply);
+		return 0;
+	}
+	#endif
+
+	XFlush(fb->wh.dpy);
+	while(1)
+	{
+		while(XCheckIfEvent(fb->wh.dpy, &e, isCompletion, (XPointer)fb));
+		/* If the write failed, then the X server sent an error rather than a
+		   completion event, but either one advances the last known request. */
+		if((long)(LastKnownRequestProcessed(fb->wh.dpy)-fb->serial)>=0) break;
+		pfd.fd=ConnectionNumber(fb->wh.dpy);  pfd.events=POLLIN;
+		pfd.revents=0;
+		if(poll(&pfd, 1, 100)==-1 && errno!=EINTR) _throw(strerror(errno));
+		XEventsQueued(fb->wh.dpy, QueuedAfterReading);
+	}
+	fb->pending=0;
+	return 0;
+
+	finally:
+	return -1;
+}
+
+
 int fbx_awrite(fbx_struct *fb, int srcX_, int srcY_, int dstX_, int dstY_,
 	int width_, int height_)
 {
@@ -574,6 +1011,19 @@ int fbx_awrite(fbx_struct *fb, int srcX_, int srcY_, int dstX_, int dstY_,
 	if(!fb->wh.dpy || !fb->wh.d || !fb->xi || !fb->bits)
 		_throw("Not initialized");
 
+	#ifdef USEXCB
+	if(fb->xcb)
+	{
+		xcb_shm_put_image(fb->conn, fb->wh.d, fb->xcbgc, fb->width, fb->height,
+			srcX, srcY, width, height, dstX, dstY, fb->xi->depth,
+			XCB_IMAGE_FORMAT_Z_PIXMAP, 0, fb->shminfo.shmseg, 0);
+		/* The X server processes requests in order, so the reply to this request
+		   indicates that the write has completed. */
+		if(fb->pending) xcb_discard_reply(fb->conn, fb->sequence);
+		fb->sequence=xcb_get_input_focus(fb->conn).sequence;  fb->pending=1;
+	}
+	else
+	#endif
 	#ifdef USESHM
 	if(fb->shm)
 	{
@@ -581,8 +1031,9 @@ int fbx_awrite(fbx_struct *fb, int srcX_, int srcY_, int dstX_, int dstY_,
 		{
 			_x11(XShmAttach(fb->wh.dpy, &fb->shminfo));  fb->xattach=1;
 		}
+		fb->serial=NextRequest(fb->wh.dpy);  fb->pending=1;
 		_x11(XShmPutImage(fb->wh.dpy, fb->wh.d, fb->xgc, fb->xi, srcX, srcY, dstX,
-			dstY, width, height, False));
+			dstY, width, height, True));
 	}
 	else
 	#endif
@@ -612,12 +1063,19 @@ int fbx_sync(fbx_struct *fb)
 	if(!fb) _throw("Invalid argument");
 	if(fb->pm)
 	{
+		fb->serial=NextRequest(fb->wh.dpy);  fb->pending=1;
 		XCopyArea(fb->wh.dpy, fb->pm, fb->wh.d, fb->xgc, 0, 0, fb->width,
 			fb->height, 0, 0);
 	}
-	XFlush(fb->wh.dpy);
-	XSync(fb->wh.dpy, False);
-	return 0;
+	#ifdef USEXCB
+	if(fb->xcb) xcb_flush(fb->conn);
+	else
+	#endif
+	{
+		XFlush(fb->wh.dpy);
+		XSync(fb->wh.dpy, False);
+	}
+	return fbx_wait(fb);
 
 	finally:
 	return -1;
@@ -637,30 +1095,10 @@ int fbx_term(fbx_struct *fb)
 
 	#else
 
-	if(fb->pm)
-	{
-		XFreePixmap(fb->wh.dpy, fb->pm);  fb->pm=0;
-	}
-	if(fb->xi)
-	{
-		if(fb->xi->data && !fb->shm)
-		{
-			free(fb->xi->data);  fb->xi->data=NULL;
-		}
-		XDestroyImage(fb->xi);
-	}
+	termImage(fb);
 	#ifdef USESHM
-	if(fb->shm)
-	{
-		if(fb->xattach)
-		{
-			XShmDetach(fb->wh.dpy, &fb->shminfo);  XSync(fb->wh.dpy, False);
-		}
-		if(fb->shminfo.shmaddr!=NULL) shmdt(fb->shminfo.shmaddr);
-		if(fb->shminfo.shmid!=-1) shmctl(fb->shminfo.shmid, IPC_RMID, 0);
-	}
+	freeShm(fb);
 	#endif
-	if(fb->xgc) XFreeGC(fb->wh.dpy, fb->xgc);
 
 	#endif
 
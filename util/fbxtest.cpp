@@ -53,7 +53,7 @@ bool doPixmap=false, doShm=true, doFS=false, doVid=false, doDisplay=false,
 int offset, retCode=0;
 double benchTime=5.0;
 #ifndef _WIN32
-bool checkDB=false, doCI=false;
+bool checkDB=false, doCI=false, doXCB=false;
 Window win=0;
 #endif
 fbx_wh wh;
@@ -175,6 +175,9 @@ void nativeWrite(bool useShm)
 	{
 		_fbx(fbx_init(&fb, wh, 0, 0, useShm? 1:0));
 		if(useShm && !fb.shm) _throw("MIT-SHM not available");
+		#ifndef _WIN32
+		if(useShm && doXCB && !fb.xcb) _throw("XCB not available");
+		#endif
 		fprintf(stderr, "Native Pixel Format:  %s\n", fbx_formatname(fb.format));
 		if(fb.width!=width || fb.height!=height)
 		{
@@ -307,6 +310,9 @@ void nativeRead(bool useShm)
 		_fbx(fbx_init(&fb, wh, 0, 0, useShm? 1:0));
 		int ps=fbx_ps[fb.format];
 		if(useShm && !fb.shm) _throw("MIT-SHM not available");
+		#ifndef _WIN32
+		if(useShm && doXCB && !fb.xcb) _throw("XCB not available");
+		#endif
 		if(fb.width!=width || fb.height!=height)
 		{
 			fprintf(stderr, "WARNING:  Requested size = %d x %d  Actual size = %d x %d\n",
@@ -369,6 +375,9 @@ class WriteThread : public Runnable
 				fbx_term(&fb);
 				_fbx(fbx_init(&fb, wh, myWidth, myHeight, useShm? 1:0));
 				if(useShm && !fb.shm) _throw("MIT-SHM not available");
+				#ifndef _WIN32
+				if(useShm && doXCB && !fb.xcb) _throw("XCB not available");
+				#endif
 				initBuf(myX, myY, fb.width, fb.pitch, fb.height, fb.format,
 					(unsigned char *)fb.bits, 0);
 				for(i=0; i<iter; i++)
@@ -411,6 +420,9 @@ class ReadThread : public Runnable
 				fbx_term(&fb);
 				_fbx(fbx_init(&fb, wh, myWidth, myHeight, useShm? 1:0));
 				if(useShm && !fb.shm) _throw("MIT-SHM not available");
+				#ifndef _WIN32
+				if(useShm && doXCB && !fb.xcb) _throw("XCB not available");
+				#endif
 				int ps=fbx_ps[fb.format];
 				memset(fb.bits, 0, fb.width*fb.height*ps);
 				for(i=0; i<iter; i++)
@@ -696,6 +708,7 @@ void usage(char *progname)
 	fprintf(stderr, "-index = Test color index pixel format (PseudoColor visual)\n");
 	fprintf(stderr, "-noshm = Do not use MIT-SHM extension to accelerate blitting\n");
 	fprintf(stderr, "-pm = Blit to a pixmap rather than to a window\n");
+	fprintf(stderr, "-xcb = Use XCB rather than Xlib to access MIT-SHM\n");
 	#endif
 	fprintf(stderr, "-mt = Run multi-threaded stress tests\n");
 	fprintf(stderr, "-v = Print all warnings and informational messages from FBX\n");
@@ -741,6 +754,10 @@ int main(int argc, char **argv)
 		{
 			doPixmap=true;  doShm=false;
 		}
+		if(!stricmp(argv[i], "-xcb"))
+		{
+			doXCB=true;  setenv("FBX_USEXCB", "1", 1);
+		}
 		if(!strnicmp(argv[i], "-index", 3))
 		{
 			doCI=true;
@@ -16,6 +16,8 @@
 /* This library abstracts X Video drawing */
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
 #include "fbxv.h"
 #include "x11err.h"
 
@@ -191,6 +193,7 @@ int fbxv_init(fbxv_struct *fb, Display *dpy, Window win, int width_,
 			shmctl(fb->shminfo.shmid, IPC_RMID, 0);  goto noshm;
 		}
 		fb->xattach=1;  fb->shm=1;
+		fb->shmCompletion=XShmGetEventBase(dpy)+ShmCompletion;
 	}
 	else if(useShm)
 	{
@@ -221,8 +224,9 @@ int fbxv_init(fbxv_struct *fb, Display *dpy, Window win, int width_,
 }
 
 
-int fbxv_write(fbxv_struct *fb, int srcX_, int srcY_, int srcWidth_,
-	int srcHeight_, int dstX_, int dstY_, int dstWidth, int dstHeight)
+static int putImage(fbxv_struct *fb, int srcX_, int srcY_, int srcWidth_,
+	int srcHeight_, int dstX_, int dstY_, int dstWidth, int dstHeight,
+	int sendEvent)
 {
 	int srcX, srcY, dstX, dstY, srcWidth, srcHeight;
 	if(!fb) _throw("Invalid argument");
@@ -239,15 +243,18 @@ int fbxv_write(fbxv_struct *fb, int srcX_, int srcY_, int srcWidth_,
 	if(srcX+srcWidth>fb->xvi->width) srcWidth=fb->xvi->width-srcX;
 	if(srcY+srcHeight>fb->xvi->height) srcHeight=fb->xvi->height-srcY;
 
+	fb->serial=NextRequest(fb->dpy);
 	#ifdef USESHM
 	if(fb->shm)
 	{
 		if(!fb->xattach)
 		{
 			_errifnot(XShmAttach(fb->dpy, &fb->shminfo));  fb->xattach=1;
+			fb->serial=NextRequest(fb->dpy);
 		}
 		_x11(XvShmPutImage(fb->dpy, fb->port, fb->win, fb->xgc, fb->xvi, srcX,
-			srcY, srcWidth, srcHeight, dstX, dstY, dstWidth, dstHeight, False));
+			srcY, srcWidth, srcHeight, dstX, dstY, dstWidth, dstHeight,
+			sendEvent));
 	}
 	else
 	#endif
@@ -255,7 +262,76 @@ int fbxv_write(fbxv_struct *fb, int srcX_, int srcY_, int srcWidth_,
 	_x11(XvPutImage(fb->dpy, fb->port, fb->win, fb->xgc, fb->xvi, srcX, srcY,
 		srcWidth, srcHeight, dstX, dstY, dstWidth, dstHeight));
 	XFlush(fb->dpy);
+	return 0;
+
+	finally:
+	return -1;
+}
+
+
+int fbxv_write(fbxv_struct *fb, int srcX, int srcY, int srcWidth,
+	int srcHeight, int dstX, int dstY, int dstWidth, int dstHeight)
+{
+	if(fbxv_wait(fb)==-1) return -1;
+	if(putImage(fb, srcX, srcY, srcWidth, srcHeight, dstX, dstY, dstWidth,
+		dstHeight, False)==-1)
+		return -1;
+	XSync(fb->dpy, False);
+	return 0;
+}
+
+
+int fbxv_flush(fbxv_struct *fb, int srcX, int srcY, int srcWidth,
+	int srcHeight, int dstX, int dstY, int dstWidth, int dstHeight)
+{
+	if(fbxv_wait(fb)==-1) return -1;
+	if(putImage(fb, srcX, srcY, srcWidth, srcHeight, dstX, dstY, dstWidth,
+		dstHeight, True)==-1)
+		return -1;
+	fb->pending=1;
+	return 0;
+}
+
+
+#ifdef USESHM
+static Bool isCompletion(Display *dpy, XEvent *e, XPointer arg)
+{
+	fbxv_struct *fb=(fbxv_struct *)arg;
+	(void)dpy;
+	return e->type==fb->shmCompletion
+		&& ((XShmCompletionEvent *)e)->drawable==fb->win;
+}
+#endif
+
+
+int fbxv_wait(fbxv_struct *fb)
+{
+	#ifdef USESHM
+	XEvent e;  struct pollfd pfd;
+	#endif
+
+	if(!fb) _throw("Invalid argument");
+	if(!fb->pending) return 0;
+
+	#ifdef USESHM
+	if(fb->shm)
+	{
+		while(1)
+		{
+			while(XCheckIfEvent(fb->dpy, &e, isCompletion, (XPointer)fb));
+			/* If the write failed, then the X server sent an error rather than a
+			   completion event, but either one advances the last known request. */
+			if((long)(LastKnownRequestProcessed(fb->dpy)-fb->serial)>=0) break;
+			pfd.fd=ConnectionNumber(fb->dpy);  pfd.events=POLLIN;  pfd.revents=0;
+			if(poll(&pfd, 1, 100)==-1 && errno!=EINTR) _throw(strerror(errno));
+			XEventsQueued(fb->dpy, QueuedAfterReading);
+		}
+	}
+	else
+	#endif
+	/* XvPutImage() doesn't generate an event, so a round trip is necessary. */
 	XSync(fb->dpy, False);
+	fb->pending=0;
 	return 0;
 
 	finally:
@@ -266,6 +342,7 @@ int fbxv_write(fbxv_struct *fb, int srcX_, int srcY_, int srcWidth_,
 int fbxv_term(fbxv_struct *fb)
 {
 	if(!fb) _throw("Invalid argument");
+	if(fb->pending) fbxv_wait(fb);
 	if(fb->xvi)
 	{
 		if(fb->xvi->data && !fb->shm)
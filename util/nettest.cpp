@@ -18,6 +18,8 @@
 #include "Socket.h"
 #include "vglutil.h"
 #include "Timer.h"
+#include "Thread.h"
+#include "GenericQ.h"
 #ifdef sun
 #include <kstat.h>
 #endif
@@ -29,6 +31,7 @@ using namespace vglutil;
 #define MINDATASIZE 1
 #define MAXDATASIZE (4*1024*1024)
 #define ITER 5
+#define DEFAULTCLIENTPORT 4242
 
 
 double benchTime=2.0;
@@ -143,6 +146,240 @@ int cmpBuf(char *buf, int len)
 }
 
 
+// Network impairment proxy
+
+#ifdef _WIN32
+#define SHUT_WR SD_SEND
+#define SHUT_RDWR SD_BOTH
+#endif
+
+#define CHUNKSIZE 16384
+// Maximum number of chunks (4 MB) that can be in flight in each direction
+#define MAXCHUNKS 256
+
+double proxyBW=0., proxyLatency=0., proxyJitter=0., proxyReorder=0.;
+unsigned int proxySeed=1;
+
+
+static void sleepUntil(double t)
+{
+	double delay=t-getTime();
+	if(delay>0.) usleep((unsigned int)(delay*1000000.));
+}
+
+
+// Relays the data received on one socket to another, delaying each chunk of
+// data in order to emulate the bandwidth, latency, jitter, and reordering of a
+// wide-area network.  The receiver blocks until the emulated link can accept
+// more data, so the bandwidth cap applies back-pressure to the sender just as
+// a real bottleneck would.  Since TCP delivers data in order, a reordered
+// chunk (one that the network delivers late, causing the receiver to wait for
+// it) stalls all of the data behind it within the same stream, but the
+// streams of a striped connection are delayed independently.
+class Pipe : public Runnable
+{
+	public:
+
+		Pipe(Socket *src_, Socket *dst_, unsigned int seed_) : src(src_),
+			dst(dst_), slots(MAXCHUNKS), seed(seed_), bytes(0), sender(this)
+		{
+		}
+
+		void run(void)
+		{
+			Thread senderThread(&sender);
+			double linkFree=0., lastRelease=0.;
+
+			senderThread.start();
+			for(;;)
+			{
+				Chunk *c=NULL;
+				slots.wait();
+				_newcheck(c=new Chunk);
+				if((c->len=::recv(src->getSocket(), c->buf, CHUNKSIZE, 0))<=0)
+				{
+					delete c;  break;
+				}
+				bytes+=c->len;
+
+				double now=getTime(), delay=proxyLatency;
+				if(proxyBW>0.)
+				{
+					if(linkFree<now) linkFree=now;
+					linkFree+=(double)c->len*8./(proxyBW*1000000.);
+					sleepUntil(linkFree);
+					now=linkFree;
+				}
+				if(proxyJitter>0.) delay+=proxyJitter*(2.*random01()-1.);
+				if(proxyReorder>0. && random01()*100.<proxyReorder)
+				{
+					// A reordered chunk arrives roughly one round trip late, which is
+					// how long TCP takes to recover from it.
+					double holdTime=2.*proxyLatency+proxyJitter;
+					delay+=holdTime>0.001? holdTime:0.001;
+				}
+				if(delay<0.) delay=0.;
+				c->release=now+delay;
+				if(c->release<lastRelease) c->release=lastRelease;
+				lastRelease=c->release;
+				queue.add(c);
+			}
+			queue.add(NULL);
+			senderThread.stop();
+		}
+
+		unsigned long long getBytes(void) { return bytes; }
+
+	private:
+
+		typedef struct
+		{
+			char buf[CHUNKSIZE];  int len;  double release;
+		} Chunk;
+
+		class Sender : public Runnable
+		{
+			public:
+
+				Sender(Pipe *pipe_) : pipe(pipe_) {}
+				void run(void) { pipe->send(); }
+
+			private:
+
+				Pipe *pipe;
+		};
+
+		void send(void)
+		{
+			bool failed=false;
+
+			for(;;)
+			{
+				Chunk *c=NULL;
+				queue.get((void **)&c);
+				if(!c) break;
+				if(!failed)
+				{
+					sleepUntil(c->release);
+					try
+					{
+						dst->send(c->buf, c->len);
+					}
+					catch(Error &e)
+					{
+						// The destination is gone, so unblock the receiver.
+						failed=true;
+						shutdown(src->getSocket(), SHUT_RDWR);
+					}
+				}
+				delete c;
+				slots.post();
+			}
+			if(!failed) shutdown(dst->getSocket(), SHUT_WR);
+		}
+
+		double random01(void)
+		{
+			seed=seed*1103515245+12345;
+			return (double)((seed>>16)&0x7fff)/32768.;
+		}
+
+		Socket *src, *dst;
+		GenericQ queue;
+		Semaphore slots;
+		unsigned int seed;
+		unsigned long long bytes;
+		Sender sender;
+};
+
+
+// Relays one client connection to the destination
+class Connection : public Runnable
+{
+	public:
+
+		Connection(Socket *client_, char *host_, unsigned short port_,
+			unsigned int seed_) : client(client_), host(host_), port(port_),
+			seed(seed_), thread(this)
+		{
+		}
+
+		void start(void)
+		{
+			thread.start();
+			thread.detach();
+		}
+
+		void run(void)
+		{
+			Socket *server=NULL;
+			char clientName[256];
+
+			snprintf(clientName, 256, "%s", client->remoteName());
+			try
+			{
+				_newcheck(server=new Socket(false));
+				server->connect(host, port);
+				printf("Relaying %s <-> %s:%d\n", clientName, host, port);
+				fflush(stdout);
+
+				Pipe up(client, server, seed), down(server, client, seed+1);
+				Thread upThread(&up), downThread(&down);
+				Timer timer;
+
+				timer.start();
+				upThread.start();  downThread.start();
+				upThread.stop();  downThread.stop();
+				double elapsed=timer.elapsed();
+				printf("Closed %s:  Sent %.2f MB (%f Mbits/sec), ", clientName,
+					(double)up.getBytes()/1048576.,
+					(double)up.getBytes()/125000./elapsed);
+				printf("received %.2f MB (%f Mbits/sec)\n",
+					(double)down.getBytes()/1048576.,
+					(double)down.getBytes()/125000./elapsed);
+				fflush(stdout);
+			}
+			catch(Error &e)
+			{
+				printf("Error in %s--\n%s\n", e.getMethod(), e.getMessage());
+			}
+			delete server;
+			delete client;
+			delete this;
+		}
+
+	private:
+
+		Socket *client;  char *host;  unsigned short port;
+		unsigned int seed;
+		Thread thread;
+};
+
+
+void proxy(unsigned short listenPort, char *host, unsigned short port)
+{
+	Socket socket(false);
+
+	socket.listen(listenPort, true);
+	printf("Relaying TCP port %d to %s:%d\n", listenPort, host, port);
+	printf("Bandwidth: ");
+	if(proxyBW>0.) printf("%.3f Mbits/sec", proxyBW);
+	else printf("unlimited");
+	printf("   Latency: %.1f ms   Jitter: %.1f ms   Reordering: %.1f%%\n",
+		proxyLatency*1000., proxyJitter*1000., proxyReorder);
+	fflush(stdout);
+
+	for(;;)
+	{
+		Socket *client=socket.accept();
+		Connection *conn=NULL;
+		_newcheck(conn=new Connection(client, host, port, proxySeed));
+		conn->start();
+		proxySeed+=2;
+	}
+}
+
+
 void usage(char **argv)
 {
 	printf("\nUSAGE: %s -client <server name or IP>", argv[0]);
@@ -155,12 +392,24 @@ void usage(char **argv)
 	printf(" [-ssl]");
 	#endif
 	printf("\n or    %s -findport\n", argv[0]);
+	printf(" or    %s -proxy <port> <client>[:<client port>] [-bw <b>]\n", argv[0]);
+	printf("           [-latency <l>] [-jitter <j>] [-reorder <r>] [-seed <s>]\n");
 	#if defined(sun) || defined(linux)
 	printf(" or    %s -bench <interface> [interval]\n", argv[0]);
 	printf("\n-bench = measure throughput on selected network interface");
 	#endif
 	printf("\n-findport = display a free TCP port number and exit");
 	printf("\n-old = communicate with NetTest server v2.1.x or earlier\n");
+	printf("-proxy = relay connections on TCP port <port> to <client>:<client port>\n");
+	printf("         [default client port = %d] while emulating the following network\n",
+		DEFAULTCLIENTPORT);
+	printf("         characteristics in each direction:\n");
+	printf("  -bw <b> = Limit bandwidth to <b> Mbits/sec [default = unlimited]\n");
+	printf("  -latency <l> = Delay data by <l> ms [default = 0]\n");
+	printf("  -jitter <j> = Vary the delay randomly by up to +/- <j> ms [default = 0]\n");
+	printf("  -reorder <r> = Deliver <r> percent of the data one round trip late\n");
+	printf("                 [default = 0]\n");
+	printf("  -seed <s> = Random number seed [default = 1]\n");
 	#ifdef USESSL
 	printf("-ssl = use secure tunnel\n");
 	#endif
@@ -231,6 +480,38 @@ int main(int argc, char **argv)
 			socket.close();
 			exit(0);
 		}
+		else if(!stricmp(argv[1], "-proxy"))
+		{
+			int listenPort=0, port=DEFAULTCLIENTPORT;  char *ptr;
+			if(argc<4 || (listenPort=atoi(argv[2]))<1 || listenPort>65535)
+				usage(argv);
+			if((ptr=strrchr(argv[3], ':'))!=NULL)
+			{
+				if((port=atoi(ptr+1))<1 || port>65535) usage(argv);
+				*ptr='\0';
+			}
+			for(i=4; i<argc; i++)
+			{
+				double temp=-1.;
+				if(!stricmp(argv[i], "-bw") && i<argc-1
+					&& sscanf(argv[++i], "%lf", &temp)==1 && temp>0.)
+					proxyBW=temp;
+				else if(!stricmp(argv[i], "-latency") && i<argc-1
+					&& sscanf(argv[++i], "%lf", &temp)==1 && temp>=0.)
+					proxyLatency=temp/1000.;
+				else if(!stricmp(argv[i], "-jitter") && i<argc-1
+					&& sscanf(argv[++i], "%lf", &temp)==1 && temp>=0.)
+					proxyJitter=temp/1000.;
+				else if(!stricmp(argv[i], "-reorder") && i<argc-1
+					&& sscanf(argv[++i], "%lf", &temp)==1 && temp>=0. && temp<=100.)
+					proxyReorder=temp;
+				else if(!stricmp(argv[i], "-seed") && i<argc-1)
+					proxySeed=(unsigned int)atoi(argv[++i]);
+				else usage(argv);
+			}
+			proxy((unsigned short)listenPort, argv[3], (unsigned short)port);
+			exit(0);
+		}
 		#if defined(sun) || defined(linux)
 		else if(!stricmp(argv[1], "-bench"))
 		{
@@ -341,6 +622,26 @@ int main(int argc, char **argv)
 
 			char id[6]="VGL22";
 			socket.send(id, 5);
+
+			// Check that a gather send preserves the order of a small buffer
+			// followed by a large one (as when the VGL Transport sends a tile
+			// header followed by its payload.)
+			const int hdrSize=16, bodySize=12000;
+			struct iovec iov[2];
+			size=hdrSize+bodySize;
+			if(!littleendian()) size=byteswap(size);
+			socket.send((char *)&size, (int)sizeof(int));
+			initBuf(buf, hdrSize+bodySize);
+			iov[0].iov_base=buf;  iov[0].iov_len=hdrSize;
+			iov[1].iov_base=&buf[hdrSize];  iov[1].iov_len=bodySize;
+			socket.send(iov, 2);
+			socket.recv(buf, hdrSize+bodySize);
+			if(!cmpBuf(buf, hdrSize+bodySize))
+			{
+				printf("GATHER SEND DATA ERROR\n");  exit(1);
+			}
+			buf[0]=(char)255;
+			socket.send(buf, hdrSize+bodySize);
 			for(i=MINDATASIZE; i<=MAXDATASIZE; i*=2)
 			{
 				size=i;